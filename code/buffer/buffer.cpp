@@ -33,6 +33,12 @@ void Buffer::RetrieveAll() {
     writePos = 0;
 }
 
+void Buffer::Reallocate() {
+    std::vector<char>(v_buffer.size()).swap(v_buffer);
+    readPos = 0;
+    writePos = 0;
+}
+
 std::string Buffer::RetrieveAllToStr() {
     std::string str(Peek(), ReadableBytes());
     RetrieveAll();
@@ -33,6 +33,9 @@ public:
 
     std::string RetrieveAllToStr();
 
+    // 丢弃内容, 在调用线程上重新分配同样大小的空间, 页面由调用线程首次写入
+    void Reallocate();
+
     const char *BeginWriteConst() const;
 
     char *BeginWrite();
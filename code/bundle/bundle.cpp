@@ -0,0 +1,128 @@
+#include "bundle.h"
+
+BundleMapping::BundleMapping(char *base, size_t len) : b_base(base), b_len(len) {
+    b_header = reinterpret_cast<const BundleHeader *>(b_base);
+    b_entries = reinterpret_cast<const BundleEntry *>(b_base + b_header->indexOffset);
+}
+
+BundleMapping::~BundleMapping() {
+    munmap(b_base, b_len);
+}
+
+std::string_view BundleMapping::String(uint64_t off, uint32_t len) const {
+    return {b_base + b_header->stringOffset + off, len};
+}
+
+bool BundleMapping::Find(std::string_view path, BundleFile &file) const {
+    // 索引按路径排序, 二分查找
+    size_t lo = 0, hi = b_header->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const BundleEntry &entry = b_entries[mid];
+        int cmp = String(entry.pathOff, entry.pathLen).compare(path);
+        if (cmp == 0) {
+            file.data = b_base + entry.dataOff;
+            file.len = entry.dataLen;
+            file.gzip = entry.gzipLen ? b_base + entry.gzipOff : nullptr;
+            file.gzipLen = entry.gzipLen;
+            file.mime = String(entry.mimeOff, entry.mimeLen);
+            file.etag = String(entry.etagOff, entry.etagLen);
+            return true;
+        } else if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return false;
+}
+
+Bundle *Bundle::Instance() {
+    static Bundle bundle;
+    return &bundle;
+}
+
+bool Bundle::Load(const std::string &fileName, bool populate) {
+    auto mapping = Map(fileName, populate);
+    if (!mapping) {
+        return false;
+    }
+    std::lock_guard<std::mutex> locker(b_mutex);
+    b_fileName = fileName;
+    b_populate = populate;
+    std::atomic_store(&b_mapping, mapping);
+    LOG_INFO("Bundle %s loaded, files:%d", fileName.c_str(), (int) mapping->Count())
+    return true;
+}
+
+bool Bundle::Reload() {
+    std::string fileName;
+    bool populate;
+    {
+        std::lock_guard<std::mutex> locker(b_mutex);
+        fileName = b_fileName;
+        populate = b_populate;
+    }
+    if (fileName.empty()) {
+        return false;
+    }
+    return Load(fileName, populate);
+}
+
+std::shared_ptr<const BundleMapping> Bundle::Acquire() const {
+    return std::atomic_load(&b_mapping);
+}
+
+bool Bundle::IsOpen() const {
+    return static_cast<bool>(std::atomic_load(&b_mapping));
+}
+
+std::shared_ptr<const BundleMapping> Bundle::Map(const std::string &fileName, bool populate) {
+    int fd = open(fileName.data(), O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR("Bundle %s open error!", fileName.c_str())
+        return nullptr;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(BundleHeader)) {
+        LOG_ERROR("Bundle %s size error!", fileName.c_str())
+        close(fd);
+        return nullptr;
+    }
+    size_t len = st.st_size;
+    int flags = MAP_PRIVATE | (populate ? MAP_POPULATE : 0);
+    void *ret = mmap(nullptr, len, PROT_READ, flags, fd, 0);
+    close(fd);
+    if (ret == MAP_FAILED) {
+        LOG_ERROR("Bundle %s mmap error!", fileName.c_str())
+        return nullptr;
+    }
+#ifdef MADV_HUGEPAGE
+    // 内核支持只读文件大页时生效, 否则忽略
+    madvise(ret, len, MADV_HUGEPAGE);
+#endif
+    char *base = static_cast<char *>(ret);
+
+    // 校验头部和全部索引项, 之后查找时不再检查边界
+    const auto *header = reinterpret_cast<const BundleHeader *>(base);
+    bool valid = memcmp(header->magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) == 0
+                 && header->version == BUNDLE_VERSION
+                 && header->fileSize == len
+                 && header->indexOffset + uint64_t(header->count) * sizeof(BundleEntry) <= len
+                 && header->stringOffset + header->stringLen <= len;
+    const auto *entries = reinterpret_cast<const BundleEntry *>(base + header->indexOffset);
+    for (uint32_t i = 0; valid && i < header->count; ++i) {
+        const BundleEntry &entry = entries[i];
+        valid = entry.pathOff + entry.pathLen <= header->stringLen
+                && entry.mimeOff + entry.mimeLen <= header->stringLen
+                && entry.etagOff + entry.etagLen <= header->stringLen
+                && entry.dataOff + entry.dataLen <= len
+                && entry.gzipOff + entry.gzipLen <= len;
+    }
+    if (!valid) {
+        LOG_ERROR("Bundle %s format error!", fileName.c_str())
+        munmap(base, len);
+        return nullptr;
+    }
+    return std::make_shared<const BundleMapping>(base, len);
+}
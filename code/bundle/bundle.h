@@ -0,0 +1,73 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "bundle_format.h"
+#include "../log/log.h"
+
+struct BundleFile {
+    const char *data;
+    size_t len;
+    const char *gzip;
+    size_t gzipLen;
+    std::string_view mime;
+    std::string_view etag;
+};
+
+// 一次 mmap 的资源包, 由 shared_ptr 管理生命周期, 旧包在最后一个连接释放后解除映射
+class BundleMapping {
+public:
+    BundleMapping(char *base, size_t len);
+
+    ~BundleMapping();
+
+    BundleMapping(const BundleMapping &other) = delete;
+
+    BundleMapping &operator=(const BundleMapping &other) = delete;
+
+    bool Find(std::string_view path, BundleFile &file) const;
+
+    uint32_t Count() const { return b_header->count; }
+
+private:
+    std::string_view String(uint64_t off, uint32_t len) const;
+
+    char *b_base;
+    size_t b_len;
+    const BundleHeader *b_header;
+    const BundleEntry *b_entries;
+};
+
+class Bundle {
+public:
+    static Bundle *Instance();
+
+    // 加载成功后原子替换当前资源包
+    bool Load(const std::string &fileName, bool populate);
+
+    bool Reload();
+
+    std::shared_ptr<const BundleMapping> Acquire() const;
+
+    bool IsOpen() const;
+
+private:
+    Bundle() = default;
+
+    static std::shared_ptr<const BundleMapping> Map(const std::string &fileName, bool populate);
+
+    std::string b_fileName;
+    bool b_populate = false;
+    std::mutex b_mutex;
+    std::shared_ptr<const BundleMapping> b_mapping;
+};
+
+#endif //BUNDLE_H
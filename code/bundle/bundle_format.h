@@ -0,0 +1,54 @@
+#ifndef BUNDLE_FORMAT_H
+#define BUNDLE_FORMAT_H
+
+#include <cstdint>
+#include <cstring>
+
+// 静态资源包文件布局 (主机字节序):
+// | BundleHeader | BundleEntry[count] (按路径排序) | 字符串表 | 文件数据 (按页对齐) |
+// 字符串表存放路径, MIME 类型和 ETag, 均以偏移 + 长度引用
+
+static const char BUNDLE_MAGIC[8] = {'T', 'W', 'S', 'B', 'N', 'D', 'L', '1'};
+static const uint32_t BUNDLE_VERSION = 1;
+static const uint64_t BUNDLE_ALIGN = 4096;
+
+struct BundleHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t indexOffset;
+    uint64_t stringOffset;
+    uint64_t stringLen;
+    uint64_t fileSize;
+};
+
+struct BundleEntry {
+    uint64_t pathOff;
+    uint64_t mimeOff;
+    uint64_t etagOff;
+    uint32_t pathLen;
+    uint32_t mimeLen;
+    uint32_t etagLen;
+    uint32_t flags;
+    uint64_t dataOff;
+    uint64_t dataLen;
+    // 无 gzip 版本时 gzipLen 为 0
+    uint64_t gzipOff;
+    uint64_t gzipLen;
+};
+
+inline uint64_t BundleAlign(uint64_t off) {
+    return (off + BUNDLE_ALIGN - 1) & ~(BUNDLE_ALIGN - 1);
+}
+
+// FNV-1a, 用于生成 ETag
+inline uint64_t BundleHash(const char *data, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+#endif //BUNDLE_FORMAT_H
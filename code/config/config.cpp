@@ -1,11 +1,25 @@
 #include "config.h"
 
-Config::Config() {
-    Init();
+std::shared_ptr<const Config> Config::Load(const std::string &path, std::string *err) {
+    std::shared_ptr<Config> config(new Config());
+    try {
+        config->Init(path);
+    } catch (const std::exception &e) {
+        *err = path + ": " + e.what();
+        return nullptr;
+    }
+    *err = config->Validate();
+    if (!err->empty()) {
+        return nullptr;
+    }
+    return config;
 }
 
-void Config::Init() {
-    std::ifstream fin("./server_config.json");
+void Config::Init(const std::string &path) {
+    std::ifstream fin(path);
+    if (!fin) {
+        throw std::runtime_error("can not open");
+    }
     std::stringstream ss;
     ss << fin.rdbuf();
     std::string s(ss.str());
@@ -18,12 +32,246 @@ void Config::Init() {
 
     auto serverNode = config["server"];
     port = serverNode["port"].getInt();
+    listeners.clear();
+    for (auto &listener: serverNode["listeners"].getArray()) {
+        listeners.push_back({listener["address"].getString(), listener["backlog"].getInt(),
+                             listener["clientLimit"].getBool(), listener["tls"].getBool()});
+    }
     trigMode = serverNode["trigMode"].getInt();
     timeoutMs = serverNode["timeoutMs"].getInt();
     optLinger = serverNode["optLinger"].getBool();
     connPoolNum = serverNode["connPoolNum"].getInt();
     threadNum = serverNode["threadNum"].getInt();
+    threadMax = serverNode["threadMax"].getInt();
+    threadTargetWaitMs = serverNode["threadTargetWaitMs"].getInt();
+    threadIdleMs = serverNode["threadIdleMs"].getInt();
     openLog = serverNode["openLog"].getBool();
     logLevel = serverNode["logLevel"].getInt();
     logQueSize = serverNode["logQueSize"].getInt();
+    cacheMaxFileSize = serverNode["cacheMaxFileSize"].getInt();
+    bundlePath = serverNode["bundlePath"].getString();
+    bundlePopulate = serverNode["bundlePopulate"].getBool();
+    fileCacheEntries = serverNode["fileCacheEntries"].getInt();
+    ioThreadNum = serverNode["ioThreadNum"].getInt();
+    writeQuantum = serverNode["writeQuantum"].getInt();
+    notSentLowat = serverNode["notSentLowat"].getInt();
+    dbThreadNum = serverNode["dbThreadNum"].getInt();
+    dbQueueMax = serverNode["dbQueueMax"].getInt();
+    metricsPath = serverNode["metricsPath"].getString();
+
+    auto bwNode = serverNode["bandwidth"];
+    bwGlobalRate = bwNode["globalRate"].getInt();
+    bwPerIpRate = bwNode["perIpRate"].getInt();
+    bwRules.clear();
+    for (auto &rule: bwNode["rules"].getArray()) {
+        bwRules.push_back({rule["prefix"].getString(), rule["suffix"].getString(), rule["rate"].getInt()});
+    }
+
+    auto traceNode = serverNode["trace"];
+    traceSampleRate = traceNode["sampleRate"].getInt();
+    traceBufferSize = traceNode["bufferSize"].getInt();
+    traceFile = traceNode["file"].getString();
+
+    loopStallMs = serverNode["loopStallMs"].getInt();
+    drainTimeoutMs = serverNode["drainTimeoutMs"].getInt();
+
+    auto tlsNode = serverNode["tls"];
+    tlsCertFile = tlsNode["certFile"].getString();
+    tlsKeyFile = tlsNode["keyFile"].getString();
+    tlsSessionCacheSize = tlsNode["sessionCacheSize"].getInt();
+    tlsSessionTimeoutSec = tlsNode["sessionTimeoutSec"].getInt();
+    tlsKtls = tlsNode["ktls"].getBool();
+
+    auto http2Node = serverNode["http2"];
+    http2 = http2Node["enabled"].getBool();
+    http2MaxStreams = http2Node["maxConcurrentStreams"].getInt();
+
+    auto wsNode = serverNode["websocket"];
+    wsPath = wsNode["path"].getString();
+    wsRelay = wsNode["relay"].getBool();
+    wsPingMs = wsNode["pingIntervalMs"].getInt();
+    wsMaxMessage = wsNode["maxMessageSize"].getInt();
+    wsMaxQueue = wsNode["maxQueueBytes"].getInt();
+
+    auto affinityNode = serverNode["affinity"];
+    auto readCpus = [](Node &node, std::vector<int> &cpus) {
+        cpus.clear();
+        for (auto &cpu: node.getArray()) {
+            cpus.push_back(cpu.getInt());
+        }
+    };
+    readCpus(affinityNode["loop"], loopCpus);
+    readCpus(affinityNode["workers"], workerCpus);
+    readCpus(affinityNode["log"], logCpus);
+
+    auto busyPollNode = serverNode["busyPoll"];
+    busyPoll = busyPollNode["enabled"].getBool();
+    busyPollSpinUs = busyPollNode["spinUs"].getInt();
+    busyPollSocketUs = busyPollNode["socketUs"].getInt();
+
+    auto keepAliveNode = serverNode["keepAlive"];
+    keepAliveLowWater = keepAliveNode["lowWater"].getInt();
+    keepAliveHighWater = keepAliveNode["highWater"].getInt();
+    keepAliveMinMs = keepAliveNode["minTimeoutMs"].getInt();
+    memHighMB = keepAliveNode["memHighMB"].getInt();
+    maxConns = keepAliveNode["maxConns"].getInt();
+
+    auto slowNode = serverNode["slowClient"];
+    headerTimeoutMs = slowNode["headerTimeoutMs"].getInt();
+    minBodyRate = slowNode["minBodyRate"].getInt();
+    minSendRate = slowNode["minSendRate"].getInt();
+    slowGraceMs = slowNode["graceMs"].getInt();
+
+    auto clientNode = serverNode["clientLimit"];
+    ipMaxConns = clientNode["maxConns"].getInt();
+    ipRequestRate = clientNode["requestRate"].getInt();
+    ipRequestBurst = clientNode["requestBurst"].getInt();
+    ipDbCost = clientNode["dbRequestCost"].getInt();
+    ipMaxEntries = clientNode["maxEntries"].getInt();
+
+    auto admitNode = serverNode["admission"];
+    admitMinLimit = admitNode["minLimit"].getInt();
+    admitMaxLimit = admitNode["maxLimit"].getInt();
+    admitTargetMs = admitNode["targetQueueMs"].getInt();
+    admitDeadlineMs = admitNode["deadlineMs"].getInt();
+    retryAfter = admitNode["retryAfter"].getInt();
+}
+
+std::string Config::Validate() const {
+    // 0 一般表示关闭或使用默认值, 负数都视为配置错误, 不在使用处各自兜底
+    if (sqlPort <= 0 || sqlPort > 65535) { return "mysql port out of range [1, 65535]"; }
+    if (port < 1024 || port > 65535) { return "port out of range [1024, 65535]"; }
+    if (trigMode < 0 || trigMode > 3) { return "trigMode out of range [0, 3]"; }
+    if (logLevel < 0 || logLevel > 3) { return "logLevel out of range [0, 3]"; }
+    if (timeoutMs < 0) { return "timeoutMs is negative"; }
+    if (connPoolNum <= 0) { return "connPoolNum must be positive"; }
+    if (threadNum <= 0) { return "threadNum must be positive"; }
+    if (threadMax < 0 || dbThreadNum < 0 || ioThreadNum < 0) { return "thread count is negative"; }
+    if (threadTargetWaitMs < 0 || threadIdleMs < 0) { return "thread pool timing is negative"; }
+    if (dbQueueMax < 0) { return "dbQueueMax is negative"; }
+    if (logQueSize < 0) { return "logQueSize is negative"; }
+    if (cacheMaxFileSize < 0 || fileCacheEntries < 0) { return "cache size is negative"; }
+    if (writeQuantum < 0 || notSentLowat < 0) { return "writeQuantum/notSentLowat is negative"; }
+    if (loopStallMs < 0) { return "loopStallMs is negative"; }
+    if (drainTimeoutMs < 0) { return "drainTimeoutMs is negative"; }
+    if (tlsSessionCacheSize < 0 || tlsSessionTimeoutSec < 0) { return "tls session settings are negative"; }
+    if (http2 && http2MaxStreams <= 0) { return "http2 maxConcurrentStreams must be positive"; }
+    if (http2MaxStreams < 0) { return "http2 maxConcurrentStreams is negative"; }
+    if (wsPingMs < 0 || wsMaxMessage < 0 || wsMaxQueue < 0) { return "websocket limits are negative"; }
+    if (!wsPath.empty() && (wsPingMs <= 0 || wsMaxMessage <= 0 || wsMaxQueue <= 0)) {
+        return "websocket limits must be positive";
+    }
+    if (bwGlobalRate < 0 || bwPerIpRate < 0) { return "bandwidth rate is negative"; }
+    if (traceSampleRate < 0) { return "trace sampleRate is negative"; }
+    if (traceSampleRate > 0 && traceBufferSize <= 0) { return "trace bufferSize must be positive"; }
+    if (admitMinLimit < 0 || admitMaxLimit < 0 || admitTargetMs < 0 || admitDeadlineMs < 0 || retryAfter < 0) {
+        return "admission settings are negative";
+    }
+    if (admitMaxLimit > 0 && admitMinLimit > admitMaxLimit) { return "admission minLimit > maxLimit"; }
+    if (keepAliveLowWater < 0 || keepAliveHighWater < 0 || keepAliveMinMs < 0 || memHighMB < 0 || maxConns < 0) {
+        return "keepAlive settings are negative";
+    }
+    if (keepAliveHighWater > 0 && keepAliveLowWater > keepAliveHighWater) { return "keepAlive lowWater > highWater"; }
+    if (headerTimeoutMs < 0 || minBodyRate < 0 || minSendRate < 0 || slowGraceMs < 0) {
+        return "slowClient settings are negative";
+    }
+    if (busyPollSpinUs < 0 || busyPollSocketUs < 0) { return "busyPoll settings are negative"; }
+    if (ipRequestRate < 0 || ipMaxConns < 0 || ipRequestBurst < 0 || ipDbCost < 0 || ipMaxEntries < 0) {
+        return "clientLimit is negative";
+    }
+    for (const auto *cpus: {&loopCpus, &workerCpus, &logCpus}) {
+        for (int cpu: *cpus) {
+            if (cpu < 0) { return "affinity cpu is negative"; }
+        }
+    }
+    for (const auto &listener: listeners) {
+        if (listener.address.empty()) { return "listener address is empty"; }
+        if (listener.backlog <= 0) { return "listener backlog must be positive"; }
+        if (listener.tls && (tlsCertFile.empty() || tlsKeyFile.empty())) { return "tls listener needs certFile"; }
+    }
+    for (const auto &rule: bwRules) {
+        if (rule.rate <= 0) { return "bandwidth rule rate must be positive"; }
+    }
+    return "";
+}
+
+void Config::Diff(const Config &before, const Config &after,
+                  std::vector<std::string> &live, std::vector<std::string> &restart) {
+#define CONFIG_DIFF(field, isLive) \
+    if (!(before.field == after.field)) { ((isLive) ? live : restart).emplace_back(#field); }
+    CONFIG_DIFF(port, false)
+    CONFIG_DIFF(listeners, false)
+    CONFIG_DIFF(tlsCertFile, false)
+    CONFIG_DIFF(tlsKeyFile, false)
+    CONFIG_DIFF(tlsSessionCacheSize, false)
+    CONFIG_DIFF(tlsSessionTimeoutSec, false)
+    CONFIG_DIFF(tlsKtls, false)
+    CONFIG_DIFF(http2, false)
+    CONFIG_DIFF(http2MaxStreams, false)
+    CONFIG_DIFF(wsPath, false)
+    CONFIG_DIFF(wsRelay, false)
+    CONFIG_DIFF(wsMaxMessage, false)
+    CONFIG_DIFF(wsMaxQueue, false)
+    CONFIG_DIFF(trigMode, false)
+    CONFIG_DIFF(optLinger, false)
+    CONFIG_DIFF(sqlPort, false)
+    CONFIG_DIFF(sqlUser, false)
+    CONFIG_DIFF(sqlPwd, false)
+    CONFIG_DIFF(dbName, false)
+    CONFIG_DIFF(openLog, false)
+    CONFIG_DIFF(logQueSize, false)
+    CONFIG_DIFF(cacheMaxFileSize, false)
+    CONFIG_DIFF(bundlePath, false)
+    CONFIG_DIFF(bundlePopulate, false)
+    CONFIG_DIFF(fileCacheEntries, false)
+    CONFIG_DIFF(ioThreadNum, false)
+    CONFIG_DIFF(writeQuantum, false)
+    CONFIG_DIFF(metricsPath, false)
+    CONFIG_DIFF(bwGlobalRate, false)
+    CONFIG_DIFF(bwPerIpRate, false)
+    CONFIG_DIFF(bwRules, false)
+    CONFIG_DIFF(loopStallMs, false)
+    CONFIG_DIFF(retryAfter, false)
+    CONFIG_DIFF(loopCpus, false)
+    CONFIG_DIFF(workerCpus, false)
+    CONFIG_DIFF(logCpus, false)
+    CONFIG_DIFF(busyPoll, false)
+    CONFIG_DIFF(busyPollSpinUs, false)
+    CONFIG_DIFF(busyPollSocketUs, false)
+    CONFIG_DIFF(ipMaxEntries, false)
+    // 开关类的变化需要重启, 只调整取值的可以在线生效
+    CONFIG_DIFF(timeoutMs, (before.timeoutMs > 0) == (after.timeoutMs > 0))
+    CONFIG_DIFF(admitMaxLimit, (before.admitMaxLimit > 0) == (after.admitMaxLimit > 0))
+    CONFIG_DIFF(ipMaxConns, (before.ipMaxConns > 0) == (after.ipMaxConns > 0))
+    CONFIG_DIFF(ipRequestRate, (before.ipRequestRate > 0 || before.ipMaxConns > 0) ==
+                               (after.ipRequestRate > 0 || after.ipMaxConns > 0))
+    CONFIG_DIFF(dbThreadNum, (before.dbThreadNum > 0) == (after.dbThreadNum > 0))
+    CONFIG_DIFF(logLevel, true)
+    CONFIG_DIFF(connPoolNum, true)
+    CONFIG_DIFF(threadNum, true)
+    CONFIG_DIFF(threadMax, true)
+    CONFIG_DIFF(threadTargetWaitMs, true)
+    CONFIG_DIFF(threadIdleMs, true)
+    CONFIG_DIFF(dbQueueMax, true)
+    CONFIG_DIFF(drainTimeoutMs, true)
+    CONFIG_DIFF(notSentLowat, true)
+    CONFIG_DIFF(traceSampleRate, true)
+    CONFIG_DIFF(traceBufferSize, true)
+    CONFIG_DIFF(traceFile, true)
+    CONFIG_DIFF(admitMinLimit, true)
+    CONFIG_DIFF(admitTargetMs, true)
+    CONFIG_DIFF(admitDeadlineMs, true)
+    CONFIG_DIFF(keepAliveLowWater, true)
+    CONFIG_DIFF(keepAliveHighWater, true)
+    CONFIG_DIFF(keepAliveMinMs, true)
+    CONFIG_DIFF(memHighMB, true)
+    CONFIG_DIFF(maxConns, true)
+    CONFIG_DIFF(headerTimeoutMs, true)
+    CONFIG_DIFF(minBodyRate, true)
+    CONFIG_DIFF(minSendRate, true)
+    CONFIG_DIFF(slowGraceMs, true)
+    CONFIG_DIFF(wsPingMs, true)
+    CONFIG_DIFF(ipRequestBurst, true)
+    CONFIG_DIFF(ipDbCost, true)
+#undef CONFIG_DIFF
 }
@@ -3,14 +3,47 @@
 
 #include <unistd.h>
 #include <string>
+#include <vector>
+#include <memory>
 
 #include "json_util.h"
 
+// 限速规则: 路径前缀或扩展名匹配, rate 为单连接字节/秒
+struct BandwidthRule {
+    std::string prefix;
+    std::string suffix;
+    int64_t rate;
+
+    bool operator==(const BandwidthRule &other) const {
+        return prefix == other.prefix && suffix == other.suffix && rate == other.rate;
+    }
+};
+
+// 额外的监听地址: "127.0.0.1:9007", "[::]:9006", "unix:/run/tws.sock"
+// clientLimit 为 false 时不做单 IP 限制, 用于同机代理等来源; tls 为 true 时使用 tls 节点的证书
+struct ListenerConfig {
+    std::string address;
+    int backlog;
+    bool clientLimit;
+    bool tls;
+
+    bool operator==(const ListenerConfig &other) const {
+        return address == other.address && backlog == other.backlog && clientLimit == other.clientLimit &&
+               tls == other.tls;
+    }
+};
+
+// 一次读取得到的完整配置, 发布后不再修改, 热加载时整体替换
 class Config {
 public:
-    Config();
+    // 解析并校验, 失败时返回空并在 err 中给出原因
+    static std::shared_ptr<const Config> Load(const std::string &path, std::string *err);
+
+    // 两份配置中取值不同的字段, 分为可以在线生效和需要重启两类
+    static void Diff(const Config &before, const Config &after,
+                     std::vector<std::string> &live, std::vector<std::string> &restart);
 
-    void Init();
+    static constexpr const char *PATH = "./server_config.json";
 
     int sqlPort;
     std::string sqlUser;
@@ -18,6 +51,7 @@ public:
     std::string dbName;
 
     int port;
+    std::vector<ListenerConfig> listeners;
     int trigMode;
     int timeoutMs;
     bool optLinger;
@@ -26,6 +60,98 @@ public:
     bool openLog;
     int logLevel;
     int logQueSize;
+    int cacheMaxFileSize;
+    std::string bundlePath;
+    bool bundlePopulate;
+    int fileCacheEntries;
+    int ioThreadNum;
+    int writeQuantum;
+    int notSentLowat;
+    std::string metricsPath;
+
+    // 下载限速(字节/秒), 没有规则时关闭; 全局和单 IP 的上限只作用于命中规则的响应, 0 表示不限
+    // 例: "bandwidth": {"globalRate": 52428800, "perIpRate": 10485760,
+    //                   "rules": [{"prefix": "/video/", "suffix": "", "rate": 4194304}]}
+    int bwGlobalRate;
+    int bwPerIpRate;
+    std::vector<BandwidthRule> bwRules;
+
+    // 每 sampleRate 个请求采样一个, 0 时关闭; 收到 SIGUSR2 时写入 file
+    // 例: "trace": {"sampleRate": 100, "bufferSize": 4096, "file": "./trace.json"}
+    int traceSampleRate;
+    int traceBufferSize;
+    std::string traceFile;
+
+    int loopStallMs;
+
+    std::string tlsCertFile;
+    std::string tlsKeyFile;
+    int tlsSessionCacheSize;
+    int tlsSessionTimeoutSec;
+    bool tlsKtls;
+
+    // h2c 连接前言和 TLS 上的 ALPN h2, 默认关闭; 例: "http2": {"enabled": true, "maxConcurrentStreams": 128}
+    bool http2;
+    int http2MaxStreams;
+
+    // WebSocket 握手路径, 为空时关闭; 一个周期内没有收到帧时发送 Ping, 再过一个周期关闭
+    std::string wsPath;
+    // 把客户端发来的消息广播给所有连接, 任何客户端都能向其他人推送内容, 只用于演示和测试
+    bool wsRelay;
+    int wsPingMs;
+    int wsMaxMessage;
+    int wsMaxQueue;
+
+    // 优雅退出/升级时等待已有请求完成的最长时间
+    int drainTimeoutMs;
+
+    int admitMinLimit;
+    int admitMaxLimit;
+    int admitTargetMs;
+    int admitDeadlineMs;
+    int retryAfter;
+
+    int dbThreadNum;
+    int dbQueueMax;
+
+    int threadMax;
+    int threadTargetWaitMs;
+    int threadIdleMs;
+
+    std::vector<int> loopCpus;
+    std::vector<int> workerCpus;
+    std::vector<int> logCpus;
+
+    bool busyPoll;
+    int busyPollSpinUs;
+    int busyPollSocketUs;
+
+    int keepAliveLowWater;
+    int keepAliveHighWater;
+    int keepAliveMinMs;
+    int memHighMB;
+    int maxConns;
+
+    int headerTimeoutMs;
+    int minBodyRate;
+    int minSendRate;
+    int slowGraceMs;
+
+    // 单 IP 的连接数和请求速率(个/秒), 都为 0 时关闭; 经过反向代理时所有请求来自同一 IP, 应在代理上限制
+    // 例: "clientLimit": {"maxConns": 256, "requestRate": 200, "requestBurst": 400, "dbRequestCost": 10, ...}
+    int ipMaxConns;
+    int ipRequestRate;
+    int ipRequestBurst;
+    int ipDbCost;
+    int ipMaxEntries;
+
+private:
+    Config() = default;
+
+    // 字段缺失或类型不符时抛出异常
+    void Init(const std::string &path);
+
+    std::string Validate() const;
 };
 
 #endif //CONFIG_H
@@ -63,6 +63,13 @@ struct Node {
         throw std::runtime_error("not a bool");
     }
 
+    Array &getArray() {
+        if (auto object = std::get_if<Array>(&value)) {
+            return *object;
+        }
+        throw std::runtime_error("not an array");
+    }
+
     void push(const Node &rhs) {
         if (auto array = std::get_if<Array>(&value)) {
             array->push_back(rhs);
@@ -106,6 +113,10 @@ struct JsonParser {
 
     std::optional<Value> parse_number() {
         size_t endPos = pos;
+        // 负数交给 Config::Validate 报告具体字段, 不在解析时失败
+        if (endPos < json_str.size() && json_str[endPos] == '-') {
+            ++endPos;
+        }
         while (endPos < json_str.size() && (
                 std::isdigit(json_str[endPos]) ||
                 json_str[endPos] == 'e' ||
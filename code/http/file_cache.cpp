@@ -0,0 +1,119 @@
+#include "file_cache.h"
+
+#include <algorithm>
+
+std::shared_ptr<const MappedFile> MappedFile::Open(const std::string &fileName, size_t len) {
+    if (len == 0) {
+        return nullptr;
+    }
+    int fd = open(fileName.data(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    // MAP_PRIVATE 建立一个写入时拷贝的私有映射
+    void *ret = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ret == MAP_FAILED) {
+        return nullptr;
+    }
+    return std::make_shared<const MappedFile>(static_cast<char *>(ret), len);
+}
+
+FileCache *FileCache::Instance() {
+    static FileCache cache;
+    return &cache;
+}
+
+void FileCache::Init(size_t maxEntries) {
+    f_maxEntries = maxEntries;
+    Clear();
+}
+
+void FileCache::Close() {
+    f_maxEntries = 0;
+    Clear();
+}
+
+bool FileCache::Stat(const std::string &srcDir, const std::string &path, struct stat &st) {
+    if (!IsOpen()) {
+        return stat((srcDir + path).data(), &st) == 0;
+    }
+    Shard &shard = ShardOf(path);
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> locker(shard.mutex);
+        auto it = shard.entries.find(path);
+        if (it != shard.entries.end()) {
+            st = it->second.st;
+            return it->second.exist;
+        }
+        generation = shard.generation;
+    }
+    // 不存在的路径也缓存, 由目录的 IN_CREATE 事件失效
+    Entry entry{false, {}, nullptr};
+    bool exist = stat((srcDir + path).data(), &entry.st) == 0;
+    entry.exist = exist;
+    st = entry.st;
+    std::lock_guard<std::mutex> locker(shard.mutex);
+    // stat 期间发生过失效则不缓存, 避免写入旧数据
+    if (generation == shard.generation) {
+        Insert(shard, path, std::move(entry));
+    }
+    return exist;
+}
+
+std::shared_ptr<const MappedFile> FileCache::Map(const std::string &srcDir, const std::string &path,
+                                                 const struct stat &st) {
+    if (!IsOpen()) {
+        return MappedFile::Open(srcDir + path, st.st_size);
+    }
+    Shard &shard = ShardOf(path);
+    {
+        std::lock_guard<std::mutex> locker(shard.mutex);
+        auto it = shard.entries.find(path);
+        if (it != shard.entries.end() && it->second.mapped) {
+            return it->second.mapped;
+        }
+    }
+    auto mapped = MappedFile::Open(srcDir + path, st.st_size);
+    if (!mapped) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> locker(shard.mutex);
+    auto it = shard.entries.find(path);
+    if (it != shard.entries.end() && it->second.st.st_ino == st.st_ino
+        && it->second.st.st_mtime == st.st_mtime) {
+        // 映射期间条目可能已失效, 只有元数据一致时才缓存
+        it->second.mapped = mapped;
+    }
+    return mapped;
+}
+
+void FileCache::Invalidate(const std::string &path) {
+    Shard &shard = ShardOf(path);
+    std::lock_guard<std::mutex> locker(shard.mutex);
+    ++shard.generation;
+    shard.entries.erase(path);
+}
+
+void FileCache::Clear() {
+    for (auto &shard: f_shards) {
+        std::lock_guard<std::mutex> locker(shard.mutex);
+        ++shard.generation;
+        shard.entries.clear();
+    }
+}
+
+FileCache::Shard &FileCache::ShardOf(const std::string &path) {
+    return f_shards[std::hash<std::string>()(path) % SHARD_NUM];
+}
+
+void FileCache::Insert(Shard &shard, const std::string &path, Entry entry) {
+    // 路径由客户端决定, 分片满时逐出一个条目以限制内存, 不清空其余的热点条目
+    size_t maxEntries = std::max(f_maxEntries.load(std::memory_order_relaxed) / SHARD_NUM, static_cast<size_t>(1));
+    if (shard.entries.size() >= maxEntries && !shard.entries.count(path)) {
+        LOG_DEBUG("FileCache shard full, evict %s", shard.entries.begin()->first.c_str())
+        shard.entries.erase(shard.entries.begin());
+    }
+    shard.entries.insert_or_assign(path, std::move(entry));
+}
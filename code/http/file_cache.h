@@ -0,0 +1,88 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "../log/log.h"
+
+// 只读文件映射, 最后一个引用释放时解除映射
+class MappedFile {
+public:
+    MappedFile(char *data, size_t len) : m_data(data), m_len(len) {}
+
+    ~MappedFile() { munmap(m_data, m_len); }
+
+    MappedFile(const MappedFile &other) = delete;
+
+    MappedFile &operator=(const MappedFile &other) = delete;
+
+    char *Data() const { return m_data; }
+
+    size_t Len() const { return m_len; }
+
+    static std::shared_ptr<const MappedFile> Open(const std::string &fileName, size_t len);
+
+private:
+    char *m_data;
+    size_t m_len;
+};
+
+// 文件元数据与映射缓存, 由 FileWatcher 通知失效, 稳定状态下请求不再 stat/open/mmap
+// 未开启时直接访问文件系统; 与 ResponseCache 一样按路径分片加锁, 每个分片单独限制条目数
+class FileCache {
+public:
+    static FileCache *Instance();
+
+    void Init(size_t maxEntries);
+
+    void Close();
+
+    bool IsOpen() const { return f_maxEntries > 0; }
+
+    // 语义同 stat: 失败返回 false
+    bool Stat(const std::string &srcDir, const std::string &path, struct stat &st);
+
+    std::shared_ptr<const MappedFile> Map(const std::string &srcDir, const std::string &path,
+                                          const struct stat &st);
+
+    void Invalidate(const std::string &path);
+
+    void Clear();
+
+private:
+    FileCache() = default;
+
+    static constexpr size_t SHARD_NUM = 16;
+
+    struct Entry {
+        bool exist;
+        struct stat st;
+        std::shared_ptr<const MappedFile> mapped;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        // 分片内发生失效的次数, stat 期间变化时不写入
+        uint64_t generation = 0;
+        std::unordered_map<std::string, Entry> entries;
+    };
+
+    Shard &ShardOf(const std::string &path);
+
+    // 在 shard.mutex 内调用
+    void Insert(Shard &shard, const std::string &path, Entry entry);
+
+    std::atomic<size_t> f_maxEntries{0};
+
+    Shard f_shards[SHARD_NUM];
+};
+
+#endif //FILE_CACHE_H
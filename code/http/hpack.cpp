@@ -0,0 +1,373 @@
+#include "hpack.h"
+
+#include <algorithm>
+#include <mutex>
+
+namespace {
+    struct HuffmanCode {
+        uint32_t code;
+        int bits;
+    };
+
+    struct HeaderField {
+        const char *name;
+        const char *value;
+    };
+
+    // RFC 7541 附录 B, 最后一项为 EOS
+    const HuffmanCode HUFFMAN_CODES[257] = {
+            {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28},
+            {0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+            {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28},
+            {0xfffffef, 28}, {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+            {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+            {0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12}, {0x1ff9, 13},
+            {0x15, 6}, {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11}, {0xfa, 8}, {0x16, 6},
+            {0x17, 6}, {0x18, 6}, {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+            {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8}, {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+            {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7}, {0x63, 7},
+            {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7},
+            {0x6d, 7}, {0x6e, 7}, {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7}, {0xfd, 8},
+            {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6}, {0x7ffd, 15}, {0x3, 5}, {0x23, 6},
+            {0x4, 5}, {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7}, {0x28, 6},
+            {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7},
+            {0x78, 7}, {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13},
+            {0xffffffc, 28}, {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20}, {0x3fffd3, 22},
+            {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23},
+            {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23}, {0xffffec, 24},
+            {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23},
+            {0x7fffe3, 23}, {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23}, {0x3fffd9, 22},
+            {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20},
+            {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21}, {0x7fffea, 23},
+            {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23},
+            {0x7fffec, 23}, {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21}, {0x7fffed, 23},
+            {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22},
+            {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23}, {0x3ffffe0, 26},
+            {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22},
+            {0x1ffffec, 25}, {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27}, {0x7ffffdf, 27},
+            {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26},
+            {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24}, {0x1fffe4, 21},
+            {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27},
+            {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21}, {0x3fffe9, 22},
+            {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25},
+            {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23}, {0x3ffffeb, 26},
+            {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27},
+            {0x7ffffea, 27}, {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27}, {0x7ffffee, 27},
+            {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30}
+    };
+
+    // RFC 7541 附录 A, 下标从 1 开始
+    const HeaderField STATIC_TABLE[] = {
+            {":authority", ""},
+            {":method", "GET"},
+            {":method", "POST"},
+            {":path", "/"},
+            {":path", "/index.html"},
+            {":scheme", "http"},
+            {":scheme", "https"},
+            {":status", "200"},
+            {":status", "204"},
+            {":status", "206"},
+            {":status", "304"},
+            {":status", "400"},
+            {":status", "404"},
+            {":status", "500"},
+            {"accept-charset", ""},
+            {"accept-encoding", "gzip, deflate"},
+            {"accept-language", ""},
+            {"accept-ranges", ""},
+            {"accept", ""},
+            {"access-control-allow-origin", ""},
+            {"age", ""},
+            {"allow", ""},
+            {"authorization", ""},
+            {"cache-control", ""},
+            {"content-disposition", ""},
+            {"content-encoding", ""},
+            {"content-language", ""},
+            {"content-length", ""},
+            {"content-location", ""},
+            {"content-range", ""},
+            {"content-type", ""},
+            {"cookie", ""},
+            {"date", ""},
+            {"etag", ""},
+            {"expect", ""},
+            {"expires", ""},
+            {"from", ""},
+            {"host", ""},
+            {"if-match", ""},
+            {"if-modified-since", ""},
+            {"if-none-match", ""},
+            {"if-range", ""},
+            {"if-unmodified-since", ""},
+            {"last-modified", ""},
+            {"link", ""},
+            {"location", ""},
+            {"max-forwards", ""},
+            {"proxy-authenticate", ""},
+            {"proxy-authorization", ""},
+            {"range", ""},
+            {"referer", ""},
+            {"refresh", ""},
+            {"retry-after", ""},
+            {"server", ""},
+            {"set-cookie", ""},
+            {"strict-transport-security", ""},
+            {"transfer-encoding", ""},
+            {"user-agent", ""},
+            {"vary", ""},
+            {"via", ""},
+            {"www-authenticate", ""},
+    };
+
+    // 动态表每项额外计 32 字节
+    const size_t ENTRY_OVERHEAD = 32;
+    const int EOS = 256;
+
+    // 按码字逐位走的解码树, 叶子保存符号
+    struct HuffmanNode {
+        int child[2] = {-1, -1};
+        int symbol = -1;
+    };
+
+    const std::vector<HuffmanNode> &HuffmanTree() {
+        static std::vector<HuffmanNode> tree;
+        static std::once_flag once;
+        std::call_once(once, [] {
+            tree.emplace_back();
+            for (int symbol = 0; symbol <= EOS; ++symbol) {
+                int node = 0;
+                for (int i = HUFFMAN_CODES[symbol].bits - 1; i >= 0; --i) {
+                    int bit = (HUFFMAN_CODES[symbol].code >> i) & 1;
+                    if (tree[node].child[bit] < 0) {
+                        tree[node].child[bit] = static_cast<int>(tree.size());
+                        tree.emplace_back();
+                    }
+                    node = tree[node].child[bit];
+                }
+                tree[node].symbol = symbol;
+            }
+        });
+        return tree;
+    }
+}
+
+HpackTable::HpackTable(size_t maxSize) : h_size(0), h_maxSize(maxSize) {}
+
+const std::pair<std::string, std::string> *HpackTable::Get(size_t index) const {
+    if (index <= STATIC_SIZE || index - STATIC_SIZE > h_entries.size()) {
+        return nullptr;
+    }
+    return &h_entries[index - STATIC_SIZE - 1];
+}
+
+void HpackTable::Insert(std::string_view name, std::string_view value) {
+    size_t size = name.size() + value.size() + ENTRY_OVERHEAD;
+    if (size > h_maxSize) {
+        // 放不下的字段清空整个表
+        h_entries.clear();
+        h_size = 0;
+        return;
+    }
+    h_entries.emplace_front(std::string(name), std::string(value));
+    h_size += size;
+    Evict();
+}
+
+void HpackTable::Resize(size_t maxSize) {
+    h_maxSize = maxSize;
+    Evict();
+}
+
+void HpackTable::Evict() {
+    while (h_size > h_maxSize && !h_entries.empty()) {
+        h_size -= h_entries.back().first.size() + h_entries.back().second.size() + ENTRY_OVERHEAD;
+        h_entries.pop_back();
+    }
+}
+
+size_t HpackTable::Find(std::string_view name, std::string_view value, size_t *nameIndex) const {
+    *nameIndex = 0;
+    for (size_t i = 0; i < STATIC_SIZE; ++i) {
+        if (name != STATIC_TABLE[i].name) { continue; }
+        if (value == STATIC_TABLE[i].value) { return i + 1; }
+        if (!*nameIndex) { *nameIndex = i + 1; }
+    }
+    for (size_t i = 0; i < h_entries.size(); ++i) {
+        if (name != h_entries[i].first) { continue; }
+        if (value == h_entries[i].second) { return STATIC_SIZE + i + 1; }
+        if (!*nameIndex) { *nameIndex = STATIC_SIZE + i + 1; }
+    }
+    return 0;
+}
+
+HpackDecoder::HpackDecoder(size_t maxSize) : h_table(maxSize), h_settingSize(maxSize) {}
+
+bool HpackDecoder::Decode(const uint8_t *data, size_t len, HeaderList &headers, size_t maxListSize) {
+    const uint8_t *p = data;
+    const uint8_t *end = data + len;
+    size_t listSize = 0;
+    bool isFieldSeen = false;
+    while (p < end) {
+        uint64_t index = 0;
+        std::string name, value;
+        bool isIndexing = false;
+        if (*p & 0x80) {
+            // 索引字段
+            if (!DecodeInt(p, end, 7, &index) || index == 0) { return false; }
+            if (index <= HpackTable::STATIC_SIZE) {
+                name = STATIC_TABLE[index - 1].name;
+                value = STATIC_TABLE[index - 1].value;
+            } else {
+                auto *field = h_table.Get(index);
+                if (!field) { return false; }
+                name = field->first;
+                value = field->second;
+            }
+        } else if ((*p & 0xe0) == 0x20) {
+            // 动态表大小更新, 只能出现在头部块开头
+            if (isFieldSeen || !DecodeInt(p, end, 5, &index) || index > h_settingSize) { return false; }
+            h_table.Resize(index);
+            continue;
+        } else {
+            // 字面值: 增量索引 01xxxxxx, 不索引 0000xxxx, 永不索引 0001xxxx
+            isIndexing = (*p & 0xc0) == 0x40;
+            if (!DecodeInt(p, end, isIndexing ? 6 : 4, &index)) { return false; }
+            if (index == 0) {
+                if (!DecodeString(p, end, &name)) { return false; }
+            } else if (index <= HpackTable::STATIC_SIZE) {
+                name = STATIC_TABLE[index - 1].name;
+            } else {
+                auto *field = h_table.Get(index);
+                if (!field) { return false; }
+                name = field->first;
+            }
+            if (!DecodeString(p, end, &value)) { return false; }
+            if (isIndexing) { h_table.Insert(name, value); }
+        }
+        isFieldSeen = true;
+        listSize += name.size() + value.size() + ENTRY_OVERHEAD;
+        if (listSize > maxListSize) { return false; }
+        headers.emplace_back(std::move(name), std::move(value));
+    }
+    return true;
+}
+
+bool HpackDecoder::DecodeInt(const uint8_t *&p, const uint8_t *end, int prefix, uint64_t *value) {
+    uint64_t max = (1u << prefix) - 1;
+    *value = *p++ & max;
+    if (*value < max) {
+        return true;
+    }
+    for (int shift = 0; p < end && shift <= 28; shift += 7) {
+        uint8_t byte = *p++;
+        *value += static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) { return true; }
+    }
+    return false;
+}
+
+bool HpackDecoder::DecodeString(const uint8_t *&p, const uint8_t *end, std::string *out) {
+    if (p >= end) {
+        return false;
+    }
+    bool isHuffman = *p & 0x80;
+    uint64_t len = 0;
+    if (!DecodeInt(p, end, 7, &len) || len > static_cast<uint64_t>(end - p)) {
+        return false;
+    }
+    const uint8_t *begin = p;
+    p += len;
+    if (isHuffman) {
+        return DecodeHuffman(begin, len, out);
+    }
+    out->assign(reinterpret_cast<const char *>(begin), len);
+    return true;
+}
+
+bool HpackDecoder::DecodeHuffman(const uint8_t *p, size_t len, std::string *out) {
+    const std::vector<HuffmanNode> &tree = HuffmanTree();
+    out->clear();
+    out->reserve(len * 8 / 5);
+    int node = 0;
+    int pendingBits = 0;
+    bool isAllOnes = true;
+    for (size_t i = 0; i < len; ++i) {
+        for (int shift = 7; shift >= 0; --shift) {
+            int bit = (p[i] >> shift) & 1;
+            node = tree[node].child[bit];
+            if (node < 0) { return false; }
+            ++pendingBits;
+            isAllOnes = isAllOnes && bit;
+            if (tree[node].symbol >= 0) {
+                if (tree[node].symbol == EOS) { return false; }
+                out->push_back(static_cast<char>(tree[node].symbol));
+                node = 0;
+                pendingBits = 0;
+                isAllOnes = true;
+            }
+        }
+    }
+    // 结尾的填充必须是不超过 7 位的 EOS 前缀
+    return pendingBits <= 7 && isAllOnes;
+}
+
+HpackEncoder::HpackEncoder() : h_table(4096), h_pendingSize(4096), h_isSizeChanged(false) {}
+
+void HpackEncoder::SetMaxSize(size_t maxSize) {
+    // 动态表最多使用默认的 4096 字节
+    h_pendingSize = std::min(maxSize, static_cast<size_t>(4096));
+    h_isSizeChanged = h_pendingSize != h_table.MaxSize();
+}
+
+void HpackEncoder::Begin(Buffer &out) {
+    if (!h_isSizeChanged) {
+        return;
+    }
+    h_table.Resize(h_pendingSize);
+    EncodeInt(out, 0x20, 5, h_pendingSize);
+    h_isSizeChanged = false;
+}
+
+void HpackEncoder::Encode(Buffer &out, std::string_view name, std::string_view value, bool isIndexed) {
+    size_t nameIndex = 0;
+    size_t index = h_table.Find(name, value, &nameIndex);
+    if (index) {
+        EncodeInt(out, 0x80, 7, index);
+        return;
+    }
+    if (isIndexed) {
+        EncodeInt(out, 0x40, 6, nameIndex);
+        h_table.Insert(name, value);
+    } else {
+        EncodeInt(out, 0x00, 4, nameIndex);
+    }
+    if (!nameIndex) {
+        EncodeString(out, name);
+    }
+    EncodeString(out, value);
+}
+
+void HpackEncoder::EncodeInt(Buffer &out, uint8_t flags, int prefix, uint64_t value) {
+    uint8_t bytes[16];
+    size_t len = 0;
+    uint64_t max = (1u << prefix) - 1;
+    if (value < max) {
+        bytes[len++] = flags | static_cast<uint8_t>(value);
+    } else {
+        bytes[len++] = flags | static_cast<uint8_t>(max);
+        value -= max;
+        while (value >= 0x80) {
+            bytes[len++] = static_cast<uint8_t>(value & 0x7f) | 0x80;
+            value >>= 7;
+        }
+        bytes[len++] = static_cast<uint8_t>(value);
+    }
+    out.Append(bytes, len);
+}
+
+void HpackEncoder::EncodeString(Buffer &out, std::string_view str) {
+    EncodeInt(out, 0x00, 7, str.size());
+    out.Append(str.data(), str.size());
+}
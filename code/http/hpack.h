@@ -0,0 +1,87 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "../buffer/buffer.h"
+
+// HPACK 头部压缩 (RFC 7541): 静态表, 动态表和 Huffman 解码
+// 编码端不使用 Huffman, 响应头中重复的字段进入动态表后只占一个字节
+
+typedef std::vector<std::pair<std::string, std::string>> HeaderList;
+
+class HpackTable {
+public:
+    explicit HpackTable(size_t maxSize);
+
+    // 静态表之后的下标, 越界返回 nullptr
+    const std::pair<std::string, std::string> *Get(size_t index) const;
+
+    void Insert(std::string_view name, std::string_view value);
+
+    void Resize(size_t maxSize);
+
+    size_t MaxSize() const { return h_maxSize; }
+
+    // 完全匹配时返回下标, 只有名称匹配时 nameIndex 为名称所在的下标, 都不匹配返回 0
+    size_t Find(std::string_view name, std::string_view value, size_t *nameIndex) const;
+
+    static const size_t STATIC_SIZE = 61;
+
+private:
+    void Evict();
+
+    std::deque<std::pair<std::string, std::string>> h_entries;
+    size_t h_size;
+    size_t h_maxSize;
+};
+
+class HpackDecoder {
+public:
+    // maxSize 为本端 SETTINGS_HEADER_TABLE_SIZE, 对端的表大小更新不能超过它
+    explicit HpackDecoder(size_t maxSize = 4096);
+
+    // 解码一个完整的头部块, 失败时为连接错误 COMPRESSION_ERROR
+    // 名称和值的总长超过 maxListSize 时同样失败
+    bool Decode(const uint8_t *data, size_t len, HeaderList &headers, size_t maxListSize);
+
+private:
+    static bool DecodeInt(const uint8_t *&p, const uint8_t *end, int prefix, uint64_t *value);
+
+    static bool DecodeString(const uint8_t *&p, const uint8_t *end, std::string *out);
+
+    static bool DecodeHuffman(const uint8_t *p, size_t len, std::string *out);
+
+    HpackTable h_table;
+    size_t h_settingSize;
+};
+
+class HpackEncoder {
+public:
+    HpackEncoder();
+
+    // 对端的 SETTINGS_HEADER_TABLE_SIZE, 在下一个头部块开头通知
+    void SetMaxSize(size_t maxSize);
+
+    // 开始一个头部块, 需要时先写入表大小更新
+    void Begin(Buffer &out);
+
+    // 名称为小写; isIndexed 为 false 时不进入动态表, 用于 Date 这类每次都变的字段
+    void Encode(Buffer &out, std::string_view name, std::string_view value, bool isIndexed = true);
+
+private:
+    static void EncodeInt(Buffer &out, uint8_t flags, int prefix, uint64_t value);
+
+    static void EncodeString(Buffer &out, std::string_view str);
+
+    HpackTable h_table;
+    size_t h_pendingSize;
+    bool h_isSizeChanged;
+};
+
+#endif //HPACK_H
@@ -0,0 +1,612 @@
+#include "http2_session.h"
+
+#include <algorithm>
+#include <cctype>
+
+#include "http_request.h"
+
+const char Http2Session::PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+int Http2Session::maxStreams = 128;
+
+namespace {
+    enum FrameType {
+        FRAME_DATA = 0x0,
+        FRAME_HEADERS = 0x1,
+        FRAME_PRIORITY = 0x2,
+        FRAME_RST_STREAM = 0x3,
+        FRAME_SETTINGS = 0x4,
+        FRAME_PUSH_PROMISE = 0x5,
+        FRAME_PING = 0x6,
+        FRAME_GOAWAY = 0x7,
+        FRAME_WINDOW_UPDATE = 0x8,
+        FRAME_CONTINUATION = 0x9,
+    };
+
+    enum Setting {
+        SETTINGS_HEADER_TABLE_SIZE = 0x1,
+        SETTINGS_ENABLE_PUSH = 0x2,
+        SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+        SETTINGS_INITIAL_WINDOW_SIZE = 0x4,
+        SETTINGS_MAX_FRAME_SIZE = 0x5,
+        SETTINGS_MAX_HEADER_LIST_SIZE = 0x6,
+    };
+
+    const uint8_t FLAG_ACK = 0x1;
+    const uint8_t FLAG_END_STREAM = 0x1;
+    const uint8_t FLAG_END_HEADERS = 0x4;
+    const uint8_t FLAG_PADDED = 0x8;
+    const uint8_t FLAG_PRIORITY = 0x20;
+
+    const size_t FRAME_HEADER_LEN = 9;
+    const size_t DEFAULT_FRAME_SIZE = 16384;
+    const int64_t DEFAULT_WINDOW = 65535;
+    const int64_t MAX_WINDOW = 0x7fffffff;
+    // 本端的流初始窗口即请求体上限, 流内不需要 WINDOW_UPDATE
+    const int64_t LOCAL_STREAM_WINDOW = HttpRequest::MAX_BODY_SIZE;
+    // 连接窗口: 所有流已收到而未取出的请求体总量上限
+    const int64_t LOCAL_CONN_WINDOW = 4 * HttpRequest::MAX_BODY_SIZE;
+    // 解码后的请求头和未解码的头部块, 与 HTTP/1.1 的头部上限一致
+    const size_t MAX_HEADER_LIST = 16384;
+    const size_t MAX_HEADER_BLOCK = 65536;
+
+    uint32_t ReadUint32(const uint8_t *p) {
+        return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 |
+               static_cast<uint32_t>(p[2]) << 8 | p[3];
+    }
+
+    void AppendUint32(Buffer &out, uint32_t value) {
+        uint8_t bytes[4] = {static_cast<uint8_t>(value >> 24), static_cast<uint8_t>(value >> 16),
+                            static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value)};
+        out.Append(bytes, sizeof(bytes));
+    }
+
+    // 小写的头部名称转换为 HttpRequest 使用的形式: content-type -> Content-Type
+    void AppendCanonical(Buffer &out, const std::string &name) {
+        std::string canonical(name);
+        bool isWordStart = true;
+        for (char &c: canonical) {
+            if (isWordStart && c >= 'a' && c <= 'z') { c = static_cast<char>(c - 'a' + 'A'); }
+            isWordStart = c == '-';
+        }
+        out.Append(canonical);
+    }
+}
+
+Http2Session::Http2Session() {
+    s_isPrefaceSeen = false;
+    s_isSettingsSeen = false;
+    s_headerStreamId = 0;
+    s_headerFlags = 0;
+    s_lastStreamId = 0;
+    s_sendWindow = DEFAULT_WINDOW;
+    s_recvWindow = DEFAULT_WINDOW;
+    s_consumed = 0;
+    s_peerInitialWindow = DEFAULT_WINDOW;
+    s_peerMaxFrame = DEFAULT_FRAME_SIZE;
+    s_isClosing = false;
+    s_isGoingAway = false;
+    s_isPeerGoingAway = false;
+}
+
+void Http2Session::Start(Buffer &out) {
+    WriteFrameHeader(out, 18, FRAME_SETTINGS, 0, 0);
+    out.Append("\x00\x03", 2);
+    AppendUint32(out, static_cast<uint32_t>(std::max(maxStreams, 1)));
+    out.Append("\x00\x04", 2);
+    AppendUint32(out, static_cast<uint32_t>(LOCAL_STREAM_WINDOW));
+    out.Append("\x00\x06", 2);
+    AppendUint32(out, MAX_HEADER_LIST);
+    // 连接窗口不受 SETTINGS 影响, 直接放大
+    WriteWindowUpdate(out, 0, static_cast<uint32_t>(LOCAL_CONN_WINDOW - DEFAULT_WINDOW));
+    s_recvWindow = LOCAL_CONN_WINDOW;
+}
+
+bool Http2Session::IsDone() const {
+    return s_isClosing || ((s_isGoingAway || s_isPeerGoingAway) && s_streams.empty());
+}
+
+bool Http2Session::Feed(Buffer &in, Buffer &out) {
+    if (s_isClosing) {
+        in.RetrieveAll();
+        return false;
+    }
+    if (!s_isPrefaceSeen) {
+        if (in.ReadableBytes() < PREFACE_LEN) {
+            return memcmp(in.Peek(), PREFACE, in.ReadableBytes()) == 0 || ConnError(out, H2_PROTOCOL_ERROR);
+        }
+        if (memcmp(in.Peek(), PREFACE, PREFACE_LEN) != 0) {
+            return ConnError(out, H2_PROTOCOL_ERROR);
+        }
+        in.Retrieve(PREFACE_LEN);
+        s_isPrefaceSeen = true;
+    }
+    while (in.ReadableBytes() >= FRAME_HEADER_LEN) {
+        auto *p = reinterpret_cast<const uint8_t *>(in.Peek());
+        size_t len = static_cast<size_t>(p[0]) << 16 | static_cast<size_t>(p[1]) << 8 | p[2];
+        if (len > DEFAULT_FRAME_SIZE) {
+            // 本端没有调大 SETTINGS_MAX_FRAME_SIZE
+            return ConnError(out, H2_FRAME_SIZE_ERROR);
+        }
+        if (in.ReadableBytes() < FRAME_HEADER_LEN + len) {
+            break;
+        }
+        uint8_t type = p[3];
+        uint8_t flags = p[4];
+        uint32_t streamId = ReadUint32(p + 5) & 0x7fffffff;
+        bool ok = OnFrame(type, flags, streamId, p + FRAME_HEADER_LEN, len, out);
+        in.Retrieve(FRAME_HEADER_LEN + len);
+        if (!ok) {
+            in.RetrieveAll();
+            return false;
+        }
+    }
+    ReturnCredit(out);
+    return true;
+}
+
+bool Http2Session::OnFrame(uint8_t type, uint8_t flags, uint32_t streamId, const uint8_t *payload, size_t len,
+                           Buffer &out) {
+    if (!s_isSettingsSeen && type != FRAME_SETTINGS) {
+        // 前言之后的第一帧必须是 SETTINGS
+        return ConnError(out, H2_PROTOCOL_ERROR);
+    }
+    if (s_headerStreamId && (type != FRAME_CONTINUATION || streamId != s_headerStreamId)) {
+        // 头部块必须连续
+        return ConnError(out, H2_PROTOCOL_ERROR);
+    }
+    switch (type) {
+        case FRAME_DATA:
+            return OnData(flags, streamId, payload, len, out);
+        case FRAME_HEADERS:
+            return OnHeaders(flags, streamId, payload, len, out);
+        case FRAME_CONTINUATION:
+            if (!s_headerStreamId) { return ConnError(out, H2_PROTOCOL_ERROR); }
+            if (s_headerBlock.size() + len > MAX_HEADER_BLOCK) { return ConnError(out, H2_ENHANCE_YOUR_CALM); }
+            s_headerBlock.append(reinterpret_cast<const char *>(payload), len);
+            if (flags & FLAG_END_HEADERS) { return OnHeaderBlock(out); }
+            return true;
+        case FRAME_PRIORITY:
+            // 优先级已被 RFC 9113 废弃, 各个流轮流发送
+            if (streamId == 0) { return ConnError(out, H2_PROTOCOL_ERROR); }
+            if (len != 5) { ResetStream(out, streamId, H2_FRAME_SIZE_ERROR); }
+            return true;
+        case FRAME_RST_STREAM:
+            if (streamId == 0 || streamId > s_lastStreamId) { return ConnError(out, H2_PROTOCOL_ERROR); }
+            if (len != 4) { return ConnError(out, H2_FRAME_SIZE_ERROR); }
+            if (auto it = s_streams.find(streamId); it != s_streams.end()) { EraseStream(it); }
+            return true;
+        case FRAME_SETTINGS:
+            if (streamId != 0) { return ConnError(out, H2_PROTOCOL_ERROR); }
+            return OnSettings(flags, payload, len, out);
+        case FRAME_PUSH_PROMISE:
+            return ConnError(out, H2_PROTOCOL_ERROR);
+        case FRAME_PING:
+            if (streamId != 0) { return ConnError(out, H2_PROTOCOL_ERROR); }
+            if (len != 8) { return ConnError(out, H2_FRAME_SIZE_ERROR); }
+            if (!(flags & FLAG_ACK)) {
+                WriteFrameHeader(out, 8, FRAME_PING, FLAG_ACK, 0);
+                out.Append(payload, len);
+            }
+            return true;
+        case FRAME_GOAWAY:
+            if (streamId != 0) { return ConnError(out, H2_PROTOCOL_ERROR); }
+            s_isPeerGoingAway = true;
+            return true;
+        case FRAME_WINDOW_UPDATE:
+            return OnWindowUpdate(streamId, payload, len, out);
+        default:
+            // 未知类型的帧直接忽略
+            return true;
+    }
+}
+
+bool Http2Session::OnHeaders(uint8_t flags, uint32_t streamId, const uint8_t *payload, size_t len, Buffer &out) {
+    if (streamId == 0 || !(streamId & 1)) {
+        return ConnError(out, H2_PROTOCOL_ERROR);
+    }
+    if (!StripPadding(flags, payload, len)) {
+        return ConnError(out, H2_PROTOCOL_ERROR);
+    }
+    if (flags & FLAG_PRIORITY) {
+        if (len < 5) { return ConnError(out, H2_FRAME_SIZE_ERROR); }
+        payload += 5;
+        len -= 5;
+    }
+    if (streamId <= s_lastStreamId) {
+        auto it = s_streams.find(streamId);
+        if (it == s_streams.end() || it->second.isRemoteClosed) {
+            return ConnError(out, H2_STREAM_CLOSED);
+        }
+        // 请求体之后的 trailer 必须结束流
+        if (!(flags & FLAG_END_STREAM)) { return ConnError(out, H2_PROTOCOL_ERROR); }
+    }
+    s_headerStreamId = streamId;
+    s_headerFlags = flags;
+    s_headerBlock.assign(reinterpret_cast<const char *>(payload), len);
+    if (flags & FLAG_END_HEADERS) {
+        return OnHeaderBlock(out);
+    }
+    return true;
+}
+
+bool Http2Session::OnHeaderBlock(Buffer &out) {
+    uint32_t streamId = s_headerStreamId;
+    bool isEndStream = s_headerFlags & FLAG_END_STREAM;
+    s_headerStreamId = 0;
+    HeaderList headers;
+    // 即使要拒绝这个流也必须解码, 保持双方动态表一致
+    if (!s_decoder.Decode(reinterpret_cast<const uint8_t *>(s_headerBlock.data()), s_headerBlock.size(), headers,
+                          MAX_HEADER_LIST)) {
+        return ConnError(out, H2_COMPRESSION_ERROR);
+    }
+    s_headerBlock.clear();
+
+    auto it = s_streams.find(streamId);
+    if (it != s_streams.end()) {
+        // trailer, 不需要处理
+        it->second.isRemoteClosed = true;
+        s_ready.push_back(streamId);
+        return true;
+    }
+    s_lastStreamId = streamId;
+    if (s_isGoingAway) {
+        return true;
+    }
+    if (s_streams.size() >= static_cast<size_t>(std::max(maxStreams, 1))) {
+        ResetStream(out, streamId, H2_REFUSED_STREAM);
+        return true;
+    }
+    if (!IsValidRequest(headers)) {
+        ResetStream(out, streamId, H2_PROTOCOL_ERROR);
+        return true;
+    }
+    Stream &stream = s_streams[streamId];
+    stream.sendWindow = s_peerInitialWindow;
+    stream.recvWindow = LOCAL_STREAM_WINDOW;
+    stream.headers = std::move(headers);
+    if (isEndStream) {
+        stream.isRemoteClosed = true;
+        s_ready.push_back(streamId);
+    }
+    return true;
+}
+
+bool Http2Session::OnData(uint8_t flags, uint32_t streamId, const uint8_t *payload, size_t len, Buffer &out) {
+    if (streamId == 0 || streamId > s_lastStreamId) {
+        return ConnError(out, H2_PROTOCOL_ERROR);
+    }
+    // 整个帧 (含填充) 计入流量控制; 填充和丢弃的数据立即归还连接窗口, 请求体等取出后再归还
+    s_recvWindow -= static_cast<int64_t>(len);
+    if (s_recvWindow < 0) {
+        return ConnError(out, H2_FLOW_CONTROL_ERROR);
+    }
+    size_t frameLen = len;
+    if (!StripPadding(flags, payload, len)) {
+        return ConnError(out, H2_PROTOCOL_ERROR);
+    }
+    s_consumed += frameLen - len;
+    auto it = s_streams.find(streamId);
+    if (it == s_streams.end() || it->second.isRemoteClosed) {
+        s_consumed += len;
+        ResetStream(out, streamId, H2_STREAM_CLOSED);
+        return true;
+    }
+    Stream &stream = it->second;
+    stream.recvWindow -= static_cast<int64_t>(frameLen);
+    if (stream.recvWindow < 0 || stream.body.size() + len > HttpRequest::MAX_BODY_SIZE) {
+        s_consumed += len;
+        ResetStream(out, streamId, stream.recvWindow < 0 ? H2_FLOW_CONTROL_ERROR : H2_CANCEL);
+        EraseStream(it);
+        return true;
+    }
+    stream.body.append(reinterpret_cast<const char *>(payload), len);
+    if (flags & FLAG_END_STREAM) {
+        stream.isRemoteClosed = true;
+        s_ready.push_back(streamId);
+    }
+    return true;
+}
+
+bool Http2Session::OnSettings(uint8_t flags, const uint8_t *payload, size_t len, Buffer &out) {
+    if (flags & FLAG_ACK) {
+        return len == 0 || ConnError(out, H2_FRAME_SIZE_ERROR);
+    }
+    if (len % 6 != 0) {
+        return ConnError(out, H2_FRAME_SIZE_ERROR);
+    }
+    for (size_t i = 0; i < len; i += 6) {
+        uint16_t id = static_cast<uint16_t>(payload[i] << 8 | payload[i + 1]);
+        uint32_t value = ReadUint32(payload + i + 2);
+        switch (id) {
+            case SETTINGS_HEADER_TABLE_SIZE:
+                s_encoder.SetMaxSize(value);
+                break;
+            case SETTINGS_ENABLE_PUSH:
+                if (value > 1) { return ConnError(out, H2_PROTOCOL_ERROR); }
+                break;
+            case SETTINGS_INITIAL_WINDOW_SIZE: {
+                if (value > MAX_WINDOW) { return ConnError(out, H2_FLOW_CONTROL_ERROR); }
+                // 已有流的窗口按差值调整, 可以变为负数
+                int64_t delta = static_cast<int64_t>(value) - s_peerInitialWindow;
+                for (auto &stream: s_streams) {
+                    stream.second.sendWindow += delta;
+                    if (stream.second.sendWindow > MAX_WINDOW) { return ConnError(out, H2_FLOW_CONTROL_ERROR); }
+                }
+                s_peerInitialWindow = value;
+                break;
+            }
+            case SETTINGS_MAX_FRAME_SIZE:
+                if (value < DEFAULT_FRAME_SIZE || value > 0xffffff) { return ConnError(out, H2_PROTOCOL_ERROR); }
+                s_peerMaxFrame = value;
+                break;
+            default:
+                break;
+        }
+    }
+    s_isSettingsSeen = true;
+    WriteFrameHeader(out, 0, FRAME_SETTINGS, FLAG_ACK, 0);
+    return true;
+}
+
+bool Http2Session::OnWindowUpdate(uint32_t streamId, const uint8_t *payload, size_t len, Buffer &out) {
+    if (len != 4) {
+        return ConnError(out, H2_FRAME_SIZE_ERROR);
+    }
+    uint32_t increment = ReadUint32(payload) & 0x7fffffff;
+    if (streamId == 0) {
+        if (increment == 0) { return ConnError(out, H2_PROTOCOL_ERROR); }
+        s_sendWindow += increment;
+        return s_sendWindow <= MAX_WINDOW || ConnError(out, H2_FLOW_CONTROL_ERROR);
+    }
+    if (streamId > s_lastStreamId) {
+        return ConnError(out, H2_PROTOCOL_ERROR);
+    }
+    auto it = s_streams.find(streamId);
+    if (it == s_streams.end()) {
+        // 已经结束的流
+        return true;
+    }
+    if (increment == 0) {
+        ResetStream(out, streamId, H2_PROTOCOL_ERROR);
+        EraseStream(it);
+        return true;
+    }
+    it->second.sendWindow += increment;
+    if (it->second.sendWindow > MAX_WINDOW) {
+        ResetStream(out, streamId, H2_FLOW_CONTROL_ERROR);
+        EraseStream(it);
+    }
+    return true;
+}
+
+bool Http2Session::StripPadding(uint8_t flags, const uint8_t *&payload, size_t &len) {
+    if (!(flags & FLAG_PADDED)) {
+        return true;
+    }
+    if (len < 1 || payload[0] >= len) {
+        return false;
+    }
+    size_t padLen = payload[0];
+    payload += 1;
+    len -= 1 + padLen;
+    return true;
+}
+
+bool Http2Session::IsValidRequest(const HeaderList &headers) {
+    bool hasMethod = false, hasPath = false, hasScheme = false;
+    bool isRegularSeen = false;
+    for (const auto &header: headers) {
+        const std::string &name = header.first;
+        if (name.empty()) { return false; }
+        if (name[0] == ':') {
+            // 伪头部必须在普通字段之前
+            if (isRegularSeen) { return false; }
+            if (name == ":method") { hasMethod = true; }
+            else if (name == ":path") { hasPath = !header.second.empty(); }
+            else if (name == ":scheme") { hasScheme = true; }
+            else if (name != ":authority") { return false; }
+            continue;
+        }
+        isRegularSeen = true;
+        if (std::any_of(name.begin(), name.end(), [](char c) { return c >= 'A' && c <= 'Z'; })) { return false; }
+        if (name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+            name == "transfer-encoding" || name == "upgrade") {
+            return false;
+        }
+        if (name == "te" && header.second != "trailers") { return false; }
+    }
+    return hasMethod && hasPath && hasScheme;
+}
+
+bool Http2Session::PopRequest(uint32_t *streamId, Buffer &request) {
+    while (!s_ready.empty()) {
+        uint32_t id = s_ready.front();
+        s_ready.pop_front();
+        auto it = s_streams.find(id);
+        if (it == s_streams.end() || it->second.isResponding) {
+            // 期间被对端重置
+            continue;
+        }
+        Stream &stream = it->second;
+        std::string method, path, authority, cookie;
+        for (const auto &header: stream.headers) {
+            if (header.first == ":method") { method = header.second; }
+            else if (header.first == ":path") { path = header.second; }
+            else if (header.first == ":authority") { authority = header.second; }
+        }
+        request.Append(method + " " + path + " HTTP/1.1\r\n");
+        if (!authority.empty()) {
+            request.Append("Host: " + authority + "\r\n");
+        }
+        bool hasLength = false;
+        for (const auto &header: stream.headers) {
+            if (header.first[0] == ':') { continue; }
+            if (header.first == "cookie") {
+                // 拆开发送的 cookie 重新合并为一行
+                cookie += (cookie.empty() ? "" : "; ") + header.second;
+                continue;
+            }
+            hasLength = hasLength || header.first == "content-length";
+            AppendCanonical(request, header.first);
+            request.Append(": " + header.second + "\r\n");
+        }
+        if (!cookie.empty()) {
+            request.Append("Cookie: " + cookie + "\r\n");
+        }
+        if (!hasLength && !stream.body.empty()) {
+            request.Append("Content-Length: " + std::to_string(stream.body.size()) + "\r\n");
+        }
+        request.Append("\r\n", 2);
+        request.Append(stream.body);
+        stream.headers.clear();
+        s_consumed += stream.body.size();
+        // 释放空间, 流在响应发完前一直保留
+        std::string().swap(stream.body);
+        *streamId = id;
+        return true;
+    }
+    return false;
+}
+
+void Http2Session::Respond(Buffer &out, uint32_t streamId, std::string_view head,
+                           std::shared_ptr<const void> owner, const char *body, size_t len) {
+    auto it = s_streams.find(streamId);
+    if (it == s_streams.end() || s_isClosing) {
+        return;
+    }
+    Buffer block;
+    s_encoder.Begin(block);
+    // 状态行 "HTTP/1.1 200 OK", 200/404 等常见状态码在静态表中
+    size_t lineEnd = head.find("\r\n");
+    std::string_view status = head.substr(9, 3);
+    s_encoder.Encode(block, ":status", status);
+    for (size_t pos = lineEnd + 2; pos < head.size();) {
+        size_t end = head.find("\r\n", pos);
+        if (end == std::string_view::npos) { end = head.size(); }
+        std::string_view line = head.substr(pos, end - pos);
+        pos = end + 2;
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) { continue; }
+        std::string name(line.substr(0, colon));
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+        std::string_view value = line.substr(colon + 1);
+        while (!value.empty() && value.front() == ' ') { value.remove_prefix(1); }
+        if (name == "connection" || name == "keep-alive" || name == "transfer-encoding") {
+            continue;
+        }
+        // Date 和长度每次都不同, 不进入动态表
+        s_encoder.Encode(block, name, value, name != "date" && name != "content-length");
+    }
+
+    // 头部块超过对端的帧大小时拆分到 CONTINUATION
+    size_t blockLen = block.ReadableBytes();
+    size_t sent = 0;
+    uint8_t type = FRAME_HEADERS;
+    uint8_t flags = len == 0 ? FLAG_END_STREAM : 0;
+    do {
+        size_t frameLen = std::min(blockLen - sent, s_peerMaxFrame);
+        bool isLast = sent + frameLen == blockLen;
+        WriteFrameHeader(out, frameLen, type, flags | (isLast ? FLAG_END_HEADERS : 0), streamId);
+        out.Append(block.Peek() + sent, frameLen);
+        sent += frameLen;
+        type = FRAME_CONTINUATION;
+        flags = 0;
+    } while (sent < blockLen);
+
+    if (len == 0) {
+        EraseStream(it);
+        return;
+    }
+    Stream &stream = it->second;
+    stream.isResponding = true;
+    stream.owner = std::move(owner);
+    stream.data = body;
+    stream.left = len;
+}
+
+void Http2Session::Pump(Buffer &out, size_t limit) {
+    ReturnCredit(out);
+    bool isProgress = true;
+    while (isProgress && s_sendWindow > 0 && out.ReadableBytes() < limit && !s_isClosing) {
+        isProgress = false;
+        for (auto it = s_streams.begin(); it != s_streams.end() && s_sendWindow > 0 &&
+                                          out.ReadableBytes() < limit;) {
+            Stream &stream = it->second;
+            if (!stream.isResponding || stream.sendWindow <= 0) {
+                ++it;
+                continue;
+            }
+            size_t frameLen = std::min({stream.left, static_cast<size_t>(stream.sendWindow),
+                                        static_cast<size_t>(s_sendWindow), s_peerMaxFrame,
+                                        limit - out.ReadableBytes()});
+            bool isLast = frameLen == stream.left;
+            WriteFrameHeader(out, frameLen, FRAME_DATA, isLast ? FLAG_END_STREAM : 0, it->first);
+            out.Append(stream.data, frameLen);
+            stream.data += frameLen;
+            stream.left -= frameLen;
+            stream.sendWindow -= static_cast<int64_t>(frameLen);
+            s_sendWindow -= static_cast<int64_t>(frameLen);
+            isProgress = true;
+            if (isLast) {
+                it = EraseStream(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+void Http2Session::GoAway(Buffer &out) {
+    if (s_isGoingAway || s_isClosing) {
+        return;
+    }
+    s_isGoingAway = true;
+    WriteFrameHeader(out, 8, FRAME_GOAWAY, 0, 0);
+    AppendUint32(out, s_lastStreamId);
+    AppendUint32(out, H2_NO_ERROR);
+}
+
+bool Http2Session::ConnError(Buffer &out, ErrorCode code) {
+    LOG_DEBUG("HTTP/2 connection error: %d", (int) code)
+    s_isClosing = true;
+    s_streams.clear();
+    s_ready.clear();
+    WriteFrameHeader(out, 8, FRAME_GOAWAY, 0, 0);
+    AppendUint32(out, s_lastStreamId);
+    AppendUint32(out, code);
+    return false;
+}
+
+void Http2Session::ResetStream(Buffer &out, uint32_t streamId, ErrorCode code) {
+    WriteFrameHeader(out, 4, FRAME_RST_STREAM, 0, streamId);
+    AppendUint32(out, code);
+}
+
+std::map<uint32_t, Http2Session::Stream>::iterator Http2Session::EraseStream(std::map<uint32_t, Stream>::iterator it) {
+    s_consumed += it->second.body.size();
+    return s_streams.erase(it);
+}
+
+void Http2Session::ReturnCredit(Buffer &out) {
+    if (s_consumed == 0 || s_isClosing) {
+        return;
+    }
+    WriteWindowUpdate(out, 0, static_cast<uint32_t>(s_consumed));
+    s_recvWindow += static_cast<int64_t>(s_consumed);
+    s_consumed = 0;
+}
+
+void Http2Session::WriteFrameHeader(Buffer &out, size_t len, uint8_t type, uint8_t flags, uint32_t streamId) {
+    uint8_t header[FRAME_HEADER_LEN] = {static_cast<uint8_t>(len >> 16), static_cast<uint8_t>(len >> 8),
+                                        static_cast<uint8_t>(len), type, flags};
+    header[5] = static_cast<uint8_t>(streamId >> 24 & 0x7f);
+    header[6] = static_cast<uint8_t>(streamId >> 16);
+    header[7] = static_cast<uint8_t>(streamId >> 8);
+    header[8] = static_cast<uint8_t>(streamId);
+    out.Append(header, sizeof(header));
+}
+
+void Http2Session::WriteWindowUpdate(Buffer &out, uint32_t streamId, uint32_t increment) {
+    WriteFrameHeader(out, 4, FRAME_WINDOW_UPDATE, 0, streamId);
+    AppendUint32(out, increment);
+}
@@ -0,0 +1,138 @@
+#ifndef HTTP2_SESSION_H
+#define HTTP2_SESSION_H
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "../buffer/buffer.h"
+#include "../log/log.h"
+#include "hpack.h"
+
+// HTTP/2 连接 (RFC 9113): 帧解析, 流状态和双向流量控制, 不涉及请求语义
+// 接收方向: 流窗口与请求体上限相同, 连接窗口为所有流缓冲的请求体总量上限, 请求体被 PopRequest 取出后才归还
+// 收齐的请求转换为 HTTP/1.1 文本交给 HttpRequest 解析, 响应仍由 HttpResponse 构造,
+// 状态行和头部转换为 HEADERS 帧, 响应体直接引用文件映射或缓存, 按窗口分成 DATA 帧
+class Http2Session {
+public:
+    enum ErrorCode {
+        H2_NO_ERROR = 0x0,
+        H2_PROTOCOL_ERROR = 0x1,
+        H2_FLOW_CONTROL_ERROR = 0x3,
+        H2_STREAM_CLOSED = 0x5,
+        H2_FRAME_SIZE_ERROR = 0x6,
+        H2_REFUSED_STREAM = 0x7,
+        H2_CANCEL = 0x8,
+        H2_COMPRESSION_ERROR = 0x9,
+        H2_ENHANCE_YOUR_CALM = 0xb,
+    };
+
+    Http2Session();
+
+    // 连接开始时发送本端的 SETTINGS
+    void Start(Buffer &out);
+
+    // 消费 in 中完整的帧, 不完整的帧留在 in 中; 控制帧的应答写入 out
+    // 连接错误时写入 GOAWAY 并返回 false, 之后不再处理任何帧
+    bool Feed(Buffer &in, Buffer &out);
+
+    // 取出一个收齐的请求, 转换为 HTTP/1.1 请求写入 request
+    bool PopRequest(uint32_t *streamId, Buffer &request);
+
+    // head 为 HTTP/1.1 的状态行和头部, 转换后写入 HEADERS 帧
+    // 响应体由 owner 持有, 之后由 Pump 发送
+    void Respond(Buffer &out, uint32_t streamId, std::string_view head,
+                 std::shared_ptr<const void> owner, const char *body, size_t len);
+
+    // 归还已取出的请求体占用的连接窗口, 再在流量控制窗口内轮流为每个流写入一个 DATA 帧, out 达到 limit 为止
+    void Pump(Buffer &out, size_t limit);
+
+    // 不再接受新的流, 已开始的流继续完成
+    void GoAway(Buffer &out);
+
+    // 没有未完成的流
+    bool IsIdle() const { return s_streams.empty(); }
+
+    // 出错, 或任一方已发送 GOAWAY 且流都已完成, 可以关闭连接
+    bool IsDone() const;
+
+    // 连接前言 "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+    static const char PREFACE[];
+    static constexpr size_t PREFACE_LEN = 24;
+
+    // SETTINGS_MAX_CONCURRENT_STREAMS
+    static int maxStreams;
+
+private:
+    struct Stream {
+        int64_t sendWindow = 0;
+        int64_t recvWindow = 0;
+        HeaderList headers;
+        std::string body;
+        // 请求已收齐, 等待处理
+        bool isRemoteClosed = false;
+        // 已发送 HEADERS, 响应体未发完
+        bool isResponding = false;
+        std::shared_ptr<const void> owner;
+        const char *data = nullptr;
+        size_t left = 0;
+    };
+
+    bool OnFrame(uint8_t type, uint8_t flags, uint32_t streamId, const uint8_t *payload, size_t len, Buffer &out);
+
+    bool OnHeaders(uint8_t flags, uint32_t streamId, const uint8_t *payload, size_t len, Buffer &out);
+
+    bool OnHeaderBlock(Buffer &out);
+
+    bool OnData(uint8_t flags, uint32_t streamId, const uint8_t *payload, size_t len, Buffer &out);
+
+    bool OnSettings(uint8_t flags, const uint8_t *payload, size_t len, Buffer &out);
+
+    bool OnWindowUpdate(uint32_t streamId, const uint8_t *payload, size_t len, Buffer &out);
+
+    // 去掉 PADDED 标志带的填充, 填充长度不合法时返回 false
+    static bool StripPadding(uint8_t flags, const uint8_t *&payload, size_t &len);
+
+    // 请求头需要的伪头部齐全, 名称都是小写且不含连接相关字段
+    static bool IsValidRequest(const HeaderList &headers);
+
+    bool ConnError(Buffer &out, ErrorCode code);
+
+    void ResetStream(Buffer &out, uint32_t streamId, ErrorCode code);
+
+    // 删除流, 未取出的请求体计入待归还的连接窗口
+    std::map<uint32_t, Stream>::iterator EraseStream(std::map<uint32_t, Stream>::iterator it);
+
+    // 把待归还的连接窗口写成 WINDOW_UPDATE
+    void ReturnCredit(Buffer &out);
+
+    static void WriteFrameHeader(Buffer &out, size_t len, uint8_t type, uint8_t flags, uint32_t streamId);
+
+    static void WriteWindowUpdate(Buffer &out, uint32_t streamId, uint32_t increment);
+
+    std::map<uint32_t, Stream> s_streams;
+    std::deque<uint32_t> s_ready;
+    HpackDecoder s_decoder;
+    HpackEncoder s_encoder;
+    bool s_isPrefaceSeen;
+    bool s_isSettingsSeen;
+    // 收到 CONTINUATION 之前的 HEADERS 所在的流及其标志
+    uint32_t s_headerStreamId;
+    uint8_t s_headerFlags;
+    std::string s_headerBlock;
+    uint32_t s_lastStreamId;
+    int64_t s_sendWindow;
+    // 对端还能发送的 DATA 字节数, 和已经处理完等待归还的字节数
+    int64_t s_recvWindow;
+    size_t s_consumed;
+    int64_t s_peerInitialWindow;
+    size_t s_peerMaxFrame;
+    bool s_isClosing;
+    bool s_isGoingAway;
+    bool s_isPeerGoingAway;
+};
+
+#endif //HTTP2_SESSION_H
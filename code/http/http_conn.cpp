@@ -2,11 +2,46 @@
 
 const char *HttpConn::srcDir;
 std::atomic<int> HttpConn::userCount;
+std::atomic<bool> HttpConn::isDraining;
 bool HttpConn::isET;
+bool HttpConn::isCheckResident;
+int HttpConn::writeQuantum;
+bool HttpConn::isHttp2;
+std::function<const std::string *(HttpConn *, uint32_t, std::string &&)> HttpConn::dispatchDbStream;
+std::function<const std::string *(ip_key_t, bool)> HttpConn::admitStream;
+std::string HttpConn::metricsPath;
+std::string HttpConn::wsPath;
+bool HttpConn::wsRelay;
+
+namespace {
+    // 每次检查的发送窗口, 预读则多读若干窗口
+    const size_t RESIDENT_WINDOW = 1 << 20;
+    const size_t PREFETCH_LEN = 4 << 20;
+}
 
 HttpConn::HttpConn() {
     h_fd = -1;
-    s_addr = {0};
+    h_seq = 0;
+    h_node = -1;
+    h_buffNode = -1;
+    h_iovCnt = 0;
+    h_sentBytes = 0;
+    h_acceptNs = 0;
+    h_phase = PHASE_IDLE;
+    h_phaseNs = 0;
+    h_phaseBytes = 0;
+    h_activeNs = 0;
+    s_addr = {};
+    h_ip[0] = '\0';
+    h_ipKey = 0;
+    h_isLimited = false;
+    h_ssl = nullptr;
+    h_isHandshaking = false;
+    h_isKtlsSend = false;
+    h_isLinger = false;
+    h_isWebSocket = false;
+    h_isDispatched = false;
+    h_dbPending = 0;
     isClose = true;
 }
 
@@ -14,13 +49,34 @@ HttpConn::~HttpConn() {
     Close();
 }
 
-void HttpConn::Init(int sockFd, const sockaddr_in &addr) {
+void HttpConn::Init(int sockFd, const sockaddr_storage &addr) {
     assert(sockFd > 0);
     ++userCount;
     s_addr = addr;
+    h_ipKey = IpKey(addr);
+    h_isLimited = false;
+    if (addr.ss_family == AF_INET) {
+        inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in &>(addr).sin_addr, h_ip, sizeof(h_ip));
+    } else if (addr.ss_family == AF_INET6) {
+        inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6 &>(addr).sin6_addr, h_ip, sizeof(h_ip));
+    } else {
+        snprintf(h_ip, sizeof(h_ip), "unix");
+    }
     h_fd = sockFd;
+    ++h_seq;
+    h_node = -1;
     h_writeBuff.RetrieveAll();
     h_readBuff.RetrieveAll();
+    h_h2.reset();
+    h_dbPending = 0;
+    h_dbReplies.clear();
+    h_ws.reset();
+    h_isLinger = false;
+    h_trace.sampled = false;
+    h_acceptNs = Tracer::IsOpen() ? Metrics::NowNs() : 0;
+    h_phase = PHASE_IDLE;
+    h_activeNs = Metrics::NowNs();
+    h_isDispatched = false;
     isClose = false;
     LOG_INFO("Client[%d](%s:%d) in, userCount:%d", h_fd, GetIP(), GetPort(), (int) userCount)
 }
@@ -28,48 +84,143 @@ void HttpConn::Init(int sockFd, const sockaddr_in &addr) {
 void HttpConn::Close() {
     h_response.UnmapFile();
     if (!isClose) {
+        TWS_PROBE2(conn_close, h_fd, h_sentBytes);
         isClose = true;
+        TlsContext::Free(h_ssl);
+        h_ssl = nullptr;
+        h_h2.reset();
+        if (h_isWebSocket) {
+            // 先退出广播, 对象留到 Init 时释放, 事件循环线程此后仍可能访问
+            h_isWebSocket.store(false, std::memory_order_release);
+            WebSocketHub::Instance()->Remove(h_ws.get());
+            h_ws->Shutdown();
+        }
         userCount--;
         close(h_fd);
         LOG_INFO("Client[%d](%s:%d) quit, UserCount:%d", h_fd, GetIP(), GetPort(), (int) userCount)
     }
 }
 
+void HttpConn::LocalizeBuffers(int node) {
+    // 有数据时不搬动, 下次空闲的读再处理
+    if (node < 0 || node == h_buffNode || h_readBuff.ReadableBytes() > 0 || h_writeBuff.ReadableBytes() > 0) {
+        return;
+    }
+    h_readBuff.Reallocate();
+    h_writeBuff.Reallocate();
+    h_buffNode = node;
+}
+
 int HttpConn::GetFd() const {
     return h_fd;
 }
 
-struct sockaddr_in HttpConn::GetAddr() const {
-    return s_addr;
+ip_key_t HttpConn::IpKey(const sockaddr_storage &addr) {
+    if (addr.ss_family == AF_INET) {
+        // 与 IPv4 映射地址 ::ffff:a.b.c.d 的低 64 位相同
+        return 0xffffull << 32 | ntohl(reinterpret_cast<const sockaddr_in &>(addr).sin_addr.s_addr);
+    } else if (addr.ss_family == AF_INET6) {
+        const auto &in6 = reinterpret_cast<const sockaddr_in6 &>(addr);
+        uint64_t half[2];
+        memcpy(half, &in6.sin6_addr, sizeof(half));
+        // IPv4 映射地址按 IPv4 计, 其余同一 /64 前缀视为同一来源
+        return be64toh(IN6_IS_ADDR_V4MAPPED(&in6.sin6_addr) ? half[1] : half[0]);
+    }
+    return 0;
+}
+
+void HttpConn::InitTls(ssl_st *ssl) {
+    SetNoDelay();
+    h_ssl = ssl;
+    h_isHandshaking = true;
+    h_isKtlsSend = false;
+    SetPhase(PHASE_HEADER);
+}
+
+TlsContext::Result HttpConn::Handshake() {
+    TlsContext::Result ret = TlsContext::Handshake(h_ssl);
+    if (ret == TlsContext::TLS_DONE) {
+        h_isHandshaking = false;
+        h_isKtlsSend = TlsContext::IsKtlsSend(h_ssl);
+        Metrics::Add(TlsContext::IsResumed(h_ssl) ? TLS_RESUMED : TLS_FULL);
+        if (h_isKtlsSend) { Metrics::Add(TLS_KTLS); }
+        if (isHttp2 && TlsContext::IsAlpnH2(h_ssl)) { StartHttp2(); }
+        SetPhase(PHASE_IDLE);
+    } else if (ret == TlsContext::TLS_ERROR) {
+        Metrics::Add(TLS_FAIL);
+    }
+    h_activeNs.store(Metrics::NowNs(), std::memory_order_relaxed);
+    return ret;
 }
 
 const char *HttpConn::GetIP() const {
-    return inet_ntoa(s_addr.sin_addr);
+    return h_ip;
 }
 
 int HttpConn::GetPort() const {
-    return s_addr.sin_port;
+    if (s_addr.ss_family == AF_INET) {
+        return ntohs(reinterpret_cast<const sockaddr_in &>(s_addr).sin_port);
+    } else if (s_addr.ss_family == AF_INET6) {
+        return ntohs(reinterpret_cast<const sockaddr_in6 &>(s_addr).sin6_port);
+    }
+    return 0;
 }
 
 ssize_t HttpConn::Read(int *saveErrno) {
     ssize_t len = -1;
+    size_t readable = h_readBuff.ReadableBytes();
+    // HTTP/1.1 的请求收到上限为止, 余下的留在套接字中, 重新注册事件后还会就绪
+    size_t limit = h_h2 || h_ws ? SIZE_MAX : HttpRequest::MAX_REQUEST_SIZE;
     do {
-        len = h_readBuff.ReadFd(h_fd, saveErrno);
-        if (len <= 0) {
+        if (h_ssl) {
+            h_readBuff.EnsureWriteable(TLS_READ_SIZE);
+            len = TlsContext::Read(h_ssl, h_readBuff.BeginWrite(), h_readBuff.WritableBytes(), saveErrno);
+            if (len > 0) { h_readBuff.HasWritten(len); }
+        } else {
+            len = h_readBuff.ReadFd(h_fd, saveErrno);
+        }
+        if (len <= 0 || h_readBuff.ReadableBytes() >= limit) {
             break;
         }
-    } while (isET);
+        // 水平触发时 OpenSSL 内部可能还缓存着已读出的记录, 不会再有可读事件
+    } while (isET || h_ssl);
+    if (h_readBuff.ReadableBytes() > readable) {
+        h_activeNs.store(Metrics::NowNs(), std::memory_order_relaxed);
+    }
+    if (h_trace.sampled && !h_trace.ts[PH_FIRST_BYTE] && h_readBuff.ReadableBytes() > 0) {
+        h_trace.Mark(PH_FIRST_BYTE);
+    }
     return len;
 }
 
-ssize_t HttpConn::Write(int *saveErrno) {
+ssize_t HttpConn::Write(int *saveErrno, size_t maxBytes) {
     ssize_t len = -1;
+    size_t quantum = 0;
+    if (writeQuantum > 0 && (maxBytes == 0 || maxBytes > static_cast<size_t>(writeQuantum))) {
+        maxBytes = writeQuantum;
+    }
     do {
-        len = writev(h_fd, h_iov, h_iovCnt);
+        if (isCheckResident && !IsFileResident()) {
+            // 等待 IO 线程把文件页读入内存
+            *saveErrno = EINPROGRESS;
+            len = -1;
+            break;
+        }
+        if (maxBytes > 0 && static_cast<size_t>(ToWriteBytes()) > maxBytes - quantum) {
+            // 只发送配额内的部分
+            struct iovec iov[2] = {h_iov[0], h_iov[1]};
+            size_t left = maxBytes - quantum;
+            iov[0].iov_len = std::min(iov[0].iov_len, left);
+            iov[1].iov_len = std::min(iov[1].iov_len, left - iov[0].iov_len);
+            len = WriteV(iov, h_iovCnt, saveErrno);
+        } else {
+            len = WriteV(h_iov, h_iovCnt, saveErrno);
+        }
         if (len <= 0) {
-            *saveErrno = errno;
             break;
         }
+        h_sentBytes += len;
+        quantum += len;
         if (h_iov[0].iov_len + h_iov[1].iov_len == 0) { break; } /* 传输结束 */
         else if (static_cast<size_t>(len) > h_iov[0].iov_len) {
             h_iov[1].iov_base = (uint8_t *) h_iov[1].iov_base + (len - h_iov[0].iov_len);
@@ -83,25 +234,114 @@ ssize_t HttpConn::Write(int *saveErrno) {
             h_iov[0].iov_len -= len;
             h_writeBuff.Retrieve(len);
         }
-    } while (isET || ToWriteBytes() > 10240);
+    } while ((isET || ToWriteBytes() > 10240) && (maxBytes == 0 || quantum < maxBytes));
+    if (quantum > 0) {
+        Metrics::Add(BYTES_SENT, quantum);
+        h_phaseBytes.store(h_sentBytes, std::memory_order_relaxed);
+        h_activeNs.store(Metrics::NowNs(), std::memory_order_relaxed);
+    }
+    return len;
+}
+
+ssize_t HttpConn::WriteV(const struct iovec *iov, int iovCnt, int *saveErrno) {
+    if (h_ssl && !h_isKtlsSend) {
+        // 用户态加密, 需要拷贝一次
+        return TlsContext::Writev(h_ssl, iov, iovCnt, saveErrno);
+    }
+    ssize_t len = writev(h_fd, iov, iovCnt);
+    if (len <= 0) {
+        *saveErrno = errno;
+    }
     return len;
 }
 
 bool HttpConn::process() {
+    if (h_h2) {
+        return ProcessHttp2();
+    }
+    if (h_ws) {
+        return ProcessWebSocket();
+    }
     h_request.Init();
     if (h_readBuff.ReadableBytes() <= 0) {
+        h_phase.store(PHASE_IDLE, std::memory_order_relaxed);
         return false;
-    } else if (h_request.Parse(h_readBuff)) {
+    }
+    if (isHttp2 && !h_ssl) {
+        // h2c: 客户端已知服务端支持 HTTP/2, 直接发送连接前言
+        size_t len = std::min(h_readBuff.ReadableBytes(), Http2Session::PREFACE_LEN);
+        if (memcmp(h_readBuff.Peek(), Http2Session::PREFACE, len) == 0) {
+            if (len < Http2Session::PREFACE_LEN) {
+                if (GetPhase() != PHASE_HEADER) { SetPhase(PHASE_HEADER); }
+                return false;
+            }
+            StartHttp2();
+            return ProcessHttp2();
+        }
+    }
+    // 请求收齐之前不解析, 未完成的阶段由超时检查限制时长和速率
+    size_t bodyBytes = 0;
+    switch (HttpRequest::Progress(h_readBuff.Peek(), h_readBuff.BeginWriteConst(), &bodyBytes)) {
+        case HttpRequest::PENDING_HEADER:
+            if (GetPhase() != PHASE_HEADER) { SetPhase(PHASE_HEADER); }
+            return false;
+        case HttpRequest::PENDING_BODY:
+            if (GetPhase() != PHASE_BODY) { SetPhase(PHASE_BODY); }
+            h_phaseBytes.store(bodyBytes, std::memory_order_relaxed);
+            return false;
+        case HttpRequest::TOO_LARGE:
+            // 头部收齐即按 Content-length 拒绝, 丢弃已收到的部分, 回应 413 后关闭写端并读走剩余的请求体
+            LOG_WARN("Client[%d](%s) request body too large", h_fd, h_ip)
+            h_readBuff.RetrieveAll();
+            h_isLinger = true;
+            h_response.Init(srcDir, h_request.Path(), false, 413);
+            h_response.ErrorContent(h_writeBuff, "Payload Too Large");
+            Metrics::CountStatus(h_response.Code());
+            return StartResponse();
+        default:
+            SetPhase(PHASE_PROCESS);
+            break;
+    }
+    Tracer::SetCurrent(h_trace.sampled ? &h_trace : nullptr);
+    h_trace.Mark(PH_PARSE_BEGIN);
+    TWS_PROBE2(parse_start, h_fd, h_readBuff.ReadableBytes());
+    uint64_t parseStart = Metrics::NowNs();
+    bool parsed = h_request.Parse(h_readBuff);
+    uint64_t parseNs = Metrics::NowNs() - parseStart;
+    Metrics::Record(HIST_PARSE, parseNs);
+    TWS_PROBE4(parse_end, h_fd, h_request.Path().size(), parseNs, parsed);
+    h_trace.Mark(PH_PARSE_END);
+    Tracer::SetCurrent(nullptr);
+    if (parsed && !wsPath.empty() && h_request.Path() == wsPath) {
+        if (h_request.IsWebSocketUpgrade()) {
+            return StartWebSocket();
+        }
+        parsed = false;
+    }
+    if (parsed) {
         LOG_DEBUG("%s", h_request.Path().c_str())
-        h_response.Init(srcDir, h_request.Path(), h_request.IsKeepAlive(), 200);
+        h_response.Init(srcDir, h_request.Path(), IsKeepAlive(), 200, h_request.IsAcceptGzip());
     } else {
         h_response.Init(srcDir, h_request.Path(), false, 400);
     }
 
-    h_response.MakeResponse(h_writeBuff);
+    if (parsed && !metricsPath.empty() && h_request.Path() == metricsPath) {
+        h_response.MakeBodyResponse(h_writeBuff, "text/plain; version=0.0.4", Metrics::Instance()->Render());
+    } else {
+        h_response.MakeResponse(h_writeBuff);
+    }
+    Metrics::CountStatus(h_response.Code());
+    return StartResponse();
+}
+
+bool HttpConn::StartResponse() {
+    h_trace.Mark(PH_BUILT);
+    h_sentBytes = 0;
+    SetPhase(PHASE_WRITE);
     // 响应头
     h_iov[0].iov_base = const_cast<char *>(h_writeBuff.Peek());
     h_iov[0].iov_len = h_writeBuff.ReadableBytes();
+    h_iov[1].iov_len = 0;
     h_iovCnt = 1;
 
     // 文件
@@ -113,3 +353,304 @@ bool HttpConn::process() {
     LOG_DEBUG("filesize:%d, %d  to %d", h_response.FileLen(), h_iovCnt, ToWriteBytes())
     return true;
 }
+
+void HttpConn::StartHttp2() {
+    h_h2 = std::make_unique<Http2Session>();
+    h_h2->Start(h_writeBuff);
+    SetNoDelay();
+    Metrics::Add(HTTP2_CONN);
+    LOG_DEBUG("Client[%d] HTTP/2", h_fd)
+}
+
+void HttpConn::SetNoDelay() {
+    if (s_addr.ss_family != AF_UNIX) {
+        int optVal = 1;
+        setsockopt(h_fd, IPPROTO_TCP, TCP_NODELAY, &optVal, sizeof(optVal));
+    }
+}
+
+bool HttpConn::ProcessHttp2() {
+    if (GetPhase() == PHASE_WRITE) {
+        // 上一批写完后顺带读入新的帧, 大响应发送期间也能开始新的流
+        int readErrno = 0;
+        if (Read(&readErrno) == 0) {
+            // 对端已关闭, 交给读事件处理
+            return false;
+        }
+    }
+    if (isDraining) {
+        h_h2->GoAway(h_writeBuff);
+    }
+    // 数据库线程交回的响应, 连接出错后也要取走
+    std::vector<Http2Reply> replies;
+    {
+        std::lock_guard<std::mutex> locker(h_dispatchMutex);
+        replies.swap(h_dbReplies);
+    }
+    for (auto &reply: replies) {
+        h_h2->Respond(h_writeBuff, reply.streamId, reply.head, std::move(reply.owner), reply.body, reply.len);
+    }
+    if (h_h2->Feed(h_readBuff, h_writeBuff)) {
+        Buffer request;
+        uint32_t streamId;
+        while (h_h2->PopRequest(&streamId, request)) {
+            Metrics::Add(HTTP2_STREAM);
+            bool isDbRequest = HttpRequest::IsDbRequest(request.Peek(), request.BeginWriteConst());
+            const std::string *reject = h_isLimited && admitStream ? admitStream(h_ipKey, isDbRequest) : nullptr;
+            if (reject) {
+                // 只拒绝这个流, 连接上的其他流不受影响
+                Metrics::Add(CLIENT_RATE_REJECT);
+            } else if (isDbRequest && dispatchDbStream) {
+                // 其余的流不等待数据库, 响应之后由事件循环交回; 先计数, 交回可能早于返回
+                h_dbPending.fetch_add(1, std::memory_order_relaxed);
+                reject = dispatchDbStream(this, streamId, request.RetrieveAllToStr());
+                if (reject) { h_dbPending.fetch_sub(1, std::memory_order_relaxed); }
+            } else {
+                RespondHttp2(streamId, request);
+            }
+            if (reject) {
+                h_h2->Respond(h_writeBuff, streamId, *reject, nullptr, nullptr, 0);
+            }
+            request.RetrieveAll();
+        }
+        h_h2->Pump(h_writeBuff, H2_BATCH_SIZE);
+    }
+    if (h_writeBuff.ReadableBytes() == 0) {
+        // 收到一半的帧按头部期限检查, 等待窗口或新请求时按空闲计
+        Phase phase = h_readBuff.ReadableBytes() > 0 ? PHASE_HEADER : PHASE_IDLE;
+        if (GetPhase() != phase) { SetPhase(phase); }
+        return false;
+    }
+    if (GetPhase() != PHASE_WRITE) {
+        h_sentBytes = 0;
+        SetPhase(PHASE_WRITE);
+    }
+    h_iov[0].iov_base = const_cast<char *>(h_writeBuff.Peek());
+    h_iov[0].iov_len = h_writeBuff.ReadableBytes();
+    h_iov[1].iov_len = 0;
+    h_iovCnt = 1;
+    return true;
+}
+
+void HttpConn::AddDbReply(Http2Reply &&reply) {
+    h_dbPending.fetch_sub(1, std::memory_order_relaxed);
+    h_dbReplies.emplace_back(std::move(reply));
+}
+
+void HttpConn::RespondHttp2(uint32_t streamId, Buffer &request) {
+    Http2Reply reply = MakeHttp2Reply(streamId, request, h_request, h_response);
+    h_h2->Respond(h_writeBuff, streamId, reply.head, std::move(reply.owner), reply.body, reply.len);
+}
+
+HttpConn::Http2Reply HttpConn::MakeHttp2Reply(uint32_t streamId, Buffer &buff, HttpRequest &request,
+                                              HttpResponse &response) {
+    Http2Reply reply;
+    reply.streamId = streamId;
+    request.Init();
+    uint64_t parseStart = Metrics::NowNs();
+    bool parsed = request.Parse(buff);
+    Metrics::Record(HIST_PARSE, Metrics::NowNs() - parseStart);
+    Buffer head;
+    if (parsed) {
+        LOG_DEBUG("HTTP/2 stream %u: %s", streamId, request.Path().c_str())
+        response.Init(srcDir, request.Path(), true, 200, request.IsAcceptGzip());
+    } else {
+        response.Init(srcDir, request.Path(), false, 400);
+    }
+    if (parsed && !metricsPath.empty() && request.Path() == metricsPath) {
+        response.MakeBodyResponse(head, "text/plain; version=0.0.4", Metrics::Instance()->Render());
+    } else {
+        response.MakeResponse(head);
+    }
+    Metrics::CountStatus(response.Code());
+
+    // 完整的 HTTP/1.1 响应是 head 接着文件内容, 缓存命中时头部也在缓存的内容里
+    std::string_view text(head.Peek(), head.ReadableBytes());
+    const char *file = response.File();
+    size_t fileLen = file ? response.FileLen() : 0;
+    reply.owner = response.FileOwner();
+    reply.body = file;
+    reply.len = fileLen;
+    size_t headEnd = text.find("\r\n\r\n");
+    if (headEnd == std::string_view::npos) {
+        text = std::string_view(file, fileLen);
+        headEnd = text.find("\r\n\r\n");
+        if (headEnd == std::string_view::npos) {
+            LOG_ERROR("HTTP/2 stream %u: bad response head", streamId)
+            reply.head = "HTTP/1.1 500 Internal Server Error\r\n";
+            reply.owner = nullptr;
+            reply.body = nullptr;
+            reply.len = 0;
+            return reply;
+        }
+        reply.body = file + headEnd + 4;
+        reply.len = fileLen - headEnd - 4;
+    } else if (text.size() > headEnd + 4) {
+        // 错误页和指标页的内容跟在头部之后, 复制一份随流保存
+        auto content = std::make_shared<std::string>(text.substr(headEnd + 4));
+        content->append(file ? file : "", fileLen);
+        reply.body = content->data();
+        reply.len = content->size();
+        reply.owner = std::move(content);
+    }
+    if (request.GetMethod() == "HEAD") {
+        reply.len = 0;
+    }
+    reply.head = text.substr(0, headEnd + 2);
+    return reply;
+}
+
+bool HttpConn::StartWebSocket() {
+    // 之前的响应可能还映射着文件, 之后的写入只有 WebSocket 帧
+    h_response.UnmapFile();
+    h_ws = std::make_unique<WebSocket>(h_fd);
+    ResponseHeader::AppendStatusLine(h_writeBuff, 101);
+    ResponseHeader::AppendField(h_writeBuff, "Upgrade", "websocket");
+    ResponseHeader::AppendField(h_writeBuff, "Connection", "Upgrade");
+    ResponseHeader::AppendField(h_writeBuff, "Sec-WebSocket-Accept",
+                                WebSocket::AcceptKey(h_request.GetHeader("Sec-WebSocket-Key")));
+    h_writeBuff.Append("\r\n", 2);
+    WebSocketHub::Instance()->Add(h_ws.get());
+    h_isWebSocket.store(true, std::memory_order_release);
+    SetNoDelay();
+    Metrics::Add(WS_CONN);
+    Metrics::CountStatus(101);
+    LOG_DEBUG("Client[%d] WebSocket", h_fd)
+    h_trace.Mark(PH_BUILT);
+    h_sentBytes = 0;
+    SetPhase(PHASE_WRITE);
+    h_iov[0].iov_base = const_cast<char *>(h_writeBuff.Peek());
+    h_iov[0].iov_len = h_writeBuff.ReadableBytes();
+    h_iov[1].iov_len = 0;
+    h_iovCnt = 1;
+    return true;
+}
+
+bool HttpConn::ProcessWebSocket() {
+    if (GetPhase() == PHASE_WRITE) {
+        // 上一帧写完后顺带读入新的帧, 持续有广播时也能处理客户端的消息
+        int readErrno = 0;
+        if (Read(&readErrno) == 0) {
+            // 对端已关闭, 交给读事件处理
+            return false;
+        }
+    }
+    if (isDraining) {
+        h_ws->Close(WebSocket::WS_GOING_AWAY);
+    }
+    if (h_ws->Feed(h_readBuff)) {
+        WebSocket::Opcode opcode;
+        std::string payload;
+        while (h_ws->PopMessage(&opcode, payload)) {
+            Metrics::Add(WS_MESSAGE);
+            if (h_isLimited && admitStream && admitStream(h_ipKey, false)) {
+                // 超过单 IP 速率时关闭
+                Metrics::Add(CLIENT_RATE_REJECT);
+                h_ws->Close(WebSocket::WS_POLICY_VIOLATION);
+                break;
+            }
+            if (wsRelay) {
+                WebSocketHub::Instance()->Broadcast(opcode, payload);
+            }
+        }
+    }
+    const WebSocket::Frame *frame = h_ws->Next();
+    if (!frame) {
+        // 收到一半的帧按头部期限检查, 其余时间由 Ping 判断连接是否存活
+        Phase phase = h_readBuff.ReadableBytes() > 0 ? PHASE_HEADER : PHASE_IDLE;
+        if (GetPhase() != phase) { SetPhase(phase); }
+        return false;
+    }
+    if (GetPhase() != PHASE_WRITE) {
+        h_sentBytes = 0;
+        SetPhase(PHASE_WRITE);
+    }
+    // 帧由所有接收者共享, 直接作为 iovec 写出
+    h_iov[0].iov_base = const_cast<char *>(h_writeBuff.Peek());
+    h_iov[0].iov_len = 0;
+    h_iov[1].iov_base = const_cast<char *>((*frame)->data());
+    h_iov[1].iov_len = (*frame)->size();
+    h_iovCnt = 2;
+    return true;
+}
+
+void HttpConn::StartLinger() {
+    // 对端读到 FIN 后知道响应已完整, 不再需要等待请求体发完
+    shutdown(h_fd, SHUT_WR);
+    h_readBuff.RetrieveAll();
+    SetPhase(PHASE_LINGER);
+}
+
+bool HttpConn::Discard() {
+    char buff[16384];
+    // 每次最多读走一个请求的上限, 余下的等下一次可读事件
+    for (size_t total = 0; total < HttpRequest::MAX_REQUEST_SIZE;) {
+        int saveErrno = 0;
+        ssize_t len = h_ssl ? TlsContext::Read(h_ssl, buff, sizeof(buff), &saveErrno) : read(h_fd, buff, sizeof(buff));
+        if (len <= 0) {
+            if (len < 0 && !h_ssl) { saveErrno = errno; }
+            return len < 0 && saveErrno == EAGAIN;
+        }
+        total += len;
+    }
+    return true;
+}
+
+void HttpConn::SetPhase(Phase phase) {
+    h_phaseBytes.store(0, std::memory_order_relaxed);
+    h_phaseNs.store(Metrics::NowNs(), std::memory_order_relaxed);
+    h_phase.store(phase, std::memory_order_relaxed);
+}
+
+void HttpConn::BeginTrace() {
+    if (h_trace.sampled || !Tracer::Sample()) { return; }
+    h_trace = RequestTrace();
+    h_trace.sampled = true;
+    h_trace.ts[PH_ACCEPT] = h_acceptNs;
+    h_trace.Mark(PH_DISPATCH);
+}
+
+void HttpConn::EndTrace() {
+    if (!h_trace.sampled) { return; }
+    h_trace.Mark(PH_LAST_BYTE);
+    Tracer::Instance()->Commit(h_trace, h_fd, h_request.Path());
+    h_trace.sampled = false;
+}
+
+bool HttpConn::IsFileResident() const {
+    if (h_iovCnt < 2 || h_iov[1].iov_len == 0 || !h_response.IsFileBacked()) {
+        return true;
+    }
+    static const size_t pageSize = sysconf(_SC_PAGESIZE);
+    auto begin = reinterpret_cast<uintptr_t>(h_iov[1].iov_base);
+    uintptr_t end = begin + std::min(h_iov[1].iov_len, RESIDENT_WINDOW);
+    begin &= ~(pageSize - 1);
+    unsigned char vec[RESIDENT_WINDOW / 4096 + 2];
+    size_t pages = (end - begin + pageSize - 1) / pageSize;
+    if (pages > sizeof(vec) || mincore(reinterpret_cast<void *>(begin), end - begin, vec) != 0) {
+        return true;
+    }
+    for (size_t i = 0; i < pages; ++i) {
+        if (!(vec[i] & 1)) { return false; }
+    }
+    return true;
+}
+
+std::shared_ptr<const void> HttpConn::PrefetchRange(void **addr, size_t *len) const {
+    *addr = h_iov[1].iov_base;
+    *len = std::min(h_iov[1].iov_len, PREFETCH_LEN);
+    return h_response.FileOwner();
+}
+
+void HttpConn::Prefetch(void *addr, size_t len) {
+    static const size_t pageSize = sysconf(_SC_PAGESIZE);
+    auto begin = reinterpret_cast<uintptr_t>(addr) & ~(pageSize - 1);
+    auto end = reinterpret_cast<uintptr_t>(addr) + len;
+    madvise(reinterpret_cast<void *>(begin), end - begin, MADV_WILLNEED);
+    // 逐页访问, 缺页阻塞发生在 IO 线程
+    volatile char sink = 0;
+    for (uintptr_t p = begin; p < end; p += pageSize) {
+        sink = *reinterpret_cast<const volatile char *>(p);
+    }
+    (void) sink;
+}
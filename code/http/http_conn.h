@@ -4,26 +4,59 @@
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <arpa/inet.h>
+#include <endian.h>
+#include <netinet/tcp.h>
 #include <cstdlib>
 #include <cerrno>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <vector>
 
 #include "../log/log.h"
 #include "../pool/sql_conn_RAII.h"
 #include "../buffer/buffer.h"
 #include "http_request.h"
 #include "http_response.h"
+#include "tls.h"
+#include "http2_session.h"
+#include "websocket.h"
+#include "../server/bandwidth.h"
+#include "../metrics/metrics.h"
+#include "../metrics/trace.h"
+#include "../metrics/probes.h"
 
 class HttpConn {
 public:
+    // 交给数据库队列的 HTTP/2 流的响应, 在数据库线程中构造, 由事件循环交回连接
+    struct Http2Reply {
+        uint32_t streamId = 0;
+        std::string head;
+        std::shared_ptr<const void> owner;
+        const char *body = nullptr;
+        size_t len = 0;
+    };
+
+    // 连接当前所处阶段, 由工作线程更新, 超时检查时读取
+    enum Phase {
+        PHASE_IDLE,       // 等待下一个请求
+        PHASE_HEADER,     // 已收到部分头部
+        PHASE_BODY,       // 头部完整, 请求体未收齐
+        PHASE_PROCESS,    // 请求完整, 正在处理
+        PHASE_WRITE,      // 正在发送响应
+        PHASE_LINGER,     // 已回应 413 并关闭写端, 丢弃剩余的请求体
+    };
+
     HttpConn();
 
     ~HttpConn();
 
-    void Init(int sockFd, const sockaddr_in &addr);
+    void Init(int sockFd, const sockaddr_storage &addr);
 
     ssize_t Read(int *saveErrno);
 
-    ssize_t Write(int *saveErrno);
+    // maxBytes 为本次最多发送的字节数, 0 表示不限制
+    ssize_t Write(int *saveErrno, size_t maxBytes = 0);
 
     void Close();
 
@@ -33,32 +66,218 @@ public:
 
     const char *GetIP() const;
 
-    sockaddr_in GetAddr() const;
+    // 单 IP 限制和限速使用的键: IPv4 地址, IPv6 的 /64 前缀, AF_UNIX 为 0; 编码见 ip_key_t
+    static ip_key_t IpKey(const sockaddr_storage &addr);
+
+    ip_key_t GetIpKey() const { return h_ipKey; }
+
+    // 是否计入单 IP 连接数, 由所在的监听套接字决定
+    void SetLimited(bool isLimited) { h_isLimited = isLimited; }
+
+    bool IsLimited() const { return h_isLimited; }
+
+    // TLS 连接: 先完成握手, 期间按头部阶段计算期限
+    void InitTls(ssl_st *ssl);
+
+    bool IsTls() const { return h_ssl != nullptr; }
+
+    bool IsHandshaking() const { return h_isHandshaking; }
+
+    // 内核是否接管了发送方向的加密, 此时可以直接对 fd 写明文
+    bool IsKtlsSend() const { return h_isKtlsSend; }
+
+    TlsContext::Result Handshake();
 
     bool process();
 
+    size_t ToReadBytes() const { return h_readBuff.ReadableBytes(); }
+
     int ToWriteBytes() {
         return h_iov[0].iov_len + h_iov[1].iov_len;
     }
 
     bool IsKeepAlive() const {
-        return h_request.IsKeepAlive();
+        // HTTP/2 连接在流都完成并发送 GOAWAY 之前一直保持, WebSocket 直到关闭帧写出
+        if (h_h2) { return !h_h2->IsDone(); }
+        if (h_ws) { return !h_ws->IsDone(); }
+        return h_request.IsKeepAlive() && !isDraining;
+    }
+
+    bool IsHttp2() const { return h_h2 != nullptr; }
+
+    // 响应写完后不能直接关闭: 对端还在发送请求体, 接收缓冲区有数据时关闭会发 RST, 冲掉已发出的响应
+    bool IsLinger() const { return h_isLinger; }
+
+    // 关闭写端并进入 PHASE_LINGER, 之后读到的数据都丢弃
+    void StartLinger();
+
+    // 读走并丢弃已到达的数据, 对端关闭或出错时返回 false
+    bool Discard();
+
+    // 解析一个 HTTP/2 流的请求并构造响应, 只使用传入的 request/response, 可以在其他线程中调用
+    static Http2Reply MakeHttp2Reply(uint32_t streamId, Buffer &buff, HttpRequest &request, HttpResponse &response);
+
+    // 交回数据库线程构造的响应, 下次 process 时写入; 与 HasDbReply 一样在 DispatchMutex 内调用
+    void AddDbReply(Http2Reply &&reply);
+
+    bool HasDbReply() const { return !h_dbReplies.empty(); }
+
+    // 有交给数据库队列且响应还没交回的流, 连接不算空闲
+    bool IsAwaitingDb() const { return h_dbPending.load(std::memory_order_relaxed) > 0; }
+
+    // 事件循环线程也会读取, 关闭后 WebSocket 保留到连接重新初始化
+    bool IsWebSocket() const { return h_isWebSocket.load(std::memory_order_acquire); }
+
+    WebSocket *GetWebSocket() const { return h_ws.get(); }
+
+    bool IsClosed() const { return isClose; }
+
+    // 事件循环派发读写任务前置位, 工作线程交还连接时在 DispatchMutex 内清除后再重新注册事件;
+    // 事件循环只在同一把锁内确认未派发后才能关闭连接
+    bool IsDispatched() const { return h_isDispatched.load(std::memory_order_acquire); }
+
+    void SetDispatched(bool isDispatched) { h_isDispatched.store(isDispatched, std::memory_order_release); }
+
+    std::mutex &DispatchMutex() { return h_dispatchMutex; }
+
+    // 已读到的请求是否会访问数据库
+    bool IsDbRequest() const {
+        return HttpRequest::IsDbRequest(h_readBuff.Peek(), h_readBuff.BeginWriteConst());
     }
 
+    const std::string &GetPath() { return h_request.Path(); }
+
+    // 命中限速规则的响应使用的令牌桶, 未命中时 rate 为 0
+    TokenBucket &GetBucket() { return h_bucket; }
+
+    // 当前响应已发送超过一个写配额
+    size_t GetSentBytes() const { return h_sentBytes; }
+
+    bool IsBulk() const { return writeQuantum > 0 && h_sentBytes >= static_cast<size_t>(writeQuantum); }
+
+    uint64_t GetSeq() const { return h_seq; }
+
+    // 收包 CPU 所在的 NUMA 节点, 未开启绑定时为 -1
+    int GetNode() const { return h_node; }
+
+    void SetNode(int node) { h_node = node; }
+
+    // 缓冲区不在 node 上且为空时在当前线程重新分配, 由工作线程调用
+    void LocalizeBuffers(int node);
+
+    Phase GetPhase() const { return static_cast<Phase>(h_phase.load(std::memory_order_relaxed)); }
+
+    // 进入当前阶段的时间
+    uint64_t GetPhaseNs() const { return h_phaseNs.load(std::memory_order_relaxed); }
+
+    // 当前阶段已收到的请求体或已发送的响应字节数
+    uint64_t GetPhaseBytes() const { return h_phaseBytes.load(std::memory_order_relaxed); }
+
+    // 最近一次读到或写出数据的时间
+    uint64_t GetActiveNs() const { return h_activeNs.load(std::memory_order_relaxed); }
+
+    // 事件循环投递读任务时决定是否采样, 响应写完时提交
+    void BeginTrace();
+
+    void EndTrace();
+
+    // 发送窗口内的文件页是否都在页缓存中
+    bool IsFileResident() const;
+
+    // 预读区间, 返回的 owner 保证映射在预读期间有效
+    std::shared_ptr<const void> PrefetchRange(void **addr, size_t *len) const;
+
+    static void Prefetch(void *addr, size_t len);
+
     static bool isET;
+    // 开启后文件页不在内存时交给 IO 线程预读, 不在工作线程中缺页阻塞
+    static bool isCheckResident;
+    // 单次 Write 最多发送的字节数, 0 表示不限制
+    static int writeQuantum;
+    // 接受 h2c 连接前言, TLS 连接通过 ALPN 协商
+    static bool isHttp2;
+    // HTTP/2 的登录/注册流交给数据库队列, 放行时返回 nullptr, 否则返回拒绝使用的响应; 为空时在工作线程中处理
+    static std::function<const std::string *(HttpConn *conn, uint32_t streamId, std::string &&request)>
+            dispatchDbStream;
+    // HTTP/2 的每个流和 WebSocket 的每条消息单独按 IP 计费, 放行时返回 nullptr, 否则返回拒绝使用的响应
+    static std::function<const std::string *(ip_key_t ip, bool isDbRequest)> admitStream;
     static const char *srcDir;
+    // 指标页路径, 为空时不提供
+    static std::string metricsPath;
+    // WebSocket 握手路径, 为空时不提供
+    static std::string wsPath;
+    // 转发客户端消息给所有连接; 关闭时客户端消息只计数, 推送由服务端调用 WebSocketHub::Broadcast
+    static bool wsRelay;
     static std::atomic<int> userCount;
+    // 进程准备退出, 响应完当前请求后关闭连接
+    static std::atomic<bool> isDraining;
 
 private:
+    void SetPhase(Phase phase);
+
+    // 响应头在写缓冲区, 文件或缓存的完整响应在 h_response 中, 设置 iov 开始发送
+    bool StartResponse();
+
+    void StartHttp2();
+
+    // 小帧和 TLS 记录不等待 Nagle 合并
+    void SetNoDelay();
+
+    // HTTP/2 连接的 process: 处理收到的帧, 为收齐的请求构造响应, 再按窗口装入一批 DATA 帧
+    bool ProcessHttp2();
+
+    void RespondHttp2(uint32_t streamId, Buffer &request);
+
+    // 回应 101 并切换到 WebSocket 帧
+    bool StartWebSocket();
+
+    // WebSocket 连接的 process: 处理收到的帧, 开启 wsRelay 时广播收齐的消息, 再装入下一个待发送的帧
+    bool ProcessWebSocket();
+
+    // 明文直接 writev, 未由内核接管的 TLS 连接经过 SSL_write
+    ssize_t WriteV(const struct iovec *iov, int iovCnt, int *saveErrno);
+
+    static const size_t TLS_READ_SIZE = 16384;
+    // 每次装入写缓冲区的 HTTP/2 帧字节数
+    static const size_t H2_BATCH_SIZE = 131072;
+
     int h_fd;
-    struct sockaddr_in s_addr;
+    // 每次 Init 递增, 用于识别 fd 复用后的旧回调
+    uint64_t h_seq;
+    int h_node;
+    // 缓冲区页面所在的节点, 随 fd 复用保留, -1 表示在事件循环线程上分配
+    int h_buffNode;
+    struct sockaddr_storage s_addr;
+    char h_ip[INET6_ADDRSTRLEN];
+    ip_key_t h_ipKey;
+    bool h_isLimited;
+    ssl_st *h_ssl;
+    bool h_isHandshaking;
+    bool h_isKtlsSend;
     bool isClose;
+    bool h_isLinger;
     int h_iovCnt;
+    size_t h_sentBytes;
+    uint64_t h_acceptNs;
+    std::atomic<int> h_phase;
+    std::atomic<uint64_t> h_phaseNs;
+    std::atomic<uint64_t> h_phaseBytes;
+    std::atomic<uint64_t> h_activeNs;
+    RequestTrace h_trace;
+    TokenBucket h_bucket;
     struct iovec h_iov[2];
     Buffer h_readBuff; // 读缓冲区
     Buffer h_writeBuff; // 写缓冲区
     HttpRequest h_request;
     HttpResponse h_response;
+    std::unique_ptr<Http2Session> h_h2;
+    // 数据库队列中的流数, 和已经交回等待写入的响应
+    std::atomic<int> h_dbPending;
+    std::vector<Http2Reply> h_dbReplies;
+    std::unique_ptr<WebSocket> h_ws;
+    std::atomic<bool> h_isWebSocket;
+    std::atomic<bool> h_isDispatched;
+    std::mutex h_dispatchMutex;
 };
 
 
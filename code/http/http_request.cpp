@@ -1,5 +1,8 @@
 #include "http_request.h"
 
+#include <charconv>
+#include <strings.h>
+
 const std::unordered_set<string> HttpRequest::DEFAULT_HTML{
         "/index", "/register", "/login",
         "/welcome", "/video", "/picture",};
@@ -22,6 +25,37 @@ bool HttpRequest::IsKeepAlive() const {
     return false;
 }
 
+bool HttpRequest::IsAcceptGzip() const {
+    auto it = h_header.find("Accept-Encoding");
+    return it != h_header.end() && it->second.find("gzip") != string::npos;
+}
+
+string HttpRequest::GetHeader(const string &key) const {
+    auto it = h_header.find(key);
+    return it != h_header.end() ? it->second : "";
+}
+
+bool HttpRequest::IsWebSocketUpgrade() const {
+    // 逗号分隔的取值中是否含有 token, 不区分大小写
+    auto hasToken = [this](const string &key, std::string_view token) {
+        string value = GetHeader(key);
+        for (size_t begin = 0; begin < value.size();) {
+            size_t end = std::min(value.find(',', begin), value.size());
+            size_t first = value.find_first_not_of(' ', begin);
+            size_t last = value.find_last_not_of(' ', end - 1);
+            if (first < end && last - first + 1 == token.size() &&
+                strncasecmp(value.data() + first, token.data(), token.size()) == 0) {
+                return true;
+            }
+            begin = end + 1;
+        }
+        return false;
+    };
+    return h_method == "GET" && h_version == "1.1" && hasToken("Upgrade", "websocket") &&
+           hasToken("Connection", "Upgrade") && GetHeader("Sec-WebSocket-Version") == "13" &&
+           !GetHeader("Sec-WebSocket-Key").empty();
+}
+
 bool HttpRequest::Parse(Buffer &buff) {
     const char CRLF[] = "\r\n";
     if (buff.ReadableBytes() <= 0) {
@@ -62,6 +96,44 @@ bool HttpRequest::Parse(Buffer &buff) {
     return true;
 }
 
+bool HttpRequest::IsDbRequest(const char *begin, const char *end) {
+    std::string_view line(begin, end - begin);
+    line = line.substr(0, line.find("\r\n"));
+    if (line.compare(0, 5, "POST ") != 0) {
+        return false;
+    }
+    string path(line.substr(5, line.find(' ', 5) - 5));
+    if (DEFAULT_HTML.count(path)) {
+        path += ".html";
+    }
+    return DEFAULT_HTML_TAG.count(path) > 0;
+}
+
+HttpRequest::PROGRESS HttpRequest::Progress(const char *begin, const char *end, size_t *bodyBytes) {
+    std::string_view buff(begin, end - begin);
+    *bodyBytes = 0;
+    size_t headerEnd = buff.find("\r\n\r\n");
+    if (headerEnd == std::string_view::npos) {
+        return buff.size() > MAX_HEADER_SIZE ? COMPLETE : PENDING_HEADER;
+    }
+    static constexpr std::string_view field = "content-length:";
+    size_t contentLength = 0;
+    for (size_t pos = buff.find("\r\n"); pos < headerEnd; pos = buff.find("\r\n", pos + 2)) {
+        std::string_view line = buff.substr(pos + 2, field.size());
+        if (line.size() == field.size() && strncasecmp(line.data(), field.data(), field.size()) == 0) {
+            const char *value = begin + pos + 2 + field.size();
+            while (*value == ' ') { ++value; }
+            std::from_chars(value, begin + headerEnd, contentLength);
+            break;
+        }
+    }
+    if (contentLength > MAX_BODY_SIZE || headerEnd + 4 + contentLength > MAX_REQUEST_SIZE) {
+        return TOO_LARGE;
+    }
+    *bodyBytes = buff.size() - headerEnd - 4;
+    return *bodyBytes >= contentLength ? COMPLETE : PENDING_BODY;
+}
+
 void HttpRequest::ParsePath() {
     if (h_path == "/") {
         h_path = "/index.html";
@@ -137,8 +209,16 @@ bool HttpRequest::UserVerify(const string &name, const string &pwd, bool isLogin
     if (name.empty() || pwd.empty()) { return false; }
     LOG_INFO("Verify name:%s pwd:%s", name.c_str(), pwd.c_str())
     MYSQL *sql;
-    SqlConnRAII(&sql, SqlConnPool::Instance());
-    assert(sql);
+    Tracer::Mark(PH_DB_BEGIN);
+    uint64_t waitStart = Metrics::NowNs();
+    SqlConnRAII conn(&sql, SqlConnPool::Instance());
+    uint64_t queryStart = Metrics::NowNs();
+    Metrics::Record(HIST_DB_WAIT, queryStart - waitStart);
+    if (!sql) {
+        // 连接池已空, 工作线程数可能超过了连接数
+        Tracer::Mark(PH_DB_END);
+        return false;
+    }
 
     bool flag = false;
     MYSQL_RES *res = nullptr;
@@ -152,6 +232,8 @@ bool HttpRequest::UserVerify(const string &name, const string &pwd, bool isLogin
 
     if (mysql_query(sql, order1.c_str())) {
         mysql_free_result(res);
+        Metrics::Record(HIST_DB_QUERY, Metrics::NowNs() - queryStart);
+        Tracer::Mark(PH_DB_END);
         return false;
     }
     res = mysql_store_result(sql);
@@ -183,7 +265,8 @@ bool HttpRequest::UserVerify(const string &name, const string &pwd, bool isLogin
         }
         flag = true;
     }
-    SqlConnPool::Instance()->FreeConn(sql);
+    Metrics::Record(HIST_DB_QUERY, Metrics::NowNs() - queryStart);
+    Tracer::Mark(PH_DB_END);
     LOG_DEBUG("UserVerify success!!")
     return flag;
 }
@@ -12,6 +12,8 @@
 #include "../log/log.h"
 #include "../pool/sql_conn_pool.h"
 #include "../pool/sql_conn_RAII.h"
+#include "../metrics/metrics.h"
+#include "../metrics/trace.h"
 
 using std::string;
 
@@ -35,6 +37,14 @@ public:
         CLOSED_CONNECTION,
     };
 
+    // 请求接收进度
+    enum PROGRESS {
+        PENDING_HEADER,
+        PENDING_BODY,
+        COMPLETE,
+        TOO_LARGE,
+    };
+
     HttpRequest() { Init(); }
 
     void Init();
@@ -53,6 +63,27 @@ public:
 
     bool IsKeepAlive() const;
 
+    bool IsAcceptGzip() const;
+
+    string GetHeader(const string &key) const;
+
+    // RFC 6455 握手: HTTP/1.1 的 GET, Upgrade 为 websocket, Connection 含 Upgrade, 版本 13 且带 Sec-WebSocket-Key
+    bool IsWebSocketUpgrade() const;
+
+    // 只看请求行判断是否为需要访问数据库的登录/注册请求
+    static bool IsDbRequest(const char *begin, const char *end);
+
+    // 只扫描头部结束符和 Content-length, 不做解析; bodyBytes 为已收到的请求体字节数
+    // 头部超过 MAX_HEADER_SIZE 仍未结束时视为完整, 交给 Parse 报错;
+    // Content-length 超过 MAX_BODY_SIZE 或整个请求超过 MAX_REQUEST_SIZE 时为 TOO_LARGE
+    static PROGRESS Progress(const char *begin, const char *end, size_t *bodyBytes);
+
+    static const size_t MAX_HEADER_SIZE = 16384;
+    // HTTP/1.1 请求体和 HTTP/2 每个流的请求体上限
+    static const size_t MAX_BODY_SIZE = 1 << 20;
+    // 读缓冲区中未处理的请求超过这个大小时停止读入
+    static const size_t MAX_REQUEST_SIZE = MAX_HEADER_SIZE + MAX_BODY_SIZE;
+
 private:
     bool ParseRequestLine(const string &line);
 
@@ -1,66 +1,54 @@
 #include "http_response.h"
 
-const std::unordered_map<std::string, std::string> HttpResponse::SUFFIX_TYPE = {
-        {".html",  "text/html"},
-        {".xml",   "text/xml"},
-        {".xhtml", "application/xhtml+xml"},
-        {".txt",   "text/plain"},
-        {".rtf",   "application/rtf"},
-        {".pdf",   "application/pdf"},
-        {".word",  "application/msword"},
-        {".png",   "image/png"},
-        {".gif",   "image/gif"},
-        {".jpg",   "image/jpeg"},
-        {".jpeg",  "image/jpeg"},
-        {".au",    "audio/basic"},
-        {".mpeg",  "video/mpeg"},
-        {".mpg",   "video/mpeg"},
-        {".avi",   "video/x-msvideo"},
-        {".gz",    "application/x-gzip"},
-        {".tar",   "application/x-tar"},
-        {".css",   "text/css "},
-        {".js",    "text/javascript "},
-};
-
-const std::unordered_map<int, std::string> HttpResponse::CODE_STATUS = {
-        {200, "OK"},
-        {400, "Bad Request"},
-        {403, "Forbidden"},
-        {404, "Not Found"},
-};
-
 const std::unordered_map<int, std::string> HttpResponse::CODE_PATH = {
         {400, "/400.html"},
         {403, "/403.html"},
         {404, "/404.html"},
 };
 
+std::atomic<int> HttpResponse::keepAliveSec;
+
 HttpResponse::HttpResponse() {
     h_code = -1;
     path = srcDir = "";
     isKeepAlive = false;
-    mmFile = nullptr;
+    h_keepAliveSec = 0;
+    isAcceptGzip = false;
     mmFileStat = {0};
+    h_cached = nullptr;
+    h_bundle = nullptr;
+    h_bundleBody = nullptr;
+    h_bundleLen = 0;
 }
 
 HttpResponse::~HttpResponse() {
     UnmapFile();
 }
 
-void HttpResponse::Init(const std::string &_srcDir, std::string &_path, bool _isKeepAlive, int _code) {
+void HttpResponse::Init(const std::string &_srcDir, std::string &_path, bool _isKeepAlive, int _code,
+                        bool _isAcceptGzip) {
     assert(!_srcDir.empty());
-    if (mmFile) { UnmapFile(); }
+    UnmapFile();
     h_code = _code;
     isKeepAlive = _isKeepAlive;
+    h_keepAliveSec = keepAliveSec.load(std::memory_order_relaxed);
+    isAcceptGzip = _isAcceptGzip;
     path = _path;
     srcDir = _srcDir;
-    mmFile = nullptr;
     mmFileStat = {0};
+    h_cached = nullptr;
+    h_bundle = nullptr;
+    h_bundleBody = nullptr;
+    h_bundleLen = 0;
 }
 
 void HttpResponse::MakeResponse(Buffer &buff) {
+    // 资源包优先, 未收录的路径回退到文件系统
+    if (h_code != 400 && MakeBundleResponse(buff)) {
+        return;
+    }
     // 判断请求的资源文件
-    if (stat((srcDir + path).data(), &mmFileStat) < 0 || S_ISDIR(mmFileStat.st_mode)) {
+    if (!FileCache::Instance()->Stat(srcDir, path, mmFileStat) || S_ISDIR(mmFileStat.st_mode)) {
         h_code = 404;
     } else if (!(mmFileStat.st_mode & S_IROTH)) {
         h_code = 403;
@@ -68,103 +56,149 @@ void HttpResponse::MakeResponse(Buffer &buff) {
         h_code = 200;
     }
     ErrorHtml();
+    // 小文件直接使用缓存的完整响应
+    h_cached = ResponseCache::Instance()->GetFile(srcDir, path, mmFileStat, h_code, isKeepAlive, h_keepAliveSec);
+    if (h_cached) {
+        return;
+    }
+    if (!MapFile()) {
+        ErrorContent(buff, "File NotFound!");
+        return;
+    }
     AddStateLine(buff);
     AddHeader(buff);
     AddContent(buff);
 }
 
 char *HttpResponse::File() {
-    return mmFile;
+    if (h_cached) {
+        return const_cast<char *>(h_cached->data());
+    }
+    if (h_bundle) {
+        return const_cast<char *>(h_bundleBody);
+    }
+    return h_mapped ? h_mapped->Data() : nullptr;
 }
 
 size_t HttpResponse::FileLen() const {
-    return mmFileStat.st_size;
+    if (h_cached) {
+        return h_cached->size();
+    }
+    if (h_bundle) {
+        return h_bundleLen;
+    }
+    return h_mapped ? h_mapped->Len() : 0;
+}
+
+std::shared_ptr<const void> HttpResponse::FileOwner() const {
+    if (h_cached) {
+        return h_cached;
+    }
+    if (h_bundle) {
+        return h_bundle;
+    }
+    return h_mapped;
+}
+
+bool HttpResponse::MakeBundleResponse(Buffer &buff) {
+    BundleFile file{};
+    h_bundle = Bundle::Instance()->Acquire();
+    if (!h_bundle || !h_bundle->Find(path, file)) {
+        h_bundle = nullptr;
+        return false;
+    }
+    h_code = 200;
+    bool useGzip = isAcceptGzip && file.gzip;
+    h_bundleBody = useGzip ? file.gzip : file.data;
+    h_bundleLen = useGzip ? file.gzipLen : file.len;
+
+    AddStateLine(buff);
+    ResponseHeader::AppendConnection(buff, isKeepAlive, h_keepAliveSec);
+    ResponseHeader::AppendField(buff, "Content-type", file.mime);
+    ResponseHeader::AppendField(buff, "ETag", file.etag);
+    if (file.gzip) {
+        ResponseHeader::AppendField(buff, "Vary", "Accept-Encoding");
+    }
+    if (useGzip) {
+        ResponseHeader::AppendField(buff, "Content-Encoding", "gzip");
+    }
+    ResponseHeader::AppendDate(buff);
+    ResponseHeader::AppendContentLength(buff, h_bundleLen);
+    return true;
+}
+
+void HttpResponse::MakeBodyResponse(Buffer &buff, std::string_view contentType, const std::string &body) {
+    h_code = 200;
+    AddStateLine(buff);
+    ResponseHeader::AppendConnection(buff, isKeepAlive, h_keepAliveSec);
+    ResponseHeader::AppendField(buff, "Content-type", contentType);
+    ResponseHeader::AppendDate(buff);
+    ResponseHeader::AppendContentLength(buff, body.size());
+    buff.Append(body.data(), body.size());
 }
 
 void HttpResponse::ErrorHtml() {
     if (CODE_PATH.count(h_code) == 1) {
         path = CODE_PATH.find(h_code)->second;
-        stat((srcDir + path).data(), &mmFileStat);
+        FileCache::Instance()->Stat(srcDir, path, mmFileStat);
     }
 }
 
 void HttpResponse::AddStateLine(Buffer &buff) {
-    std::string status;
-    if (CODE_STATUS.count(h_code) == 1) {
-        status = CODE_STATUS.find(h_code)->second;
-    } else {
+    if (!ResponseHeader::HasStatus(h_code)) {
         h_code = 400;
-        status = CODE_STATUS.find(400)->second;
     }
-    buff.Append("HTTP/1.1 " + std::to_string(h_code) + " " + status + "\r\n");
+    ResponseHeader::AppendStatusLine(buff, h_code);
 }
 
 void HttpResponse::AddHeader(Buffer &buff) {
-    buff.Append("Connection: ");
-    if (isKeepAlive) {
-        buff.Append("keep-alive\r\n");
-        buff.Append("keep-alive: max=6, timeout=120\r\n");
-    } else {
-        buff.Append("close\r\n");
-    }
-    buff.Append("Content-type: " + GetFileType() + "\r\n");
+    ResponseHeader::AppendConnection(buff, isKeepAlive, h_keepAliveSec);
+    ResponseHeader::AppendContentType(buff, path);
+    ResponseHeader::AppendDate(buff);
 }
 
-void HttpResponse::AddContent(Buffer &buff) {
-    int srcFd = open((srcDir + path).data(), O_RDONLY);
-    if (srcFd < 0) {
-        ErrorContent(buff, "File NotFound!");
-        return;
-    }
-
-    // 将文件映射到内存提高文件的访问速度
-    // MAP_PRIVATE 建立一个写入时拷贝的私有映射
-    LOG_DEBUG("file Path %s", (srcDir + path).data())
-    int *mmRet = (int *) mmap(0, mmFileStat.st_size, PROT_READ, MAP_PRIVATE,
-                              srcFd, 0);
-    if (*mmRet == -1) {
-        ErrorContent(buff, "File NotFound!");
-        return;
-    }
-    mmFile = (char *) mmRet;
-    close(srcFd);
-    buff.Append("Content-length: " + std::to_string(mmFileStat.st_size) + "\r\n\r\n");
+bool HttpResponse::MapFile() {
+    // 开启 FileCache 时复用已有映射
+    LOG_DEBUG("file Path %s%s", srcDir.c_str(), path.c_str())
+    h_mapped = FileCache::Instance()->Map(srcDir, path, mmFileStat);
+    return h_mapped != nullptr;
 }
 
-void HttpResponse::UnmapFile() {
-    if (mmFile) {
-        munmap(mmFile, mmFileStat.st_size);
-        mmFile = nullptr;
-    }
+void HttpResponse::AddContent(Buffer &buff) {
+    ResponseHeader::AppendContentLength(buff, mmFileStat.st_size);
 }
 
-std::string HttpResponse::GetFileType() {
-    // 判断文件类型
-    std::string::size_type idx = path.find_last_of('.');
-    if (idx == std::string::npos) {
-        return "text/plain";
-    }
-    std::string suffix = path.substr(idx);
-    if (SUFFIX_TYPE.count(suffix) == 1) {
-        return SUFFIX_TYPE.find(suffix)->second;
-    }
-    return "text/plain";
+void HttpResponse::UnmapFile() {
+    h_mapped = nullptr;
+    h_cached = nullptr;
+    h_bundle = nullptr;
 }
 
-void HttpResponse::ErrorContent(Buffer &buff, const std::string &message) const {
-    std::string body;
-    std::string status;
-    body += "<html><title>Error</title>";
-    body += "<body bgcolor=\"ffffff\">";
-    if (CODE_STATUS.count(h_code) == 1) {
-        status = CODE_STATUS.find(h_code)->second;
-    } else {
-        status = "Bad Request";
+void HttpResponse::ErrorContent(Buffer &buff, const std::string &message) {
+    h_cached = ResponseCache::Instance()->GetError(h_code, message, isKeepAlive, h_keepAliveSec);
+    if (h_cached) {
+        return;
     }
-    body += std::to_string(h_code) + " : " + status + "\n";
-    body += "<p>" + message + "</p>";
-    body += "<hr><em>TryWebServer</em></body></html>";
-
-    buff.Append("Content-length: " + std::to_string(body.size()) + "\r\n\r\n");
-    buff.Append(body);
+    AddStateLine(buff);
+    ResponseHeader::AppendConnection(buff, isKeepAlive, h_keepAliveSec);
+    ResponseHeader::AppendContentType(buff, ".html");
+    ResponseHeader::AppendDate(buff);
+
+    static constexpr std::string_view head = "<html><title>Error</title><body bgcolor=\"ffffff\">";
+    static constexpr std::string_view tail = "<hr><em>TryWebServer</em></body></html>";
+    char code[16];
+    size_t codeLen = ResponseHeader::FormatUInt(code, h_code);
+    std::string_view status = ResponseHeader::StatusText(h_code);
+
+    size_t bodyLen = head.size() + codeLen + 3 + status.size() + 1
+                     + 3 + message.size() + 4 + tail.size();
+    ResponseHeader::AppendContentLength(buff, bodyLen);
+    buff.Append(head.data(), head.size());
+    buff.Append(code, codeLen);
+    buff.Append(" : ", 3);
+    buff.Append(status.data(), status.size());
+    buff.Append("\n<p>", 4);
+    buff.Append(message.data(), message.size());
+    buff.Append("</p>", 4);
+    buff.Append(tail.data(), tail.size());
 }
@@ -1,6 +1,7 @@
 #ifndef HTTP_RESPONSE_H
 #define HTTP_RESPONSE_H
 
+#include <atomic>
 #include <unordered_map>
 #include <fcntl.h>
 #include <unistd.h>
@@ -9,6 +10,10 @@
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
+#include "response_header.h"
+#include "response_cache.h"
+#include "file_cache.h"
+#include "../bundle/bundle.h"
 
 class HttpResponse {
 public:
@@ -16,7 +21,8 @@ public:
 
     ~HttpResponse();
 
-    void Init(const std::string &_srcDir, std::string &_path, bool _isKeepAlive = false, int _code = -1);
+    void Init(const std::string &_srcDir, std::string &_path, bool _isKeepAlive = false, int _code = -1,
+              bool _isAcceptGzip = false);
 
     void MakeResponse(Buffer &buff);
 
@@ -26,10 +32,22 @@ public:
 
     size_t FileLen() const;
 
-    void ErrorContent(Buffer &buff, const std::string& message) const;
+    void ErrorContent(Buffer &buff, const std::string &message);
+
+    // 动态生成的响应体, 不经过文件和缓存
+    void MakeBodyResponse(Buffer &buff, std::string_view contentType, const std::string &body);
 
     int Code() const { return h_code; }
 
+    // 文件内容来自文件映射(可能触发缺页读盘)
+    bool IsFileBacked() const { return !h_cached && (h_mapped || h_bundle); }
+
+    // 持有响应内容的引用, 保证异步预读期间映射有效
+    std::shared_ptr<const void> FileOwner() const;
+
+    // 当前的空闲超时(秒), 写入 Keep-Alive 头, 0 表示不发送
+    static std::atomic<int> keepAliveSec;
+
 private:
     void AddStateLine(Buffer &buff);
 
@@ -37,21 +55,29 @@ private:
 
     void AddContent(Buffer &buff);
 
-    void ErrorHtml();
+    bool MapFile();
+
+    bool MakeBundleResponse(Buffer &buff);
 
-    std::string GetFileType();
+    void ErrorHtml();
 
     int h_code;
     bool isKeepAlive;
+    int h_keepAliveSec;
+    bool isAcceptGzip;
 
     std::string path;
     std::string srcDir;
 
-    char *mmFile;
+    std::shared_ptr<const MappedFile> h_mapped;
     struct stat mmFileStat;
+    CachedBlock h_cached;
+
+    // 资源包中的文件直接引用映射内存
+    std::shared_ptr<const BundleMapping> h_bundle;
+    const char *h_bundleBody;
+    size_t h_bundleLen;
 
-    static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;
-    static const std::unordered_map<int, std::string> CODE_STATUS;
     static const std::unordered_map<int, std::string> CODE_PATH;
 };
 
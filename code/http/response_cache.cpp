@@ -0,0 +1,182 @@
+#include "response_cache.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <ctime>
+
+ResponseCache *ResponseCache::Instance() {
+    static ResponseCache cache;
+    return &cache;
+}
+
+void ResponseCache::Init(size_t maxFileSize) {
+    r_maxFileSize = maxFileSize;
+    for (auto &shard: r_shards) {
+        std::lock_guard<std::mutex> locker(shard.mutex);
+        shard.files.clear();
+        shard.errors.clear();
+    }
+}
+
+CachedBlock ResponseCache::GetFile(const std::string &srcDir, const std::string &path,
+                                   const struct stat &st, int code, bool isKeepAlive, int keepAliveSec) {
+    if (!IsOpen() || !S_ISREG(st.st_mode) || static_cast<size_t>(st.st_size) > r_maxFileSize) {
+        return nullptr;
+    }
+    Shard &shard = ShardOf(path);
+    EntryPtr entry;
+    {
+        std::lock_guard<std::mutex> locker(shard.mutex);
+        auto it = shard.files.find(path);
+        if (it != shard.files.end()) {
+            if (it->second->mtime == st.st_mtime && it->second->size == st.st_size && it->second->ino == st.st_ino) {
+                entry = it->second;
+            } else {
+                shard.files.erase(it);
+            }
+        }
+    }
+    if (entry) {
+        return GetVariant(*entry, path, code, isKeepAlive, keepAliveSec);
+    }
+
+    // 读文件不持锁
+    std::string body;
+    if (!ReadFile(srcDir + path, st.st_size, body)) {
+        return nullptr;
+    }
+    entry = std::make_shared<Entry>();
+    entry->body = std::make_shared<const std::string>(std::move(body));
+    entry->mtime = st.st_mtime;
+    entry->size = st.st_size;
+    entry->ino = st.st_ino;
+    {
+        std::lock_guard<std::mutex> locker(shard.mutex);
+        shard.files.insert_or_assign(path, entry);
+    }
+    LOG_DEBUG("ResponseCache add %s, size:%d", path.c_str(), (int) st.st_size)
+    return GetVariant(*entry, path, code, isKeepAlive, keepAliveSec);
+}
+
+CachedBlock ResponseCache::GetError(int code, const std::string &message, bool isKeepAlive, int keepAliveSec) {
+    if (!IsOpen()) {
+        return nullptr;
+    }
+    std::string key = std::to_string(code) + ":" + message;
+    Shard &shard = ShardOf(key);
+    EntryPtr entry;
+    {
+        std::lock_guard<std::mutex> locker(shard.mutex);
+        EntryPtr &slot = shard.errors[key];
+        if (!slot) {
+            slot = std::make_shared<Entry>();
+            slot->body = std::make_shared<const std::string>(ErrorBody(code, message));
+        }
+        entry = slot;
+    }
+    return GetVariant(*entry, ".html", code, isKeepAlive, keepAliveSec);
+}
+
+void ResponseCache::Invalidate(const std::string &path) {
+    Shard &shard = ShardOf(path);
+    std::lock_guard<std::mutex> locker(shard.mutex);
+    shard.files.erase(path);
+}
+
+void ResponseCache::Clear() {
+    for (auto &shard: r_shards) {
+        std::lock_guard<std::mutex> locker(shard.mutex);
+        shard.files.clear();
+    }
+}
+
+size_t ResponseCache::Size() {
+    size_t size = 0;
+    for (auto &shard: r_shards) {
+        std::lock_guard<std::mutex> locker(shard.mutex);
+        size += shard.files.size();
+    }
+    return size;
+}
+
+ResponseCache::Shard &ResponseCache::ShardOf(const std::string &key) {
+    return r_shards[std::hash<std::string>()(key) % SHARD_NUM];
+}
+
+CachedBlock ResponseCache::GetVariant(Entry &entry, const std::string &path, int code, bool isKeepAlive,
+                                      int keepAliveSec) {
+    // Date 头每秒变化, 过期的变体按需重建
+    // 同时重建的线程得到相同的内容, 后写入的覆盖先写入的即可
+    time_t now = NowSec();
+    if (!isKeepAlive) { keepAliveSec = 0; }
+    for (auto &slot: entry.variants) {
+        VariantPtr variant = std::atomic_load(&slot);
+        if (!variant) {
+            VariantPtr fresh = std::make_shared<const Variant>(
+                    Variant{code, isKeepAlive, keepAliveSec, now,
+                            Serialize(code, isKeepAlive, keepAliveSec, path, *entry.body)});
+            if (std::atomic_compare_exchange_strong(&slot, &variant, fresh)) {
+                return fresh->block;
+            }
+            // 槽位已被其他线程占用, variant 为占用者
+        }
+        if (variant->code == code && variant->isKeepAlive == isKeepAlive && variant->keepAliveSec == keepAliveSec) {
+            if (variant->dateSec == now) {
+                return variant->block;
+            }
+            VariantPtr fresh = std::make_shared<const Variant>(
+                    Variant{code, isKeepAlive, keepAliveSec, now,
+                            Serialize(code, isKeepAlive, keepAliveSec, path, *entry.body)});
+            std::atomic_store(&slot, fresh);
+            return fresh->block;
+        }
+    }
+    return Serialize(code, isKeepAlive, keepAliveSec, path, *entry.body);
+}
+
+CachedBlock ResponseCache::Serialize(int code, bool isKeepAlive, int keepAliveSec,
+                                     const std::string &path, const std::string &body) {
+    Buffer buff(static_cast<int>(body.size() + 256));
+    ResponseHeader::AppendStatusLine(buff, code);
+    ResponseHeader::AppendConnection(buff, isKeepAlive, keepAliveSec);
+    ResponseHeader::AppendContentType(buff, path);
+    ResponseHeader::AppendDate(buff);
+    ResponseHeader::AppendContentLength(buff, body.size());
+    buff.Append(body);
+    return std::make_shared<const std::string>(buff.Peek(), buff.ReadableBytes());
+}
+
+bool ResponseCache::ReadFile(const std::string &fileName, off_t size, std::string &body) {
+    int fd = open(fileName.data(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    body.resize(size);
+    off_t done = 0;
+    while (done < size) {
+        ssize_t len = pread(fd, &body[done], size - done, done);
+        if (len <= 0) {
+            close(fd);
+            return false;
+        }
+        done += len;
+    }
+    close(fd);
+    return true;
+}
+
+time_t ResponseCache::NowSec() {
+    struct timespec now = {0, 0};
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    return now.tv_sec;
+}
+
+std::string ResponseCache::ErrorBody(int code, const std::string &message) {
+    std::string body;
+    body += "<html><title>Error</title>";
+    body += "<body bgcolor=\"ffffff\">";
+    body += std::to_string(code) + " : " + std::string(ResponseHeader::StatusText(code)) + "\n";
+    body += "<p>" + message + "</p>";
+    body += "<hr><em>TryWebServer</em></body></html>";
+    return body;
+}
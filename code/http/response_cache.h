@@ -0,0 +1,93 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <atomic>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <sys/stat.h>
+
+#include "../buffer/buffer.h"
+#include "../log/log.h"
+#include "response_header.h"
+
+typedef std::shared_ptr<const std::string> CachedBlock;
+
+// 小文件完整响应缓存: 状态行 + 头部 + 文件内容存放在同一块不可变内存中
+// 连接只持有引用计数, 一次写出
+// 按路径分片加锁, 锁内只查找条目; 变体发布后不再修改, 过期时在锁外重建再原子替换
+class ResponseCache {
+public:
+    static ResponseCache *Instance();
+
+    void Init(size_t maxFileSize);
+
+    bool IsOpen() const { return r_maxFileSize.load(std::memory_order_relaxed) > 0; }
+
+    // 未命中且文件不适合缓存时返回空
+    CachedBlock GetFile(const std::string &srcDir, const std::string &path,
+                        const struct stat &st, int code, bool isKeepAlive, int keepAliveSec);
+
+    CachedBlock GetError(int code, const std::string &message, bool isKeepAlive, int keepAliveSec);
+
+    void Invalidate(const std::string &path);
+
+    void Clear();
+
+    size_t Size();
+
+    static std::string ErrorBody(int code, const std::string &message);
+
+private:
+    ResponseCache() = default;
+
+    struct Variant {
+        int code;
+        bool isKeepAlive;
+        int keepAliveSec;
+        time_t dateSec;
+        CachedBlock block;
+    };
+
+    typedef std::shared_ptr<const Variant> VariantPtr;
+
+    // 状态码, 长连接和空闲超时档位的组合有限, 槽位用完的变体不缓存
+    static constexpr size_t MAX_VARIANTS = 8;
+    static constexpr size_t SHARD_NUM = 16;
+
+    struct Entry {
+        CachedBlock body;
+        time_t mtime;
+        off_t size;
+        ino_t ino;
+        // 通过 std::atomic_load/atomic_store 读写, 不持锁
+        VariantPtr variants[MAX_VARIANTS];
+    };
+
+    typedef std::shared_ptr<Entry> EntryPtr;
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, EntryPtr> files;
+        std::unordered_map<std::string, EntryPtr> errors;
+    };
+
+    Shard &ShardOf(const std::string &key);
+
+    static CachedBlock Serialize(int code, bool isKeepAlive, int keepAliveSec,
+                                 const std::string &path, const std::string &body);
+
+    static bool ReadFile(const std::string &fileName, off_t size, std::string &body);
+
+    static time_t NowSec();
+
+    static CachedBlock GetVariant(Entry &entry, const std::string &path, int code, bool isKeepAlive,
+                                  int keepAliveSec);
+
+    std::atomic<size_t> r_maxFileSize{0};
+
+    Shard r_shards[SHARD_NUM];
+};
+
+#endif //RESPONSE_CACHE_H
@@ -0,0 +1,201 @@
+#include "response_header.h"
+
+#include <algorithm>
+
+namespace {
+    struct StatusEntry {
+        int code;
+        std::string_view text;
+        std::string_view line;
+    };
+
+    struct MimeEntry {
+        std::string_view suffix;
+        std::string_view type;
+        std::string_view line;
+    };
+
+    constexpr StatusEntry STATUS_TABLE[] = {
+            {101, "Switching Protocols", "HTTP/1.1 101 Switching Protocols\r\n"},
+            {200, "OK",          "HTTP/1.1 200 OK\r\n"},
+            {400, "Bad Request", "HTTP/1.1 400 Bad Request\r\n"},
+            {403, "Forbidden",   "HTTP/1.1 403 Forbidden\r\n"},
+            {404, "Not Found",   "HTTP/1.1 404 Not Found\r\n"},
+            {413, "Payload Too Large", "HTTP/1.1 413 Payload Too Large\r\n"},
+            {429, "Too Many Requests", "HTTP/1.1 429 Too Many Requests\r\n"},
+            {503, "Service Unavailable", "HTTP/1.1 503 Service Unavailable\r\n"},
+    };
+
+#define MIME_ENTRY(suffix, type) {suffix, type, "Content-type: " type "\r\n"}
+    constexpr MimeEntry MIME_TABLE[] = {
+            MIME_ENTRY(".html", "text/html"),
+            MIME_ENTRY(".xml", "text/xml"),
+            MIME_ENTRY(".xhtml", "application/xhtml+xml"),
+            MIME_ENTRY(".txt", "text/plain"),
+            MIME_ENTRY(".rtf", "application/rtf"),
+            MIME_ENTRY(".pdf", "application/pdf"),
+            MIME_ENTRY(".word", "application/msword"),
+            MIME_ENTRY(".png", "image/png"),
+            MIME_ENTRY(".gif", "image/gif"),
+            MIME_ENTRY(".jpg", "image/jpeg"),
+            MIME_ENTRY(".jpeg", "image/jpeg"),
+            MIME_ENTRY(".au", "audio/basic"),
+            MIME_ENTRY(".mpeg", "video/mpeg"),
+            MIME_ENTRY(".mpg", "video/mpeg"),
+            MIME_ENTRY(".avi", "video/x-msvideo"),
+            MIME_ENTRY(".mp4", "video/mp4"),
+            MIME_ENTRY(".gz", "application/x-gzip"),
+            MIME_ENTRY(".tar", "application/x-tar"),
+            MIME_ENTRY(".css", "text/css"),
+            MIME_ENTRY(".js", "text/javascript"),
+    };
+#undef MIME_ENTRY
+
+    constexpr MimeEntry DEFAULT_MIME = {"", "text/plain", "Content-type: text/plain\r\n"};
+
+    constexpr std::string_view KEEP_ALIVE_LINE = "Connection: keep-alive\r\n";
+    constexpr std::string_view KEEP_ALIVE_TIMEOUT = "Keep-Alive: timeout=";
+    constexpr std::string_view CLOSE_LINE = "Connection: close\r\n";
+
+    constexpr char WEEK_DAY[7][4] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+    constexpr char MONTH[12][4] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                   "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+    const StatusEntry *FindStatus(int code) {
+        for (const auto &entry: STATUS_TABLE) {
+            if (entry.code == code) { return &entry; }
+        }
+        return nullptr;
+    }
+
+    const MimeEntry &FindMime(std::string_view path) {
+        std::string_view::size_type idx = path.find_last_of('.');
+        if (idx == std::string_view::npos) {
+            return DEFAULT_MIME;
+        }
+        std::string_view suffix = path.substr(idx);
+        for (const auto &entry: MIME_TABLE) {
+            if (entry.suffix == suffix) { return entry; }
+        }
+        return DEFAULT_MIME;
+    }
+
+    void AppendView(Buffer &buff, std::string_view view) {
+        buff.Append(view.data(), view.size());
+    }
+
+    char *Write2Digits(char *dst, int value) {
+        dst[0] = static_cast<char>('0' + value / 10);
+        dst[1] = static_cast<char>('0' + value % 10);
+        return dst + 2;
+    }
+}
+
+bool ResponseHeader::HasStatus(int code) {
+    return FindStatus(code) != nullptr;
+}
+
+std::string_view ResponseHeader::StatusText(int code) {
+    const StatusEntry *entry = FindStatus(code);
+    return entry ? entry->text : FindStatus(400)->text;
+}
+
+void ResponseHeader::AppendStatusLine(Buffer &buff, int code) {
+    const StatusEntry *entry = FindStatus(code);
+    AppendView(buff, entry ? entry->line : FindStatus(400)->line);
+}
+
+void ResponseHeader::AppendConnection(Buffer &buff, bool isKeepAlive, int timeoutSec) {
+    if (!isKeepAlive) {
+        AppendView(buff, CLOSE_LINE);
+        return;
+    }
+    AppendView(buff, KEEP_ALIVE_LINE);
+    if (timeoutSec > 0) {
+        char line[48];
+        std::copy(KEEP_ALIVE_TIMEOUT.begin(), KEEP_ALIVE_TIMEOUT.end(), line);
+        size_t n = KEEP_ALIVE_TIMEOUT.size();
+        n += FormatUInt(line + n, timeoutSec);
+        line[n++] = '\r';
+        line[n++] = '\n';
+        buff.Append(line, n);
+    }
+}
+
+void ResponseHeader::AppendContentType(Buffer &buff, std::string_view path) {
+    AppendView(buff, FindMime(path).line);
+}
+
+std::string_view ResponseHeader::ContentType(std::string_view path) {
+    return FindMime(path).type;
+}
+
+void ResponseHeader::AppendField(Buffer &buff, std::string_view name, std::string_view value) {
+    AppendView(buff, name);
+    buff.Append(": ", 2);
+    AppendView(buff, value);
+    buff.Append("\r\n", 2);
+}
+
+void ResponseHeader::AppendDate(Buffer &buff) {
+    static thread_local DateCache cache;
+    struct timespec now = {0, 0};
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    if (now.tv_sec != cache.sec) {
+        RefreshDate(cache, now.tv_sec);
+    }
+    buff.Append(cache.line, cache.len);
+}
+
+void ResponseHeader::AppendContentLength(Buffer &buff, size_t len) {
+    static constexpr std::string_view prefix = "Content-length: ";
+    char line[64];
+    std::copy(prefix.begin(), prefix.end(), line);
+    size_t n = prefix.size();
+    n += FormatUInt(line + n, len);
+    line[n++] = '\r';
+    line[n++] = '\n';
+    line[n++] = '\r';
+    line[n++] = '\n';
+    buff.Append(line, n);
+}
+
+size_t ResponseHeader::FormatUInt(char *dst, size_t value) {
+    char tmp[24];
+    size_t n = 0;
+    do {
+        tmp[n++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value);
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = tmp[n - 1 - i];
+    }
+    return n;
+}
+
+void ResponseHeader::RefreshDate(DateCache &cache, time_t sec) {
+    // 格式: Date: Sun, 06 Nov 1994 08:49:37 GMT
+    struct tm t{};
+    gmtime_r(&sec, &t);
+    char *p = cache.line;
+    static constexpr std::string_view prefix = "Date: ";
+    p = std::copy(prefix.begin(), prefix.end(), p);
+    p = std::copy(WEEK_DAY[t.tm_wday], WEEK_DAY[t.tm_wday] + 3, p);
+    *p++ = ',';
+    *p++ = ' ';
+    p = Write2Digits(p, t.tm_mday);
+    *p++ = ' ';
+    p = std::copy(MONTH[t.tm_mon], MONTH[t.tm_mon] + 3, p);
+    *p++ = ' ';
+    p += FormatUInt(p, t.tm_year + 1900);
+    *p++ = ' ';
+    p = Write2Digits(p, t.tm_hour);
+    *p++ = ':';
+    p = Write2Digits(p, t.tm_min);
+    *p++ = ':';
+    p = Write2Digits(p, t.tm_sec);
+    static constexpr std::string_view suffix = " GMT\r\n";
+    p = std::copy(suffix.begin(), suffix.end(), p);
+    cache.len = p - cache.line;
+    cache.sec = sec;
+}
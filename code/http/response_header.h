@@ -0,0 +1,48 @@
+#ifndef RESPONSE_HEADER_H
+#define RESPONSE_HEADER_H
+
+#include <ctime>
+#include <string>
+#include <string_view>
+
+#include "../buffer/buffer.h"
+
+// 响应头构造: 状态行/Content-type 预先序列化为静态表, 写入时不产生堆分配
+class ResponseHeader {
+public:
+    // 未知状态码返回 false, 由调用方决定回退
+    static bool HasStatus(int code);
+
+    static std::string_view StatusText(int code);
+
+    static void AppendStatusLine(Buffer &buff, int code);
+
+    // timeoutSec > 0 时附带 Keep-Alive: timeout=N, 告知客户端服务端的空闲超时
+    static void AppendConnection(Buffer &buff, bool isKeepAlive, int timeoutSec = 0);
+
+    static void AppendContentType(Buffer &buff, std::string_view path);
+
+    static std::string_view ContentType(std::string_view path);
+
+    // 追加任意头部 "name: value\r\n"
+    static void AppendField(Buffer &buff, std::string_view name, std::string_view value);
+
+    // Date 头每秒刷新一次, 每个线程缓存一份
+    static void AppendDate(Buffer &buff);
+
+    // 写入 Content-length 并结束头部
+    static void AppendContentLength(Buffer &buff, size_t len);
+
+    static size_t FormatUInt(char *dst, size_t value);
+
+private:
+    struct DateCache {
+        time_t sec = -1;
+        size_t len = 0;
+        char line[48] = {0};
+    };
+
+    static void RefreshDate(DateCache &cache, time_t sec);
+};
+
+#endif //RESPONSE_HEADER_H
@@ -0,0 +1,237 @@
+#include "tls.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <algorithm>
+
+#include "../log/log.h"
+
+#ifdef TWS_WITH_TLS
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+namespace {
+    const char *LastError() {
+        static thread_local char buff[256];
+        ERR_error_string_n(ERR_get_error(), buff, sizeof(buff));
+        return buff;
+    }
+
+    // ALPN 协议列表, 按优先顺序
+    const unsigned char ALPN_H2[] = "\x02h2\x08http/1.1";
+    const unsigned char ALPN_HTTP1[] = "\x08http/1.1";
+
+    int SelectAlpn(SSL *, const unsigned char **out, unsigned char *outLen,
+                   const unsigned char *in, unsigned int inLen, void *arg) {
+        bool http2 = arg != nullptr;
+        const unsigned char *protos = http2 ? ALPN_H2 : ALPN_HTTP1;
+        unsigned int protosLen = http2 ? sizeof(ALPN_H2) - 1 : sizeof(ALPN_HTTP1) - 1;
+        unsigned char *selected = nullptr;
+        if (SSL_select_next_proto(&selected, outLen, protos, protosLen, in, inLen) != OPENSSL_NPN_NEGOTIATED) {
+            // 没有共同的协议时不回应 ALPN, 按 HTTP/1.1 处理
+            return SSL_TLSEXT_ERR_NOACK;
+        }
+        *out = selected;
+        return SSL_TLSEXT_ERR_OK;
+    }
+}
+
+TlsContext *TlsContext::Instance() {
+    static TlsContext context;
+    return &context;
+}
+
+TlsContext::~TlsContext() {
+    SSL_CTX_free(t_ctx);
+}
+
+bool TlsContext::Init(const std::string &certFile, const std::string &keyFile,
+                      int sessionCacheSize, int sessionTimeoutSec, bool ktls, bool http2) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) {
+        LOG_ERROR("TLS context error: %s", LastError())
+        return false;
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    if (SSL_CTX_use_certificate_chain_file(ctx, certFile.c_str()) != 1 ||
+        SSL_CTX_use_PrivateKey_file(ctx, keyFile.c_str(), SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ctx) != 1) {
+        LOG_ERROR("TLS load %s, %s error: %s", certFile.c_str(), keyFile.c_str(), LastError())
+        SSL_CTX_free(ctx);
+        return false;
+    }
+    // 非阻塞写: 允许部分写出, 重试时缓冲区地址可以变化; 空闲连接释放读写缓冲区
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                          SSL_MODE_RELEASE_BUFFERS);
+
+    // 会话恢复: TLS 1.2 使用服务端会话缓存, TLS 1.3 使用会话票据
+    static const unsigned char SESSION_ID_CONTEXT[] = "TryWebServer";
+    SSL_CTX_set_session_id_context(ctx, SESSION_ID_CONTEXT, sizeof(SESSION_ID_CONTEXT) - 1);
+    if (sessionCacheSize > 0) {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(ctx, sessionCacheSize);
+        SSL_CTX_set_timeout(ctx, std::max(sessionTimeoutSec, 1));
+    } else {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+    }
+
+    SSL_CTX_set_alpn_select_cb(ctx, SelectAlpn, http2 ? ctx : nullptr);
+
+    if (ktls) {
+#ifdef SSL_OP_ENABLE_KTLS
+        // 握手完成后 OpenSSL 通过 TCP_ULP "tls" 把密钥交给内核
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#else
+        LOG_WARN("OpenSSL built without kTLS, encrypt in user space")
+#endif
+    }
+    SSL_CTX_free(t_ctx);
+    t_ctx = ctx;
+    return true;
+}
+
+ssl_st *TlsContext::NewSession(int fd) {
+    SSL *ssl = SSL_new(t_ctx);
+    if (!ssl) {
+        return nullptr;
+    }
+    if (SSL_set_fd(ssl, fd) != 1) {
+        SSL_free(ssl);
+        return nullptr;
+    }
+    SSL_set_accept_state(ssl);
+    return ssl;
+}
+
+TlsContext::Result TlsContext::Handshake(ssl_st *ssl) {
+    ERR_clear_error();
+    int ret = SSL_do_handshake(ssl);
+    if (ret == 1) {
+        return TLS_DONE;
+    }
+    switch (SSL_get_error(ssl, ret)) {
+        case SSL_ERROR_WANT_READ:
+            return TLS_WANT_READ;
+        case SSL_ERROR_WANT_WRITE:
+            return TLS_WANT_WRITE;
+        default:
+            LOG_DEBUG("TLS handshake error: %s", LastError())
+            return TLS_ERROR;
+    }
+}
+
+bool TlsContext::IsResumed(ssl_st *ssl) {
+    return SSL_session_reused(ssl) == 1;
+}
+
+bool TlsContext::IsKtlsSend(ssl_st *ssl) {
+#ifdef BIO_get_ktls_send
+    return BIO_get_ktls_send(SSL_get_wbio(ssl)) == 1;
+#else
+    return false;
+#endif
+}
+
+bool TlsContext::IsAlpnH2(ssl_st *ssl) {
+    const unsigned char *proto = nullptr;
+    unsigned int len = 0;
+    SSL_get0_alpn_selected(ssl, &proto, &len);
+    return len == 2 && memcmp(proto, "h2", 2) == 0;
+}
+
+ssize_t TlsContext::Read(ssl_st *ssl, void *buff, size_t len, int *saveErrno) {
+    ERR_clear_error();
+    errno = 0;
+    int ret = SSL_read(ssl, buff, static_cast<int>(std::min(len, static_cast<size_t>(INT_MAX))));
+    if (ret > 0) {
+        return ret;
+    }
+    switch (SSL_get_error(ssl, ret)) {
+        case SSL_ERROR_WANT_READ:
+        case SSL_ERROR_WANT_WRITE:
+            *saveErrno = EAGAIN;
+            return -1;
+        case SSL_ERROR_ZERO_RETURN:
+            return 0;
+        case SSL_ERROR_SYSCALL:
+            // 未发送 close_notify 直接断开
+            if (errno == 0) { return 0; }
+            *saveErrno = errno;
+            return -1;
+        default:
+            *saveErrno = EIO;
+            return -1;
+    }
+}
+
+ssize_t TlsContext::Writev(ssl_st *ssl, const struct iovec *iov, int iovCnt, int *saveErrno) {
+    // 每段单独加密成记录, 只写出部分时返回已写出的字节数
+    ssize_t total = 0;
+    for (int i = 0; i < iovCnt; ++i) {
+        if (iov[i].iov_len == 0) { continue; }
+        ERR_clear_error();
+        int len = static_cast<int>(std::min(iov[i].iov_len, static_cast<size_t>(INT_MAX)));
+        int ret = SSL_write(ssl, iov[i].iov_base, len);
+        if (ret <= 0) {
+            int err = SSL_get_error(ssl, ret);
+            *saveErrno = err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ ? EAGAIN : EIO;
+            errno = *saveErrno;
+            return total > 0 ? total : -1;
+        }
+        total += ret;
+        if (ret < len) { break; }
+    }
+    return total;
+}
+
+void TlsContext::Free(ssl_st *ssl) {
+    if (!ssl) {
+        return;
+    }
+    if (SSL_is_init_finished(ssl)) {
+        ERR_clear_error();
+        SSL_shutdown(ssl);
+    }
+    SSL_free(ssl);
+}
+
+#else
+
+TlsContext *TlsContext::Instance() {
+    static TlsContext context;
+    return &context;
+}
+
+TlsContext::~TlsContext() = default;
+
+bool TlsContext::Init(const std::string &, const std::string &, int, int, bool, bool) {
+    LOG_ERROR("TLS listener requires building with TWS_WITH_TLS")
+    return false;
+}
+
+ssl_st *TlsContext::NewSession(int) { return nullptr; }
+
+TlsContext::Result TlsContext::Handshake(ssl_st *) { return TLS_ERROR; }
+
+bool TlsContext::IsResumed(ssl_st *) { return false; }
+
+bool TlsContext::IsKtlsSend(ssl_st *) { return false; }
+
+bool TlsContext::IsAlpnH2(ssl_st *) { return false; }
+
+ssize_t TlsContext::Read(ssl_st *, void *, size_t, int *saveErrno) {
+    *saveErrno = EIO;
+    return -1;
+}
+
+ssize_t TlsContext::Writev(ssl_st *, const struct iovec *, int, int *saveErrno) {
+    *saveErrno = EIO;
+    return -1;
+}
+
+void TlsContext::Free(ssl_st *) {}
+
+#endif
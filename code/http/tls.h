@@ -0,0 +1,62 @@
+#ifndef TLS_H
+#define TLS_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <string>
+
+// TLS 终止: 握手和会话恢复由 OpenSSL 在用户态完成, 之后把会话密钥交给内核 (kTLS)
+// 内核接管发送后仍直接对 fd writev, 响应体走原来的 mmap 零拷贝路径
+// 接收始终经过 SSL_read, 内核接管接收时由 OpenSSL 处理其中的控制消息
+// 内核或 OpenSSL 不支持 kTLS 时发送退回 SSL_write
+// 未以 TWS_WITH_TLS 编译时 Init 失败, 其余函数不会被调用
+
+struct ssl_st;
+struct ssl_ctx_st;
+
+class TlsContext {
+public:
+    enum Result {
+        TLS_DONE,
+        TLS_WANT_READ,
+        TLS_WANT_WRITE,
+        TLS_ERROR,
+    };
+
+    static TlsContext *Instance();
+
+    // sessionCacheSize 为服务端会话缓存条数, TLS 1.3 另外使用无状态的会话票据
+    // http2 为 true 时通过 ALPN 优先选择 h2
+    bool Init(const std::string &certFile, const std::string &keyFile,
+              int sessionCacheSize, int sessionTimeoutSec, bool ktls, bool http2);
+
+    bool IsOpen() const { return t_ctx != nullptr; }
+
+    ssl_st *NewSession(int fd);
+
+    static Result Handshake(ssl_st *ssl);
+
+    static bool IsResumed(ssl_st *ssl);
+
+    // 握手完成后内核是否接管了发送方向的加密
+    static bool IsKtlsSend(ssl_st *ssl);
+
+    static bool IsAlpnH2(ssl_st *ssl);
+
+    // 与 read/writev 相同的约定: 无数据可读写时返回 -1 且 saveErrno 为 EAGAIN, 对端关闭返回 0
+    static ssize_t Read(ssl_st *ssl, void *buff, size_t len, int *saveErrno);
+
+    static ssize_t Writev(ssl_st *ssl, const struct iovec *iov, int iovCnt, int *saveErrno);
+
+    // 尽量发送 close_notify 后释放
+    static void Free(ssl_st *ssl);
+
+private:
+    TlsContext() = default;
+
+    ~TlsContext();
+
+    ssl_ctx_st *t_ctx = nullptr;
+};
+
+#endif //TLS_H
@@ -0,0 +1,472 @@
+#include "websocket.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+std::function<void(int, bool)> WebSocket::arm;
+size_t WebSocket::maxMessageSize = 65536;
+size_t WebSocket::maxQueueBytes = 4 << 20;
+
+namespace {
+    const char GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    // 客户端帧的掩码键
+    const size_t MASK_LEN = 4;
+
+    uint32_t Rotl(uint32_t x, int n) {
+        return x << n | x >> (32 - n);
+    }
+
+    // 只用于握手, 不需要很快
+    void Sha1(std::string_view data, uint8_t digest[20]) {
+        uint32_t h[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+        std::string msg(data);
+        uint64_t bitLen = static_cast<uint64_t>(data.size()) * 8;
+        msg.push_back(static_cast<char>(0x80));
+        while (msg.size() % 64 != 56) { msg.push_back('\0'); }
+        for (int i = 7; i >= 0; --i) { msg.push_back(static_cast<char>(bitLen >> (i * 8))); }
+        auto *p = reinterpret_cast<const uint8_t *>(msg.data());
+        for (size_t chunk = 0; chunk < msg.size(); chunk += 64) {
+            uint32_t w[80];
+            for (int i = 0; i < 16; ++i) {
+                const uint8_t *q = p + chunk + i * 4;
+                w[i] = static_cast<uint32_t>(q[0]) << 24 | static_cast<uint32_t>(q[1]) << 16 |
+                       static_cast<uint32_t>(q[2]) << 8 | q[3];
+            }
+            for (int i = 16; i < 80; ++i) { w[i] = Rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1); }
+            uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+            for (int i = 0; i < 80; ++i) {
+                uint32_t f, k;
+                if (i < 20) {
+                    f = (b & c) | (~b & d);
+                    k = 0x5a827999;
+                } else if (i < 40) {
+                    f = b ^ c ^ d;
+                    k = 0x6ed9eba1;
+                } else if (i < 60) {
+                    f = (b & c) | (b & d) | (c & d);
+                    k = 0x8f1bbcdc;
+                } else {
+                    f = b ^ c ^ d;
+                    k = 0xca62c1d6;
+                }
+                uint32_t t = Rotl(a, 5) + f + e + k + w[i];
+                e = d;
+                d = c;
+                c = Rotl(b, 30);
+                b = a;
+                a = t;
+            }
+            h[0] += a;
+            h[1] += b;
+            h[2] += c;
+            h[3] += d;
+            h[4] += e;
+        }
+        for (int i = 0; i < 5; ++i) {
+            digest[i * 4] = static_cast<uint8_t>(h[i] >> 24);
+            digest[i * 4 + 1] = static_cast<uint8_t>(h[i] >> 16);
+            digest[i * 4 + 2] = static_cast<uint8_t>(h[i] >> 8);
+            digest[i * 4 + 3] = static_cast<uint8_t>(h[i]);
+        }
+    }
+
+    std::string Base64(const uint8_t *data, size_t len) {
+        static const char TABLE[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string out;
+        for (size_t i = 0; i < len; i += 3) {
+            uint32_t v = static_cast<uint32_t>(data[i]) << 16 | (i + 1 < len ? data[i + 1] << 8 : 0) |
+                         (i + 2 < len ? data[i + 2] : 0);
+            out.push_back(TABLE[v >> 18 & 63]);
+            out.push_back(TABLE[v >> 12 & 63]);
+            out.push_back(i + 1 < len ? TABLE[v >> 6 & 63] : '=');
+            out.push_back(i + 2 < len ? TABLE[v & 63] : '=');
+        }
+        return out;
+    }
+
+    // mask 为内存中按顺序排列的 4 字节掩码键, 各实现每次处理的宽度都是 4 的倍数, 尾部交给标量实现
+    void UnmaskScalar(char *dst, const char *src, size_t len, uint32_t mask) {
+        uint64_t mask64 = static_cast<uint64_t>(mask) << 32 | mask;
+        size_t i = 0;
+        for (; i + 8 <= len; i += 8) {
+            uint64_t v;
+            memcpy(&v, src + i, 8);
+            v ^= mask64;
+            memcpy(dst + i, &v, 8);
+        }
+        auto *key = reinterpret_cast<const uint8_t *>(&mask);
+        for (; i < len; ++i) {
+            dst[i] = static_cast<char>(src[i] ^ key[i & 3]);
+        }
+    }
+
+#ifdef __SSE2__
+    void UnmaskSse2(char *dst, const char *src, size_t len, uint32_t mask) {
+        __m128i m = _mm_set1_epi32(static_cast<int>(mask));
+        size_t i = 0;
+        for (; i + 16 <= len; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_xor_si128(v, m));
+        }
+        UnmaskScalar(dst + i, src + i, len - i, mask);
+    }
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+    // 不要求编译时开启 -mavx2, 运行时检测到 CPU 支持才使用
+    __attribute__((target("avx2")))
+    void UnmaskAvx2(char *dst, const char *src, size_t len, uint32_t mask) {
+        __m256i m = _mm256_set1_epi32(static_cast<int>(mask));
+        size_t i = 0;
+        for (; i + 64 <= len; i += 64) {
+            __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+            __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 32));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_xor_si256(v0, m));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i + 32), _mm256_xor_si256(v1, m));
+        }
+        for (; i + 32 <= len; i += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_xor_si256(v, m));
+        }
+        UnmaskScalar(dst + i, src + i, len - i, mask);
+    }
+#endif
+
+    typedef void (*UnmaskFunc)(char *, const char *, size_t, uint32_t);
+
+    UnmaskFunc ChooseUnmask() {
+#if defined(__GNUC__) && defined(__x86_64__)
+        if (__builtin_cpu_supports("avx2")) { return UnmaskAvx2; }
+#endif
+#ifdef __SSE2__
+        return UnmaskSse2;
+#else
+        return UnmaskScalar;
+#endif
+    }
+}
+
+WebSocket::WebSocket(int fd) {
+    w_fd = fd;
+    w_queuedBytes = 0;
+    w_isBusy = true;
+    w_isWoken = false;
+    w_isClosing = false;
+    w_isCloseSent = false;
+    w_isShutdown = false;
+    w_messageOpcode = WS_TEXT;
+    w_isFragmented = false;
+    w_recvNs = Metrics::NowNs();
+    w_pingNs = 0;
+}
+
+std::string WebSocket::AcceptKey(std::string_view key) {
+    std::string text(key);
+    text += GUID;
+    uint8_t digest[20];
+    Sha1(text, digest);
+    return Base64(digest, sizeof(digest));
+}
+
+WebSocket::Frame WebSocket::MakeFrame(Opcode opcode, std::string_view payload) {
+    auto frame = std::make_shared<std::string>();
+    size_t len = payload.size();
+    frame->reserve(len + 10);
+    frame->push_back(static_cast<char>(0x80 | opcode));
+    if (len < 126) {
+        frame->push_back(static_cast<char>(len));
+    } else if (len <= 0xffff) {
+        frame->push_back(126);
+        frame->push_back(static_cast<char>(len >> 8));
+        frame->push_back(static_cast<char>(len));
+    } else {
+        frame->push_back(127);
+        for (int i = 7; i >= 0; --i) { frame->push_back(static_cast<char>(static_cast<uint64_t>(len) >> (i * 8))); }
+    }
+    frame->append(payload.data(), len);
+    return frame;
+}
+
+bool WebSocket::Feed(Buffer &in) {
+    {
+        std::lock_guard<std::mutex> locker(w_mutex);
+        if (w_isClosing) {
+            in.RetrieveAll();
+            return false;
+        }
+    }
+    while (in.ReadableBytes() >= 2) {
+        auto *p = reinterpret_cast<const uint8_t *>(in.Peek());
+        size_t readable = in.ReadableBytes();
+        bool isFin = p[0] & 0x80;
+        auto opcode = static_cast<Opcode>(p[0] & 0x0f);
+        if ((p[0] & 0x70) || !(p[1] & 0x80)) {
+            // 没有协商扩展, RSV 必须为 0; 客户端发来的帧必须加掩码
+            return Fail(in, WS_PROTOCOL_ERROR);
+        }
+        size_t headLen = 2;
+        uint64_t len = p[1] & 0x7f;
+        if (len == 126) {
+            if (readable < 4) { break; }
+            len = static_cast<uint64_t>(p[2]) << 8 | p[3];
+            headLen = 4;
+        } else if (len == 127) {
+            if (readable < 10) { break; }
+            len = 0;
+            for (int i = 2; i < 10; ++i) { len = len << 8 | p[i]; }
+            headLen = 10;
+        }
+        bool isControl = opcode & 0x8;
+        if (isControl) {
+            if (!isFin || len > 125 || (opcode != WS_CLOSE && opcode != WS_PING && opcode != WS_PONG)) {
+                return Fail(in, WS_PROTOCOL_ERROR);
+            }
+        } else {
+            if (opcode > WS_BINARY || (opcode == WS_CONTINUATION) != w_isFragmented) {
+                return Fail(in, WS_PROTOCOL_ERROR);
+            }
+            // 帧头到达时就检查, 不等整帧收齐
+            if (len > maxMessageSize - w_message.size()) {
+                return Fail(in, WS_TOO_BIG);
+            }
+        }
+        if (readable < headLen + MASK_LEN + len) {
+            break;
+        }
+        const uint8_t *key = p + headLen;
+        const char *payload = reinterpret_cast<const char *>(p + headLen + MASK_LEN);
+        w_recvNs.store(Metrics::NowNs(), std::memory_order_relaxed);
+        if (isControl) {
+            std::string data(len, '\0');
+            Unmask(&data[0], payload, len, key);
+            in.Retrieve(headLen + MASK_LEN + len);
+            if (opcode == WS_PING) {
+                Push(MakeFrame(WS_PONG, data));
+            } else if (opcode == WS_CLOSE) {
+                if (len == 1) { return Fail(in, WS_PROTOCOL_ERROR); }
+                // 回应对端的关闭, 带回它的状态码
+                uint16_t code = WS_NORMAL;
+                if (len >= 2) {
+                    code = static_cast<uint16_t>(static_cast<uint8_t>(data[0]) << 8 | static_cast<uint8_t>(data[1]));
+                }
+                Close(code);
+                in.RetrieveAll();
+                return false;
+            }
+            continue;
+        }
+        size_t offset = w_message.size();
+        w_message.resize(offset + len);
+        Unmask(&w_message[offset], payload, len, key);
+        in.Retrieve(headLen + MASK_LEN + len);
+        if (opcode != WS_CONTINUATION) {
+            w_messageOpcode = opcode;
+        }
+        w_isFragmented = !isFin;
+        if (isFin) {
+            if (w_messageOpcode == WS_TEXT && !IsValidUtf8(w_message)) {
+                return Fail(in, WS_INVALID_DATA);
+            }
+            w_ready.emplace_back(w_messageOpcode, std::move(w_message));
+            w_message.clear();
+        }
+    }
+    return true;
+}
+
+bool WebSocket::Fail(Buffer &in, uint16_t code) {
+    LOG_DEBUG("WebSocket[%d] protocol error, close: %d", w_fd, (int) code)
+    Close(code);
+    in.RetrieveAll();
+    return false;
+}
+
+bool WebSocket::PopMessage(Opcode *opcode, std::string &payload) {
+    if (w_ready.empty()) {
+        return false;
+    }
+    *opcode = w_ready.front().first;
+    payload = std::move(w_ready.front().second);
+    w_ready.pop_front();
+    return true;
+}
+
+bool WebSocket::Push(const Frame &frame) {
+    std::lock_guard<std::mutex> locker(w_mutex);
+    if (w_isClosing || w_isShutdown) {
+        return false;
+    }
+    if (w_queuedBytes + frame->size() > maxQueueBytes) {
+        // 跟不上广播的客户端: 丢掉积压的帧, 只发送关闭帧
+        LOG_WARN("WebSocket[%d] send queue overflow, %d bytes", w_fd, (int) w_queuedBytes)
+        Metrics::Add(WS_OVERFLOW);
+        w_queue.clear();
+        w_queuedBytes = 0;
+        w_isClosing = true;
+        const char payload[2] = {static_cast<char>(WS_POLICY_VIOLATION >> 8), static_cast<char>(WS_POLICY_VIOLATION)};
+        Enqueue(MakeFrame(WS_CLOSE, std::string_view(payload, sizeof(payload))));
+        return false;
+    }
+    Enqueue(frame);
+    return true;
+}
+
+void WebSocket::Close(uint16_t code) {
+    const char payload[2] = {static_cast<char>(code >> 8), static_cast<char>(code)};
+    Frame frame = MakeFrame(WS_CLOSE, std::string_view(payload, sizeof(payload)));
+    std::lock_guard<std::mutex> locker(w_mutex);
+    if (w_isClosing || w_isShutdown) {
+        return;
+    }
+    w_isClosing = true;
+    Enqueue(frame);
+}
+
+void WebSocket::Ping() {
+    w_pingNs.store(Metrics::NowNs(), std::memory_order_relaxed);
+    Push(MakeFrame(WS_PING, ""));
+}
+
+void WebSocket::Enqueue(const Frame &frame) {
+    w_queue.push_back(frame);
+    w_queuedBytes += frame->size();
+    if (!w_isBusy && !w_isWoken && !w_isShutdown) {
+        // 空闲的连接只注册了读事件, 改为写事件; 之后的帧等派发时一起处理
+        w_isWoken = true;
+        arm(w_fd, true);
+    }
+}
+
+const WebSocket::Frame *WebSocket::Next() {
+    std::lock_guard<std::mutex> locker(w_mutex);
+    w_sending.reset();
+    if (w_queue.empty()) {
+        return nullptr;
+    }
+    w_sending = std::move(w_queue.front());
+    w_queue.pop_front();
+    w_queuedBytes -= w_sending->size();
+    // 开始关闭后不再入队, 关闭帧总是最后一个
+    w_isCloseSent = w_isClosing && w_queue.empty();
+    return &w_sending;
+}
+
+bool WebSocket::Acquire() {
+    std::lock_guard<std::mutex> locker(w_mutex);
+    if (w_isBusy || w_isShutdown) {
+        return false;
+    }
+    w_isBusy = true;
+    w_isWoken = false;
+    return true;
+}
+
+void WebSocket::Release(bool isWrite) {
+    std::lock_guard<std::mutex> locker(w_mutex);
+    w_isBusy = false;
+    if (w_isShutdown) {
+        return;
+    }
+    w_isWoken = isWrite || !w_queue.empty();
+    arm(w_fd, w_isWoken);
+}
+
+void WebSocket::Shutdown() {
+    std::lock_guard<std::mutex> locker(w_mutex);
+    w_isShutdown = true;
+    w_queue.clear();
+    w_queuedBytes = 0;
+}
+
+void WebSocket::Unmask(char *dst, const char *src, size_t len, const uint8_t key[4]) {
+    static const UnmaskFunc func = ChooseUnmask();
+    uint32_t mask;
+    memcpy(&mask, key, sizeof(mask));
+    func(dst, src, len, mask);
+}
+
+bool WebSocket::IsValidUtf8(std::string_view str) {
+    static const uint32_t MIN_CODE[4] = {0, 0x80, 0x800, 0x10000};
+    auto *p = reinterpret_cast<const uint8_t *>(str.data());
+    const uint8_t *end = p + str.size();
+    while (p < end) {
+        uint64_t word;
+        if (end - p >= 8 && (memcpy(&word, p, 8), (word & 0x8080808080808080ULL) == 0)) {
+            // 连续的 ASCII
+            p += 8;
+            continue;
+        }
+        if (*p < 0x80) {
+            ++p;
+            continue;
+        }
+        size_t n;
+        uint32_t code;
+        if ((*p & 0xe0) == 0xc0) {
+            n = 1;
+            code = *p & 0x1f;
+        } else if ((*p & 0xf0) == 0xe0) {
+            n = 2;
+            code = *p & 0x0f;
+        } else if ((*p & 0xf8) == 0xf0) {
+            n = 3;
+            code = *p & 0x07;
+        } else {
+            return false;
+        }
+        if (static_cast<size_t>(end - p) <= n) {
+            return false;
+        }
+        for (size_t i = 1; i <= n; ++i) {
+            if ((p[i] & 0xc0) != 0x80) { return false; }
+            code = code << 6 | (p[i] & 0x3f);
+        }
+        // 过长编码, 代理区和超出 Unicode 范围的码点
+        if (code < MIN_CODE[n] || (code >= 0xd800 && code <= 0xdfff) || code > 0x10ffff) {
+            return false;
+        }
+        p += n + 1;
+    }
+    return true;
+}
+
+WebSocketHub *WebSocketHub::Instance() {
+    static WebSocketHub hub;
+    return &hub;
+}
+
+void WebSocketHub::Add(WebSocket *ws) {
+    std::lock_guard<std::mutex> locker(w_mutex);
+    w_sockets.insert(ws);
+}
+
+void WebSocketHub::Remove(WebSocket *ws) {
+    std::lock_guard<std::mutex> locker(w_mutex);
+    w_sockets.erase(ws);
+}
+
+size_t WebSocketHub::Broadcast(WebSocket::Opcode opcode, std::string_view payload) {
+    // 在锁外序列化, 每个连接只增加一次引用计数
+    WebSocket::Frame frame = WebSocket::MakeFrame(opcode, payload);
+    std::lock_guard<std::mutex> locker(w_mutex);
+    size_t cnt = 0;
+    for (WebSocket *ws: w_sockets) {
+        if (ws->Push(frame)) { ++cnt; }
+    }
+    return cnt;
+}
+
+void WebSocketHub::CloseAll(WebSocket::CloseCode code) {
+    std::lock_guard<std::mutex> locker(w_mutex);
+    for (WebSocket *ws: w_sockets) {
+        ws->Close(code);
+    }
+}
+
+size_t WebSocketHub::Size() {
+    std::lock_guard<std::mutex> locker(w_mutex);
+    return w_sockets.size();
+}
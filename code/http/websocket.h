@@ -0,0 +1,157 @@
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+
+#include "../buffer/buffer.h"
+#include "../log/log.h"
+#include "../metrics/metrics.h"
+
+// WebSocket 连接 (RFC 6455): 握手之后在同一个连接上收发帧
+// 发送的帧只序列化一次, 由 shared_ptr 在各连接的发送队列之间共享, 写入时直接作为 iovec 引用
+// 连接空闲时其他线程加入的帧通过 arm 注册写事件, 与 EPOLLONESHOT 下正在处理的线程由 w_isBusy 互斥
+class WebSocket {
+public:
+    enum Opcode {
+        WS_CONTINUATION = 0x0,
+        WS_TEXT = 0x1,
+        WS_BINARY = 0x2,
+        WS_CLOSE = 0x8,
+        WS_PING = 0x9,
+        WS_PONG = 0xa,
+    };
+
+    enum CloseCode {
+        WS_NORMAL = 1000,
+        WS_GOING_AWAY = 1001,
+        WS_PROTOCOL_ERROR = 1002,
+        WS_INVALID_DATA = 1007,
+        WS_POLICY_VIOLATION = 1008,
+        WS_TOO_BIG = 1009,
+    };
+
+    typedef std::shared_ptr<const std::string> Frame;
+
+    // 在处理握手请求的线程中创建, 此时连接处于处理中
+    explicit WebSocket(int fd);
+
+    // Sec-WebSocket-Accept: base64(SHA-1(key + GUID))
+    static std::string AcceptKey(std::string_view key);
+
+    // 服务端发出的帧不加掩码, 不分片
+    static Frame MakeFrame(Opcode opcode, std::string_view payload);
+
+    // 消费 in 中完整的帧, Ping 和 Close 的应答进入发送队列
+    // 协议错误或已开始关闭时丢弃输入并返回 false
+    bool Feed(Buffer &in);
+
+    // 取出一条收齐的文本或二进制消息
+    bool PopMessage(Opcode *opcode, std::string &payload);
+
+    // 加入发送队列, 连接空闲时注册写事件; 已开始关闭, 已断开或队列超过上限时返回 false
+    bool Push(const Frame &frame);
+
+    // 发送关闭帧, 之后不再接受新的帧; code 可以是对端发来的任意状态码
+    void Close(uint16_t code);
+
+    void Ping();
+
+    // 上一帧已写完, 取出下一个待发送的帧, 返回的帧在下次调用之前有效
+    const Frame *Next();
+
+    // 关闭帧已交给写入, 写完后关闭连接
+    bool IsDone() const { return w_isCloseSent; }
+
+    // 事件循环派发读写事件之前调用; 已有线程在处理时返回 false, 本次事件由处理中的线程负责
+    bool Acquire();
+
+    // 处理结束时重新注册事件, 期间加入了帧则注册写事件
+    void Release(bool isWrite);
+
+    // 连接关闭, 之后不再注册事件
+    void Shutdown();
+
+    // 最近一次收到帧或发出 Ping 的时间
+    uint64_t LastActiveNs() const {
+        return std::max(w_recvNs.load(std::memory_order_relaxed), w_pingNs.load(std::memory_order_relaxed));
+    }
+
+    // 发出的 Ping 之后还没有收到任何帧
+    bool IsPinging() const {
+        return w_pingNs.load(std::memory_order_relaxed) > w_recvNs.load(std::memory_order_relaxed);
+    }
+
+    // dst 可以与 src 相同; 按 CPU 支持选择 AVX2/SSE2 或标量实现
+    static void Unmask(char *dst, const char *src, size_t len, const uint8_t key[4]);
+
+    // 注册连接的读或写事件, 由 WebServer 设置
+    static std::function<void(int fd, bool isWrite)> arm;
+    // 单条消息 (含所有分片) 的上限
+    static size_t maxMessageSize;
+    // 待发送帧的字节数上限, 超过时视为跟不上广播的慢客户端
+    static size_t maxQueueBytes;
+
+private:
+    // 持锁调用
+    void Enqueue(const Frame &frame);
+
+    // 协议错误: 丢弃输入, 发送关闭帧
+    bool Fail(Buffer &in, uint16_t code);
+
+    static bool IsValidUtf8(std::string_view str);
+
+    int w_fd;
+    std::mutex w_mutex;
+    std::deque<Frame> w_queue;
+    size_t w_queuedBytes;
+    // 正在写入的帧
+    Frame w_sending;
+    bool w_isBusy;
+    // 已为空闲的连接注册了写事件, 等待派发
+    bool w_isWoken;
+    bool w_isClosing;
+    bool w_isCloseSent;
+    bool w_isShutdown;
+    // 未收齐的分片消息
+    std::string w_message;
+    Opcode w_messageOpcode;
+    bool w_isFragmented;
+    std::deque<std::pair<Opcode, std::string>> w_ready;
+    std::atomic<uint64_t> w_recvNs;
+    std::atomic<uint64_t> w_pingNs;
+};
+
+// 所有 WebSocket 连接, 广播时一次序列化, 分发给每个连接
+class WebSocketHub {
+public:
+    static WebSocketHub *Instance();
+
+    void Add(WebSocket *ws);
+
+    void Remove(WebSocket *ws);
+
+    // 服务端推送的入口, 返回加入了发送队列的连接数
+    size_t Broadcast(WebSocket::Opcode opcode, std::string_view payload);
+
+    void CloseAll(WebSocket::CloseCode code);
+
+    size_t Size();
+
+private:
+    WebSocketHub() = default;
+
+    std::mutex w_mutex;
+    std::unordered_set<WebSocket *> w_sockets;
+};
+
+#endif //WEBSOCKET_H
@@ -126,6 +126,12 @@ void Log::Write(int level, const char *format, ...) {
         int m = vsnprintf(l_buff.BeginWrite(), l_buff.WritableBytes(), format, vaList);
         va_end(vaList);
 
+        // 返回值是完整内容的长度, 超出缓冲区的部分已被截断
+        if (m < 0) {
+            m = 0;
+        } else if (static_cast<size_t>(m) >= l_buff.WritableBytes()) {
+            m = static_cast<int>(l_buff.WritableBytes()) - 1;
+        }
         l_buff.HasWritten(m);
         l_buff.Append("\n\0", 2);
 
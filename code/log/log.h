@@ -33,6 +33,9 @@ public:
 
     bool IsOpen() const { return l_isOpen; }
 
+    // 异步写线程, 同步模式下为空
+    std::thread *GetWriteThread() { return l_writeThread.get(); }
+
 private:
     Log();
 
@@ -1,15 +1,16 @@
+#include <cstdio>
+
 #include "server/web_server.h"
 #include "config/config.h"
 
 int main() {
-    Config config;
+    std::string err;
+    std::shared_ptr<const Config> config = Config::Load(Config::PATH, &err);
+    if (!config) {
+        fprintf(stderr, "Config error: %s\n", err.c_str());
+        return 1;
+    }
 
-    WebServer server(
-            config.port, config.trigMode, config.timeoutMs, config.optLinger,   // 端口 ET模式 timeoutMs 优雅退出
-            config.sqlPort, config.sqlUser.c_str(),                               // Mysql配置
-            config.sqlPwd.c_str(), config.dbName.c_str(),
-            config.connPoolNum, config.threadNum,                               // 连接池数量 线程池数量
-            config.openLog, config.logLevel, config.logQueSize);                // 日志开关 日志等级 日志异步队列容量
+    WebServer server(config);
     server.Start();
-} 
-  
\ No newline at end of file
+}
@@ -0,0 +1,175 @@
+#include "metrics.h"
+
+namespace {
+    const char *COUNTER_NAME[COUNTER_NUM] = {
+            "tws_requests_total{class=\"2xx\"}",
+            "tws_requests_total{class=\"4xx\"}",
+            "tws_requests_total{class=\"5xx\"}",
+            "tws_requests_total{class=\"other\"}",
+            "tws_bytes_sent_total",
+            "tws_connections_accepted_total",
+            "tws_connections_rejected_total",
+            "tws_admission_rejected_total",
+            "tws_admission_deadline_dropped_total",
+            "tws_db_lane_rejected_total",
+            "tws_pool_resize_total{dir=\"grow\"}",
+            "tws_pool_resize_total{dir=\"shrink\"}",
+            "tws_numa_tasks_total{node=\"local\"}",
+            "tws_numa_tasks_total{node=\"remote\"}",
+            "tws_connections_evicted_total",
+            "tws_slow_clients_closed_total{phase=\"header\"}",
+            "tws_slow_clients_closed_total{phase=\"body\"}",
+            "tws_slow_clients_closed_total{phase=\"send\"}",
+            "tws_client_limit_rejected_total{reason=\"conns\"}",
+            "tws_client_limit_rejected_total{reason=\"rate\"}",
+            "tws_tls_handshakes_total{resumed=\"false\"}",
+            "tws_tls_handshakes_total{resumed=\"true\"}",
+            "tws_tls_ktls_connections_total",
+            "tws_tls_handshake_failed_total",
+            "tws_http2_connections_total",
+            "tws_http2_streams_total",
+            "tws_websocket_connections_total",
+            "tws_websocket_messages_total",
+            "tws_websocket_overflow_total",
+    };
+
+    const char *HIST_NAME[HIST_NUM] = {
+            "tws_parse_seconds",
+            "tws_queue_wait_seconds",
+            "tws_db_wait_seconds",
+            "tws_db_query_seconds",
+            "tws_loop_iteration_seconds",
+    };
+
+    const char *GAUGE_NAME[GAUGE_NUM] = {
+            "tws_timer_heap_size",
+    };
+
+    uint64_t BucketUpper(int idx) {
+        const int sub = 1 << Metrics::SUB_BITS;
+        if (idx < sub) {
+            return idx + 1;
+        }
+        int shift = (idx >> Metrics::SUB_BITS) - 1;
+        return static_cast<uint64_t>(sub + (idx & (sub - 1)) + 1) << shift;
+    }
+
+    void AppendLine(std::string &out, const std::string &name, const char *labels, double value) {
+        char buff[64];
+        snprintf(buff, sizeof(buff), " %.17g\n", value);
+        out += name;
+        out += labels;
+        out += buff;
+    }
+}
+
+Metrics *Metrics::Instance() {
+    static Metrics metrics;
+    return &metrics;
+}
+
+int Metrics::BucketIndex(uint64_t v) {
+    // 对数线性分桶: 每个 2 的幂区间再均分为 2^SUB_BITS 份
+    const uint64_t sub = 1 << SUB_BITS;
+    if (v < sub) {
+        return static_cast<int>(v);
+    }
+    int msb = 63 - __builtin_clzll(v);
+    int shift = msb - SUB_BITS;
+    return ((shift + 1) << SUB_BITS) + static_cast<int>((v >> shift) & (sub - 1));
+}
+
+void Metrics::Record(MetricHist hist, uint64_t ns) {
+    Histogram &h = Local()->hists[hist];
+    auto &bucket = h.buckets[BucketIndex(ns)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    h.sum.store(h.sum.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+}
+
+void Metrics::CountStatus(int code) {
+    if (code >= 200 && code < 300) {
+        Add(REQ_2XX);
+    } else if (code >= 400 && code < 500) {
+        Add(REQ_4XX);
+    } else if (code >= 500 && code < 600) {
+        Add(REQ_5XX);
+    } else {
+        Add(REQ_OTHER);
+    }
+}
+
+void Metrics::AddGaugeFunc(const std::string &name, const std::function<double()> &func) {
+    std::lock_guard<std::mutex> locker(m_mutex);
+    m_gaugeFuncs.emplace_back(name, func);
+}
+
+Metrics::Slot *Metrics::AcquireSlot() {
+    std::lock_guard<std::mutex> locker(m_mutex);
+    for (auto &slot: m_slots) {
+        bool expected = false;
+        if (slot->inUse.compare_exchange_strong(expected, true)) {
+            return slot.get();
+        }
+    }
+    m_slots.emplace_back(new Slot());
+    m_slots.back()->inUse.store(true);
+    return m_slots.back().get();
+}
+
+std::string Metrics::Render() {
+    uint64_t counters[COUNTER_NUM] = {0};
+    std::vector<uint64_t> buckets(HIST_NUM * BUCKET_NUM, 0);
+    uint64_t sums[HIST_NUM] = {0};
+    std::vector<std::pair<std::string, std::function<double()>>> gaugeFuncs;
+    {
+        std::lock_guard<std::mutex> locker(m_mutex);
+        for (auto &slot: m_slots) {
+            for (int i = 0; i < COUNTER_NUM; ++i) {
+                counters[i] += slot->counters[i].load(std::memory_order_relaxed);
+            }
+            for (int h = 0; h < HIST_NUM; ++h) {
+                for (int i = 0; i < BUCKET_NUM; ++i) {
+                    buckets[h * BUCKET_NUM + i] += slot->hists[h].buckets[i].load(std::memory_order_relaxed);
+                }
+                sums[h] += slot->hists[h].sum.load(std::memory_order_relaxed);
+            }
+        }
+        gaugeFuncs = m_gaugeFuncs;
+    }
+
+    std::string out;
+    for (int i = 0; i < COUNTER_NUM; ++i) {
+        AppendLine(out, COUNTER_NAME[i], "", static_cast<double>(counters[i]));
+    }
+    for (int i = 0; i < GAUGE_NUM; ++i) {
+        AppendLine(out, GAUGE_NAME[i], "", static_cast<double>(m_gauges[i].load(std::memory_order_relaxed)));
+    }
+    for (auto &gauge: gaugeFuncs) {
+        AppendLine(out, gauge.first, "", gauge.second());
+    }
+
+    // 直方图按 2 的幂合并输出, 只输出到最后一个非空区间
+    const int sub = 1 << SUB_BITS;
+    for (int h = 0; h < HIST_NUM; ++h) {
+        const uint64_t *b = &buckets[h * BUCKET_NUM];
+        int last = -1;
+        for (int i = 0; i < BUCKET_NUM; ++i) {
+            if (b[i]) { last = i | (sub - 1); }
+        }
+        std::string name = HIST_NAME[h];
+        out += "# TYPE " + name + " histogram\n";
+        uint64_t cumulative = 0;
+        for (int i = 0; i <= last; ++i) {
+            cumulative += b[i];
+            if ((i & (sub - 1)) == sub - 1) {
+                char labels[48];
+                snprintf(labels, sizeof(labels), "{le=\"%.9g\"}", BucketUpper(i) / 1e9);
+                AppendLine(out, name + "_bucket", labels, static_cast<double>(cumulative));
+            }
+        }
+        AppendLine(out, name + "_bucket", "{le=\"+Inf\"}", static_cast<double>(cumulative));
+        AppendLine(out, name + "_sum", "", sums[h] / 1e9);
+        AppendLine(out, name + "_count", "", static_cast<double>(cumulative));
+    }
+    return out;
+}
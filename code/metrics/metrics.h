@@ -0,0 +1,134 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+
+// 运行指标: 每个线程写自己的缓存行对齐槽位, 只在读取时汇总
+// 热路径上只有一次 thread_local 访问和一次 relaxed 写
+
+enum MetricCounter {
+    REQ_2XX,
+    REQ_4XX,
+    REQ_5XX,
+    REQ_OTHER,
+    BYTES_SENT,
+    CONN_ACCEPT,
+    CONN_REJECT,
+    ADMIT_REJECT,     // 超过准入上限直接返回 503
+    DEADLINE_DROP,    // 排队超过期限被丢弃
+    DB_LANE_REJECT,   // 数据库队列已满
+    POOL_GROW,        // 线程池扩容
+    POOL_SHRINK,      // 线程池缩容
+    NUMA_LOCAL,       // 读任务在连接所在 NUMA 节点上执行
+    NUMA_REMOTE,
+    CONN_EVICT,       // 连接数达到上限时关闭的空闲连接
+    SLOW_HEADER,      // 头部未在期限内收完
+    SLOW_BODY,        // 请求体低于最低速率
+    SLOW_SEND,        // 响应低于最低速率
+    CLIENT_CONN_REJECT, // 单 IP 连接数超限
+    CLIENT_RATE_REJECT, // 单 IP 请求速率超限
+    TLS_FULL,         // 完整握手
+    TLS_RESUMED,      // 会话恢复
+    TLS_KTLS,         // 发送方向由内核加密
+    TLS_FAIL,         // 握手失败
+    HTTP2_CONN,       // HTTP/2 连接
+    HTTP2_STREAM,     // HTTP/2 请求流
+    WS_CONN,          // WebSocket 握手成功
+    WS_MESSAGE,       // 收到的 WebSocket 消息
+    WS_OVERFLOW,      // 发送队列超限被关闭的 WebSocket 连接
+    COUNTER_NUM,
+};
+
+enum MetricHist {
+    HIST_PARSE,       // HttpRequest::Parse
+    HIST_QUEUE,       // 任务在 ThreadPool 队列中的等待
+    HIST_DB_WAIT,     // 等待数据库连接
+    HIST_DB_QUERY,    // 数据库查询
+    HIST_LOOP_BUSY,   // 事件循环单轮处理
+    HIST_NUM,
+};
+
+enum MetricGauge {
+    GAUGE_TIMER_HEAP,
+    GAUGE_NUM,
+};
+
+class Metrics {
+public:
+    static Metrics *Instance();
+
+    static void Add(MetricCounter counter, uint64_t n = 1) {
+        auto &c = Local()->counters[counter];
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    static void Record(MetricHist hist, uint64_t ns);
+
+    static void SetGauge(MetricGauge gauge, int64_t value) {
+        Instance()->m_gauges[gauge].store(value, std::memory_order_relaxed);
+    }
+
+    static void CountStatus(int code);
+
+    static uint64_t NowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // 读取时调用的外部指标, 如连接数, 数据库空闲连接数
+    void AddGaugeFunc(const std::string &name, const std::function<double()> &func);
+
+    // Prometheus 文本格式
+    std::string Render();
+
+    static const int SUB_BITS = 3;
+    static const int BUCKET_NUM = (64 - SUB_BITS + 1) << SUB_BITS;
+
+    static int BucketIndex(uint64_t v);
+
+private:
+    Metrics() = default;
+
+    struct Histogram {
+        std::atomic<uint64_t> buckets[BUCKET_NUM];
+        std::atomic<uint64_t> sum;
+    };
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> counters[COUNTER_NUM];
+        Histogram hists[HIST_NUM];
+        std::atomic<bool> inUse;
+    };
+
+    // 线程退出时归还槽位, 计数保留并由后来的线程继续累加
+    struct SlotHolder {
+        Slot *slot = nullptr;
+
+        ~SlotHolder() {
+            if (slot) { slot->inUse.store(false); }
+        }
+    };
+
+    static Slot *Local() {
+        static thread_local SlotHolder holder;
+        if (!holder.slot) {
+            holder.slot = Instance()->AcquireSlot();
+        }
+        return holder.slot;
+    }
+
+    Slot *AcquireSlot();
+
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<Slot>> m_slots;
+    std::vector<std::pair<std::string, std::function<double()>>> m_gaugeFuncs;
+    std::atomic<int64_t> m_gauges[GAUGE_NUM]{};
+};
+
+#endif //METRICS_H
@@ -0,0 +1,9 @@
+#include "probes.h"
+
+#ifdef TWS_WITH_USDT
+// 追踪器通过 .probes 段中的地址找到信号量
+#define TWS_PROBE_SEMAPHORE(name) \
+    volatile unsigned short trywebserver_##name##_semaphore __attribute__((section(".probes"))) = 0;
+TWS_PROBE_LIST(TWS_PROBE_SEMAPHORE)
+#undef TWS_PROBE_SEMAPHORE
+#endif
@@ -0,0 +1,45 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+// USDT 静态探针, provider 为 trywebserver
+// 以 -DTWS_WITH_USDT=ON 编译时生效. 每个探针带一个信号量, 追踪器挂载时由内核加一,
+// 未挂载时只检查一次信号量并跳过, 参数和计时都不会求值
+// 关闭时宏展开为空, 参数不会被求值
+
+#define TWS_PROBE_LIST(X) \
+    X(accept) X(dispatch_read) X(dispatch_write) X(parse_start) X(parse_end) X(conn_close) \
+    X(sql_conn_wait) X(timer_expire)
+
+#ifdef TWS_WITH_USDT
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#include <chrono>
+
+// 信号量定义在 probes.cpp 中
+#define TWS_PROBE_SEMAPHORE(name) extern volatile unsigned short trywebserver_##name##_semaphore;
+TWS_PROBE_LIST(TWS_PROBE_SEMAPHORE)
+#undef TWS_PROBE_SEMAPHORE
+
+#define TWS_PROBE_ENABLED(name) __builtin_expect(trywebserver_##name##_semaphore != 0, 0)
+#define TWS_PROBE1(name, a) \
+    do { if (TWS_PROBE_ENABLED(name)) { DTRACE_PROBE1(trywebserver, name, a); } } while (0)
+#define TWS_PROBE2(name, a, b) \
+    do { if (TWS_PROBE_ENABLED(name)) { DTRACE_PROBE2(trywebserver, name, a, b); } } while (0)
+#define TWS_PROBE4(name, a, b, c, d) \
+    do { if (TWS_PROBE_ENABLED(name)) { DTRACE_PROBE4(trywebserver, name, a, b, c, d); } } while (0)
+// 只为探针参数计时
+#define TWS_PROBE_CLOCK() static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>( \
+    std::chrono::steady_clock::now().time_since_epoch()).count())
+
+#else
+
+#define TWS_PROBE_ENABLED(name) false
+#define TWS_PROBE1(name, a)
+#define TWS_PROBE2(name, a, b)
+#define TWS_PROBE4(name, a, b, c, d)
+#define TWS_PROBE_CLOCK() static_cast<uint64_t>(0)
+
+#endif
+
+#endif //PROBES_H
@@ -0,0 +1,141 @@
+#include "trace.h"
+
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "../log/log.h"
+
+thread_local RequestTrace *Tracer::current = nullptr;
+
+namespace {
+    // Chrome trace 中的区间: 名称, 起点, 终点
+    struct Span {
+        const char *name;
+        TracePhase begin;
+        TracePhase end;
+    };
+
+    const Span SPANS[] = {
+            {"request", PH_DISPATCH,    PH_LAST_BYTE},
+            {"queue",   PH_DISPATCH,    PH_FIRST_BYTE},
+            {"parse",   PH_PARSE_BEGIN, PH_PARSE_END},
+            {"db",      PH_DB_BEGIN,    PH_DB_END},
+            {"build",   PH_PARSE_END,   PH_BUILT},
+            {"write",   PH_BUILT,       PH_LAST_BYTE},
+    };
+
+    void AppendEscaped(std::string &out, const char *str) {
+        for (const char *p = str; *p; ++p) {
+            if (*p == '"' || *p == '\\') {
+                out += '\\';
+                out += *p;
+            } else if (static_cast<unsigned char>(*p) < 0x20) {
+                out += ' ';
+            } else {
+                out += *p;
+            }
+        }
+    }
+}
+
+Tracer *Tracer::Instance() {
+    static Tracer tracer;
+    return &tracer;
+}
+
+void Tracer::Init(int sampleRate, int bufferSize) {
+    {
+        std::lock_guard<std::mutex> locker(t_mutex);
+        t_bufferSize = bufferSize > 0 ? bufferSize : 1;
+    }
+    t_sampleRate.store(sampleRate > 0 ? sampleRate : 0);
+}
+
+bool Tracer::Sample() {
+    int rate = Instance()->t_sampleRate.load(std::memory_order_relaxed);
+    if (rate <= 0) { return false; }
+    static thread_local unsigned int count = 0;
+    return ++count % rate == 0;
+}
+
+Tracer::Ring *Tracer::Local() {
+    static thread_local RingHolder holder;
+    if (holder.ring) { return holder.ring; }
+    std::lock_guard<std::mutex> locker(t_mutex);
+    for (auto &ring: t_rings) {
+        bool expected = false;
+        if (ring->inUse.compare_exchange_strong(expected, true)) {
+            holder.ring = ring.get();
+            return holder.ring;
+        }
+    }
+    t_rings.emplace_back(new Ring());
+    holder.ring = t_rings.back().get();
+    holder.ring->inUse.store(true);
+    holder.ring->records.resize(t_bufferSize);
+    return holder.ring;
+}
+
+void Tracer::Commit(const RequestTrace &trace, int fd, const std::string &path) {
+    Ring *ring = Local();
+    std::lock_guard<std::mutex> locker(ring->mutex);
+    Record &record = ring->records[ring->next];
+    memcpy(record.ts, trace.ts, sizeof(record.ts));
+    record.fd = fd;
+    record.tid = static_cast<int>(syscall(SYS_gettid));
+    snprintf(record.path, sizeof(record.path), "%s", path.c_str());
+    if (++ring->next == ring->records.size()) {
+        ring->next = 0;
+        ring->full = true;
+    }
+}
+
+bool Tracer::Dump(const char *file) {
+    std::vector<Record> records;
+    {
+        std::lock_guard<std::mutex> locker(t_mutex);
+        for (auto &ring: t_rings) {
+            std::lock_guard<std::mutex> ringLocker(ring->mutex);
+            size_t cnt = ring->full ? ring->records.size() : ring->next;
+            records.insert(records.end(), ring->records.begin(), ring->records.begin() + cnt);
+        }
+    }
+
+    std::string out = "{\"traceEvents\":[\n";
+    bool first = true;
+    char buff[256];
+    for (const auto &record: records) {
+        for (const auto &span: SPANS) {
+            uint64_t begin = record.ts[span.begin], end = record.ts[span.end];
+            if (begin == 0 || end < begin) { continue; }
+            out += first ? "" : ",\n";
+            first = false;
+            snprintf(buff, sizeof(buff),
+                     R"({"name":"%s","ph":"X","pid":1,"tid":%d,"ts":%.3f,"dur":%.3f,"args":{"fd":%d,"path":")",
+                     span.name, record.tid, begin / 1e3, (end - begin) / 1e3, record.fd);
+            out += buff;
+            AppendEscaped(out, record.path);
+            out += "\"";
+            if (span.begin == PH_DISPATCH && record.ts[PH_ACCEPT]) {
+                // 长连接上的请求, 记录距离连接建立的时间
+                snprintf(buff, sizeof(buff), ",\"sinceAcceptUs\":%.3f",
+                         (record.ts[PH_DISPATCH] - record.ts[PH_ACCEPT]) / 1e3);
+                out += buff;
+            }
+            out += "}}";
+        }
+    }
+    out += "\n]}\n";
+
+    FILE *fp = fopen(file, "w");
+    if (!fp) {
+        LOG_ERROR("Trace dump %s error!", file)
+        return false;
+    }
+    size_t len = fwrite(out.data(), 1, out.size(), fp);
+    fclose(fp);
+    LOG_INFO("Trace dump %s: %d requests", file, (int) records.size())
+    return len == out.size();
+}
@@ -0,0 +1,98 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "metrics.h"
+
+// 单个请求各阶段的时间点, 只有被采样的请求才会记录
+enum TracePhase {
+    PH_ACCEPT,        // 连接建立
+    PH_DISPATCH,      // 事件循环投递读任务
+    PH_FIRST_BYTE,    // 工作线程读到数据
+    PH_PARSE_BEGIN,
+    PH_DB_BEGIN,
+    PH_DB_END,
+    PH_PARSE_END,
+    PH_BUILT,         // 响应构造完成
+    PH_LAST_BYTE,     // 最后一个字节写出
+    PH_NUM,
+};
+
+struct RequestTrace {
+    bool sampled = false;
+    uint64_t ts[PH_NUM] = {0};
+
+    void Mark(TracePhase phase) {
+        if (sampled) { ts[phase] = Metrics::NowNs(); }
+    }
+};
+
+// 请求阶段追踪: 按 1/sampleRate 采样, 记录写入每个线程的环形缓冲区
+// 导出为 Chrome trace-event JSON, 可在 Perfetto 中打开
+class Tracer {
+public:
+    static Tracer *Instance();
+
+    // sampleRate 为 0 时关闭
+    void Init(int sampleRate, int bufferSize);
+
+    static bool IsOpen() { return Instance()->t_sampleRate > 0; }
+
+    // 是否采样下一个请求, 由事件循环线程调用
+    static bool Sample();
+
+    // 当前线程正在处理的请求, 用于在 HttpRequest 等深层代码中打点
+    static void SetCurrent(RequestTrace *trace) { current = trace; }
+
+    static void Mark(TracePhase phase) {
+        if (current) { current->Mark(phase); }
+    }
+
+    // 请求结束, 写入当前线程的环形缓冲区
+    void Commit(const RequestTrace &trace, int fd, const std::string &path);
+
+    bool Dump(const char *file);
+
+private:
+    Tracer() = default;
+
+    struct Record {
+        uint64_t ts[PH_NUM];
+        int fd;
+        int tid;
+        char path[48];
+    };
+
+    struct Ring {
+        std::mutex mutex;
+        std::vector<Record> records;
+        size_t next = 0;
+        bool full = false;
+        std::atomic<bool> inUse{false};
+    };
+
+    // 线程退出时归还缓冲区, 已有记录保留到被覆盖
+    struct RingHolder {
+        Ring *ring = nullptr;
+
+        ~RingHolder() {
+            if (ring) { ring->inUse.store(false); }
+        }
+    };
+
+    Ring *Local();
+
+    static thread_local RequestTrace *current;
+
+    std::atomic<int> t_sampleRate{0};
+    int t_bufferSize = 0;
+    std::mutex t_mutex;
+    std::vector<std::unique_ptr<Ring>> t_rings;
+};
+
+#endif //TRACE_H
@@ -0,0 +1,58 @@
+#include "cpu_affinity.h"
+
+#include <sched.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+bool CpuAffinity::Pin(pthread_t thread, int cpu) {
+    return Pin(thread, std::vector<int>{cpu});
+}
+
+bool CpuAffinity::Pin(pthread_t thread, const std::vector<int> &cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu: cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) { CPU_SET(cpu, &set); }
+    }
+    return CPU_COUNT(&set) > 0 && pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
+const std::vector<int> &CpuAffinity::CpuNodes() {
+    static const std::vector<int> nodes = [] {
+        long cpuNum = sysconf(_SC_NPROCESSORS_CONF);
+        std::vector<int> res(cpuNum > 0 ? cpuNum : 1, 0);
+        char path[64];
+        for (size_t cpu = 0; cpu < res.size(); ++cpu) {
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%zu", cpu);
+            DIR *dp = opendir(path);
+            if (!dp) { continue; }
+            while (struct dirent *ent = readdir(dp)) {
+                int node;
+                if (sscanf(ent->d_name, "node%d", &node) == 1) {
+                    res[cpu] = node;
+                    break;
+                }
+            }
+            closedir(dp);
+        }
+        return res;
+    }();
+    return nodes;
+}
+
+int CpuAffinity::NodeOf(int cpu) {
+    const auto &nodes = CpuNodes();
+    return (cpu >= 0 && static_cast<size_t>(cpu) < nodes.size()) ? nodes[cpu] : 0;
+}
+
+int CpuAffinity::NodeNum() {
+    const auto &nodes = CpuNodes();
+    return *std::max_element(nodes.begin(), nodes.end()) + 1;
+}
+
+int CpuAffinity::CurrentNode() {
+    return NodeOf(sched_getcpu());
+}
@@ -0,0 +1,25 @@
+#ifndef CPU_AFFINITY_H
+#define CPU_AFFINITY_H
+
+#include <vector>
+#include <pthread.h>
+
+// CPU 绑定与 NUMA 拓扑, 拓扑在首次使用时从 /sys 读取
+class CpuAffinity {
+public:
+    static bool Pin(pthread_t thread, int cpu);
+
+    static bool Pin(pthread_t thread, const std::vector<int> &cpus);
+
+    // CPU 所在的 NUMA 节点, 未知时返回 0
+    static int NodeOf(int cpu);
+
+    static int NodeNum();
+
+    static int CurrentNode();
+
+private:
+    static const std::vector<int> &CpuNodes();
+};
+
+#endif //CPU_AFFINITY_H
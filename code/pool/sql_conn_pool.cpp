@@ -9,43 +9,94 @@ void SqlConnPool::Init(const char *host, int port,
                        const char *user, const char *pwd, const char *dbName,
                        int connSize = 10) {
     assert(connSize > 0);
+    s_host = host;
+    s_port = port;
+    s_user = user;
+    s_pwd = pwd;
+    s_dbName = dbName;
     for (int i = 0; i < connSize; ++i) {
-        MYSQL *sql = nullptr;
-        sql = mysql_init(sql);
-        if (!sql) {
-            LOG_ERROR("MySql Init error!")
-            assert(sql);
-        }
-        sql = mysql_real_connect(sql, host,
-                                 user, pwd,
-                                 dbName, port, nullptr, 0);
-        if (!sql) {
-            LOG_ERROR("MySql Connect error!")
-        }
-        s_connQue.emplace(sql);
+        s_connQue.emplace(Connect());
     }
     MAX_CONN = connSize;
     sem_init(&semId, 0, MAX_CONN);
 }
 
+MYSQL *SqlConnPool::Connect() {
+    MYSQL *sql = nullptr;
+    sql = mysql_init(sql);
+    if (!sql) {
+        LOG_ERROR("MySql Init error!")
+        assert(sql);
+    }
+    sql = mysql_real_connect(sql, s_host.c_str(),
+                             s_user.c_str(), s_pwd.c_str(),
+                             s_dbName.c_str(), s_port, nullptr, 0);
+    if (!sql) {
+        LOG_ERROR("MySql Connect error!")
+    }
+    return sql;
+}
+
+void SqlConnPool::Resize(int connSize) {
+    assert(connSize > 0);
+    std::unique_lock<std::mutex> locker(s_mutex);
+    int target = connSize - (MAX_CONN - s_retire);
+    if (target > 0) {
+        // 先抵消还未关闭的缩容
+        int cancel = std::min(target, s_retire);
+        s_retire -= cancel;
+        target -= cancel;
+        locker.unlock();
+        // 建立连接不持锁
+        std::vector<MYSQL *> conns;
+        for (int i = 0; i < target; ++i) {
+            conns.push_back(Connect());
+        }
+        locker.lock();
+        for (auto sql: conns) {
+            s_connQue.emplace(sql);
+            ++MAX_CONN;
+            sem_post(&semId);
+        }
+    } else {
+        for (; target < 0 && sem_trywait(&semId) == 0; ++target) {
+            mysql_close(s_connQue.front());
+            s_connQue.pop();
+            --MAX_CONN;
+        }
+        s_retire -= target;
+    }
+    LOG_INFO("SqlConnPool resize to %d, %d to retire", MAX_CONN - s_retire, s_retire)
+}
+
 MYSQL *SqlConnPool::GetConn() {
     MYSQL *sql = nullptr;
     if (s_connQue.empty()) {
         LOG_WARN("SqlConnPool busy!")
         return nullptr;
     }
+    // 追踪器未挂载时不读时钟
+    [[maybe_unused]] uint64_t waitStart = TWS_PROBE_ENABLED(sql_conn_wait) ? TWS_PROBE_CLOCK() : 0;
     sem_wait(&semId);
     {
         std::lock_guard<std::mutex> locker(s_mutex);
         sql = s_connQue.front();
         s_connQue.pop();
     }
+    // 等待期间才挂载的追踪器没有起点, 记为 0
+    TWS_PROBE1(sql_conn_wait, waitStart ? TWS_PROBE_CLOCK() - waitStart : 0);
     return sql;
 }
 
 void SqlConnPool::FreeConn(MYSQL *sql) {
     assert(sql);
     std::lock_guard<std::mutex> locker(s_mutex);
+    if (s_retire > 0) {
+        --s_retire;
+        --MAX_CONN;
+        mysql_close(sql);
+        return;
+    }
     s_connQue.emplace(sql);
     sem_post(&semId);
 }
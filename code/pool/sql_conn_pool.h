@@ -4,11 +4,13 @@
 #include <mysql/mysql.h>
 #include <string>
 #include <queue>
+#include <vector>
 #include <mutex>
 #include <semaphore.h>
 #include <thread>
 
 #include "../log/log.h"
+#include "../metrics/probes.h"
 
 class SqlConnPool {
 public:
@@ -26,10 +28,22 @@ public:
 
     void ClosePool();
 
+    // 运行中调整连接数: 扩容时新建连接, 缩容时空闲连接立即关闭, 使用中的连接归还时关闭
+    void Resize(int connSize);
+
 private:
     ~SqlConnPool();
 
+    MYSQL *Connect();
+
     int MAX_CONN;
+    // 缩容时尚未关闭的连接数
+    int s_retire = 0;
+    std::string s_host;
+    int s_port = 0;
+    std::string s_user;
+    std::string s_pwd;
+    std::string s_dbName;
 
     std::queue<MYSQL *> s_connQue;
     std::mutex s_mutex;
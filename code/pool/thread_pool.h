@@ -4,27 +4,38 @@
 #include <mutex>
 #include <condition_variable>
 #include <queue>
+#include <list>
+#include <vector>
 #include <thread>
 #include <functional>
+#include <cassert>
+
+#include "../log/log.h"
+#include "../metrics/metrics.h"
+#include "cpu_affinity.h"
 
 class ThreadPool {
 public:
-    explicit ThreadPool(size_t threadCount = 8) : t_pool(std::make_shared<Pool>()) {
-        assert(threadCount > 0);
-        for (size_t i = 0; i < threadCount; ++i) {
-            std::thread([pool = t_pool] {
-                std::unique_lock<std::mutex> locker(pool->p_mutex);
-                while (true) {
-                    if (!pool->tasks.empty()) {
-                        auto task = std::move(pool->tasks.front());
-                        pool->tasks.pop();
-                        locker.unlock();
-                        task();
-                        locker.lock();
-                    } else if (pool->isClosed) break;
-                    else pool->cond.wait(locker);
-                }
-            }).detach();
+    explicit ThreadPool(size_t threadCount = 8) : ThreadPool(threadCount, threadCount, 0, 0) {}
+
+    // 线程数在 [minThreads, maxThreads] 之间伸缩:
+    // 任务排队超过 targetWaitMs 且没有空闲线程时扩容, 空闲超过 idleMs 的线程退出
+    // cpus 非空时工作线程依次绑定到其中的 CPU, 并按 NUMA 节点分开排队
+    ThreadPool(size_t minThreads, size_t maxThreads, int targetWaitMs, int idleMs,
+               const std::vector<int> &cpus = {}) : t_pool(std::make_shared<Pool>()) {
+        assert(minThreads > 0);
+        t_pool->minThreads = minThreads;
+        t_pool->maxThreads = std::max(minThreads, maxThreads);
+        t_pool->targetWaitNs = targetWaitMs > 0 ? static_cast<uint64_t>(targetWaitMs) * 1000000 : 0;
+        t_pool->idleMs = idleMs;
+        t_pool->cpus = cpus;
+        if (!cpus.empty()) {
+            t_pool->nodeTasks.resize(CpuAffinity::NodeNum());
+            t_pool->nodeWorkers.resize(CpuAffinity::NodeNum());
+        }
+        std::lock_guard<std::mutex> locker(t_pool->p_mutex);
+        for (size_t i = 0; i < minThreads; ++i) {
+            Spawn(t_pool);
         }
     }
 
@@ -34,32 +45,243 @@ public:
 
     ~ThreadPool() {
         if (static_cast<bool>(t_pool)) {
+            std::list<std::thread> threads;
             {
                 std::lock_guard<std::mutex> locker(t_pool->p_mutex);
                 t_pool->isClosed = true;
+                threads.swap(t_pool->threads);
             }
             t_pool->cond.notify_all();
+            // 执行完队列中剩余的任务后退出
+            for (auto &thread: threads) {
+                thread.join();
+            }
         }
     }
 
+    // isBulk: 大块传输等可延后的任务, 普通任务优先执行
+    // node: 连接所在的 NUMA 节点, 优先由该节点上的线程执行
     template<class T>
-    void AddTask(T &&task) {
+    void AddTask(T &&task, bool isBulk = false, int node = -1) {
         {
             std::lock_guard<std::mutex> locker(t_pool->p_mutex);
-            t_pool->tasks.emplace(std::forward<T>(task));
+            t_pool->Push({std::forward<T>(task), Metrics::NowNs()}, isBulk, node);
+            Grow(t_pool);
         }
         t_pool->cond.notify_one();
     }
 
+    // 队列已有 maxPending 个任务时拒绝
+    template<class T>
+    bool TryAddTask(T &&task, size_t maxPending) {
+        {
+            std::lock_guard<std::mutex> locker(t_pool->p_mutex);
+            if (t_pool->Pending() >= maxPending) {
+                return false;
+            }
+            t_pool->Push({std::forward<T>(task), Metrics::NowNs()}, false, -1);
+            Grow(t_pool);
+        }
+        t_pool->cond.notify_one();
+        return true;
+    }
+
+    // 运行中调整线程数范围, 超出上限的线程执行完手上的任务后退出
+    void SetLimits(size_t minThreads, size_t maxThreads, int targetWaitMs, int idleMs) {
+        assert(minThreads > 0);
+        {
+            std::lock_guard<std::mutex> locker(t_pool->p_mutex);
+            t_pool->minThreads = minThreads;
+            t_pool->maxThreads = std::max(minThreads, maxThreads);
+            t_pool->targetWaitNs = targetWaitMs > 0 ? static_cast<uint64_t>(targetWaitMs) * 1000000 : 0;
+            t_pool->idleMs = idleMs;
+            while (t_pool->alive < minThreads) {
+                Spawn(t_pool);
+            }
+        }
+        t_pool->cond.notify_all();
+    }
+
+    size_t ThreadCount() {
+        std::lock_guard<std::mutex> locker(t_pool->p_mutex);
+        return t_pool->alive;
+    }
+
+    size_t IdleCount() {
+        std::lock_guard<std::mutex> locker(t_pool->p_mutex);
+        return t_pool->idle;
+    }
+
 private:
+    struct Task {
+        std::function<void()> func;
+        // 入队时间, 用于统计排队时长
+        uint64_t enqueueNs;
+    };
+
     struct Pool {
+        // 连续执行这么多普通任务后插入一个低优先级任务, 避免饿死
+        static const int BULK_INTERVAL = 8;
+
         bool isClosed{};
+        int fastStreak{};
+        size_t minThreads{};
+        size_t maxThreads{};
+        uint64_t targetWaitNs{};
+        int idleMs{};
+        size_t alive{};
+        size_t idle{};
         std::mutex p_mutex;
         std::condition_variable cond;
-        std::queue<std::function<void()>> tasks;
+        std::queue<Task> tasks;
+        std::queue<Task> bulkTasks;
+        std::list<std::thread> threads;
+        // 已退出待 join 的线程
+        std::vector<std::list<std::thread>::iterator> exited;
+
+        std::vector<int> cpus;
+        size_t spawned{};
+        std::vector<std::queue<Task>> nodeTasks;
+        std::vector<size_t> nodeWorkers;
+        size_t nodePending{};
+
+        size_t Pending() const {
+            return tasks.size() + bulkTasks.size() + nodePending;
+        }
+
+        void Push(Task &&task, bool isBulk, int node) {
+            if (!isBulk && node >= 0 && static_cast<size_t>(node) < nodeTasks.size() && nodeWorkers[node] > 0) {
+                nodeTasks[node].push(std::move(task));
+                ++nodePending;
+            } else {
+                (isBulk ? bulkTasks : tasks).push(std::move(task));
+            }
+        }
+
+        std::queue<Task> &PickQueue() {
+            if (bulkTasks.empty()) { return tasks; }
+            if (tasks.empty() || ++fastStreak >= BULK_INTERVAL) {
+                fastStreak = 0;
+                return bulkTasks;
+            }
+            return tasks;
+        }
+
+        // 本节点队列 -> 公共队列 -> 其他节点队列
+        bool Pop(int node, Task &task) {
+            std::queue<Task> *queue = nullptr;
+            if (node >= 0 && !nodeTasks[node].empty()) {
+                queue = &nodeTasks[node];
+            } else if (!tasks.empty() || !bulkTasks.empty()) {
+                queue = &PickQueue();
+            } else if (nodePending > 0) {
+                for (auto &q: nodeTasks) {
+                    if (!q.empty()) {
+                        queue = &q;
+                        break;
+                    }
+                }
+            }
+            if (!queue) { return false; }
+            if (queue != &tasks && queue != &bulkTasks) { --nodePending; }
+            task = std::move(queue->front());
+            queue->pop();
+            return true;
+        }
+
+        uint64_t OldestEnqueue() const {
+            uint64_t res = UINT64_MAX;
+            if (!tasks.empty()) { res = std::min(res, tasks.front().enqueueNs); }
+            if (!bulkTasks.empty()) { res = std::min(res, bulkTasks.front().enqueueNs); }
+            for (const auto &q: nodeTasks) {
+                if (!q.empty()) { res = std::min(res, q.front().enqueueNs); }
+            }
+            return res;
+        }
     };
+
+    // 以下均在持有 p_mutex 时调用
+    static void Spawn(const std::shared_ptr<Pool> &pool) {
+        for (auto it: pool->exited) {
+            it->join();
+            pool->threads.erase(it);
+        }
+        pool->exited.clear();
+        ++pool->alive;
+        int cpu = pool->cpus.empty() ? -1 : pool->cpus[pool->spawned++ % pool->cpus.size()];
+        int node = cpu < 0 ? -1 : CpuAffinity::NodeOf(cpu);
+        if (node >= 0) { ++pool->nodeWorkers[node]; }
+        pool->threads.emplace_back();
+        auto self = std::prev(pool->threads.end());
+        *self = std::thread([pool, self, cpu, node] {
+            if (cpu >= 0 && !CpuAffinity::Pin(pthread_self(), cpu)) {
+                LOG_WARN("ThreadPool pin cpu %d error!", cpu)
+            }
+            Work(pool, self, node);
+        });
+    }
+
+    static void Grow(const std::shared_ptr<Pool> &pool) {
+        if (pool->targetWaitNs == 0 || pool->idle > 0 || pool->alive >= pool->maxThreads || pool->isClosed) {
+            return;
+        }
+        uint64_t oldest = pool->OldestEnqueue();
+        if (oldest == UINT64_MAX || Metrics::NowNs() - oldest < pool->targetWaitNs) {
+            return;
+        }
+        Spawn(pool);
+        Metrics::Add(POOL_GROW);
+        LOG_INFO("ThreadPool grow to %d threads", (int) pool->alive)
+    }
+
+    // 线程退出, 由下次扩容或析构时 join
+    static void Retire(const std::shared_ptr<Pool> &pool, std::list<std::thread>::iterator self, int node) {
+        --pool->alive;
+        if (node >= 0) { --pool->nodeWorkers[node]; }
+        pool->exited.push_back(self);
+        Metrics::Add(POOL_SHRINK);
+        LOG_INFO("ThreadPool shrink to %d threads", (int) pool->alive)
+    }
+
+    static void Work(const std::shared_ptr<Pool> &pool, std::list<std::thread>::iterator self, int node) {
+        std::unique_lock<std::mutex> locker(pool->p_mutex);
+        Task task;
+        while (true) {
+            if (pool->Pop(node, task)) {
+                Grow(pool);
+                locker.unlock();
+                Metrics::Record(HIST_QUEUE, Metrics::NowNs() - task.enqueueNs);
+                task.func();
+                task.func = nullptr;
+                locker.lock();
+            } else if (pool->isClosed) {
+                break;
+            } else if (pool->alive > pool->maxThreads) {
+                // 上限被调低
+                Retire(pool, self, node);
+                return;
+            } else if (pool->idleMs <= 0 || pool->alive <= pool->minThreads) {
+                ++pool->idle;
+                pool->cond.wait(locker);
+                --pool->idle;
+            } else {
+                ++pool->idle;
+                auto status = pool->cond.wait_for(locker, std::chrono::milliseconds(pool->idleMs));
+                --pool->idle;
+                if (status == std::cv_status::timeout && pool->Pending() == 0
+                    && pool->alive > pool->minThreads && !pool->isClosed) {
+                    // 空闲太久, 退出
+                    Retire(pool, self, node);
+                    return;
+                }
+            }
+        }
+        --pool->alive;
+        if (node >= 0) { --pool->nodeWorkers[node]; }
+    }
+
     std::shared_ptr<Pool> t_pool;
 };
 
 
-#endif //THREAD_POOL_H
\ No newline at end of file
+#endif //THREAD_POOL_H
@@ -0,0 +1,49 @@
+#include "admission.h"
+
+AdmissionControl::AdmissionControl(int minLimit, int maxLimit, int targetQueueMs) :
+        a_minLimit(0), a_maxLimit(0), a_targetNs(0),
+        a_limit(0), a_inFlight(0), a_goodCnt(0), a_lastDecrease(0) {
+    SetLimits(minLimit, maxLimit, targetQueueMs);
+    a_limit = a_maxLimit.load();
+}
+
+void AdmissionControl::SetLimits(int minLimit, int maxLimit, int targetQueueMs) {
+    int low = std::max(minLimit, 1);
+    int high = std::max(maxLimit, low);
+    a_minLimit.store(low, std::memory_order_relaxed);
+    a_maxLimit.store(high, std::memory_order_relaxed);
+    a_targetNs.store(static_cast<uint64_t>(std::max(targetQueueMs, 1)) * 1000000, std::memory_order_relaxed);
+    a_limit.store(std::max(low, std::min(high, a_limit.load(std::memory_order_relaxed))), std::memory_order_relaxed);
+}
+
+bool AdmissionControl::TryAcquire() {
+    // 只有本线程增加计数, 不会超过上限
+    if (a_inFlight.load(std::memory_order_relaxed) >= a_limit.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    a_inFlight.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void AdmissionControl::Release(uint64_t queueNs) {
+    a_inFlight.fetch_sub(1, std::memory_order_relaxed);
+    int limit = a_limit.load(std::memory_order_relaxed);
+    uint64_t targetNs = a_targetNs.load(std::memory_order_relaxed);
+    if (queueNs > targetNs) {
+        uint64_t now = Metrics::NowNs();
+        uint64_t last = a_lastDecrease.load(std::memory_order_relaxed);
+        if (now - last < DECREASE_WINDOW_NS ||
+            !a_lastDecrease.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+            return;
+        }
+        double ratio = std::max(0.5, std::min(0.9, static_cast<double>(targetNs) / queueNs));
+        int next = std::max(a_minLimit.load(std::memory_order_relaxed), static_cast<int>(limit * ratio));
+        a_limit.store(next, std::memory_order_relaxed);
+        a_goodCnt.store(0, std::memory_order_relaxed);
+        LOG_DEBUG("Admission limit %d -> %d, queue %d us", limit, next, static_cast<int>(queueNs / 1000))
+    } else if (limit < a_maxLimit.load(std::memory_order_relaxed)
+               && a_goodCnt.fetch_add(1, std::memory_order_relaxed) + 1 >= limit) {
+        a_goodCnt.store(0, std::memory_order_relaxed);
+        a_limit.compare_exchange_strong(limit, limit + 1, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <atomic>
+#include <algorithm>
+
+#include "../log/log.h"
+#include "../metrics/metrics.h"
+
+// 自适应准入控制: 限制同时在处理中的读任务数
+// 排队时间低于目标时每完成 limit 个请求上限加一, 超过目标时按 目标/实际 比例下调
+class AdmissionControl {
+public:
+    AdmissionControl(int minLimit, int maxLimit, int targetQueueMs);
+
+    // 只由事件循环线程调用
+    bool TryAcquire();
+
+    // 工作线程处理完成后调用, queueNs 为该任务的排队时间
+    void Release(uint64_t queueNs);
+
+    // 热加载时调整, 当前上限收进新的范围
+    void SetLimits(int minLimit, int maxLimit, int targetQueueMs);
+
+    int Limit() const { return a_limit.load(std::memory_order_relaxed); }
+
+    int InFlight() const { return a_inFlight.load(std::memory_order_relaxed); }
+
+private:
+    // 两次下调的最小间隔, 避免同一批排队任务连续下调
+    static const uint64_t DECREASE_WINDOW_NS = 100 * 1000 * 1000;
+
+    std::atomic<int> a_minLimit;
+    std::atomic<int> a_maxLimit;
+    std::atomic<uint64_t> a_targetNs;
+
+    std::atomic<int> a_limit;
+    std::atomic<int> a_inFlight;
+    std::atomic<int> a_goodCnt;
+    std::atomic<uint64_t> a_lastDecrease;
+};
+
+#endif //ADMISSION_H
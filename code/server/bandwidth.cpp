@@ -0,0 +1,113 @@
+#include "bandwidth.h"
+
+namespace {
+    // 令牌不足一个最小块时等待, 避免大量小包写
+    const int64_t MIN_CHUNK = 4096;
+    // 单 IP 令牌桶满且空闲超过该次数后回收
+    const int IP_IDLE_TICKS = 60 * 1000 / BandwidthShaper::REFILL_MS;
+}
+
+void TokenBucket::Reset(bool _enabled, int64_t _rate) {
+    enabled = _enabled;
+    rate = _rate;
+    tokens = _rate;
+    last = std::chrono::steady_clock::now();
+}
+
+int64_t TokenBucket::Available() {
+    auto now = std::chrono::steady_clock::now();
+    int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(now - last).count();
+    if (us > 0) {
+        tokens = std::min(rate, tokens + rate * us / 1000000);
+        last = now;
+    }
+    return tokens;
+}
+
+BandwidthShaper::BandwidthShaper(int64_t globalRate, int64_t perIpRate, std::vector<BandwidthRule> rules) :
+        b_globalRate(globalRate), b_perIpRate(perIpRate), b_rules(std::move(rules)),
+        b_globalTokens(globalRate) {}
+
+const BandwidthRule *BandwidthShaper::Match(const std::string &path) const {
+    for (const auto &rule: b_rules) {
+        if (!rule.prefix.empty() && path.compare(0, rule.prefix.size(), rule.prefix) == 0) {
+            return &rule;
+        }
+        if (!rule.suffix.empty() && path.size() >= rule.suffix.size()
+            && path.compare(path.size() - rule.suffix.size(), rule.suffix.size(), rule.suffix) == 0) {
+            return &rule;
+        }
+    }
+    return nullptr;
+}
+
+size_t BandwidthShaper::Acquire(TokenBucket &conn, ip_key_t ip, size_t want, int *waitMs) {
+    int64_t allow = static_cast<int64_t>(want);
+    int64_t need = std::min<int64_t>(allow, MIN_CHUNK);
+    *waitMs = 0;
+    auto limit = [&](int64_t tokens, int64_t rate) {
+        if (tokens < need) {
+            *waitMs = std::max(*waitMs, WaitMs(tokens, need, rate));
+            allow = 0;
+        } else {
+            allow = std::min(allow, tokens);
+        }
+    };
+    if (conn.rate > 0) {
+        limit(conn.Available(), conn.rate);
+    }
+    if (b_globalRate > 0) {
+        limit(b_globalTokens.load(std::memory_order_relaxed), b_globalRate);
+    }
+    if (b_perIpRate > 0) {
+        std::lock_guard<std::mutex> locker(b_mutex);
+        IpBucket &bucket = b_ipBuckets.try_emplace(ip, IpBucket{b_perIpRate, 0}).first->second;
+        bucket.idleTicks = 0;
+        limit(bucket.tokens, b_perIpRate);
+    }
+    return static_cast<size_t>(allow);
+}
+
+void BandwidthShaper::Consume(TokenBucket &conn, ip_key_t ip, size_t bytes) {
+    auto n = static_cast<int64_t>(bytes);
+    if (conn.rate > 0) {
+        conn.tokens -= n;
+    }
+    if (b_globalRate > 0) {
+        b_globalTokens.fetch_sub(n, std::memory_order_relaxed);
+    }
+    if (b_perIpRate > 0) {
+        std::lock_guard<std::mutex> locker(b_mutex);
+        auto it = b_ipBuckets.find(ip);
+        if (it != b_ipBuckets.end()) {
+            it->second.tokens -= n;
+        }
+    }
+}
+
+void BandwidthShaper::Refill() {
+    if (b_globalRate > 0) {
+        int64_t inc = b_globalRate * REFILL_MS / 1000;
+        int64_t cur = b_globalTokens.load(std::memory_order_relaxed);
+        while (!b_globalTokens.compare_exchange_weak(cur, std::min(b_globalRate, cur + inc),
+                                                     std::memory_order_relaxed)) {}
+    }
+    if (b_perIpRate > 0) {
+        int64_t inc = b_perIpRate * REFILL_MS / 1000;
+        std::lock_guard<std::mutex> locker(b_mutex);
+        for (auto it = b_ipBuckets.begin(); it != b_ipBuckets.end();) {
+            IpBucket &bucket = it->second;
+            bucket.tokens = std::min(b_perIpRate, bucket.tokens + inc);
+            if (bucket.tokens == b_perIpRate && ++bucket.idleTicks > IP_IDLE_TICKS) {
+                it = b_ipBuckets.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+int BandwidthShaper::WaitMs(int64_t tokens, int64_t need, int64_t rate) {
+    int64_t ms = (need - tokens) * 1000 / rate + 1;
+    return static_cast<int>(std::min<int64_t>(ms, 1000));
+}
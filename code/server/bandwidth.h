@@ -0,0 +1,67 @@
+#ifndef BANDWIDTH_H
+#define BANDWIDTH_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
+#include <netinet/in.h>
+
+#include "../config/config.h"
+#include "../log/log.h"
+#include "client_limit.h"
+
+// 单连接令牌桶, 只由持有该连接的工作线程访问, 按流逝时间补充
+struct TokenBucket {
+    // 响应命中限速规则
+    bool enabled = false;
+    int64_t rate = 0;
+    int64_t tokens = 0;
+    std::chrono::steady_clock::time_point last;
+
+    void Reset(bool _enabled, int64_t _rate);
+
+    int64_t Available();
+};
+
+// 媒体下载限速: 命中规则的响应同时受单连接, 单 IP 和全局三个令牌桶约束
+// 单 IP 和全局令牌由服务器定时器补充, 页面等未命中规则的响应不受限制
+class BandwidthShaper {
+public:
+    BandwidthShaper(int64_t globalRate, int64_t perIpRate, std::vector<BandwidthRule> rules);
+
+    bool IsOpen() const { return !b_rules.empty(); }
+
+    const BandwidthRule *Match(const std::string &path) const;
+
+    // 返回本次可发送的字节数, 为 0 时 waitMs 给出需要等待的时间
+    size_t Acquire(TokenBucket &conn, ip_key_t ip, size_t want, int *waitMs);
+
+    void Consume(TokenBucket &conn, ip_key_t ip, size_t bytes);
+
+    // 定时器回调, 每 REFILL_MS 补充一次
+    void Refill();
+
+    static const int REFILL_MS = 50;
+
+private:
+    struct IpBucket {
+        int64_t tokens;
+        int idleTicks;
+    };
+
+    static int WaitMs(int64_t tokens, int64_t need, int64_t rate);
+
+    int64_t b_globalRate;
+    int64_t b_perIpRate;
+    std::vector<BandwidthRule> b_rules;
+
+    std::atomic<int64_t> b_globalTokens;
+
+    std::mutex b_mutex;
+    std::unordered_map<ip_key_t, IpBucket> b_ipBuckets;
+};
+
+#endif //BANDWIDTH_H
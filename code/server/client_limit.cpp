@@ -0,0 +1,109 @@
+#include "client_limit.h"
+
+ClientLimiter::ClientLimiter(int maxConns, int requestRate, int requestBurst, int maxEntries) :
+        c_shardMax(std::max(maxEntries, SHARD_NUM) / SHARD_NUM), c_size(0) {
+    Configure(maxConns, requestRate, requestBurst);
+}
+
+void ClientLimiter::Configure(int maxConns, int requestRate, int requestBurst) {
+    c_maxConns.store(std::max(maxConns, 0), std::memory_order_relaxed);
+    c_rate.store(std::max(requestRate, 0), std::memory_order_relaxed);
+    c_burst.store(std::max(requestBurst, requestRate), std::memory_order_relaxed);
+}
+
+bool ClientLimiter::AcquireConn(ip_key_t ip) {
+    int maxConns = c_maxConns.load(std::memory_order_relaxed);
+    if (maxConns <= 0) {
+        return true;
+    }
+    Shard &shard = ShardOf(ip);
+    std::lock_guard<std::mutex> locker(shard.mutex);
+    Entry *entry = Find(shard, ip, Metrics::NowNs());
+    if (!entry) {
+        return true;
+    }
+    if (entry->conns >= maxConns) {
+        return false;
+    }
+    ++entry->conns;
+    return true;
+}
+
+void ClientLimiter::ReleaseConn(ip_key_t ip) {
+    if (c_maxConns.load(std::memory_order_relaxed) <= 0) {
+        return;
+    }
+    Shard &shard = ShardOf(ip);
+    std::lock_guard<std::mutex> locker(shard.mutex);
+    auto it = shard.entries.find(ip);
+    if (it != shard.entries.end() && it->second.conns > 0) {
+        --it->second.conns;
+    }
+}
+
+bool ClientLimiter::AcquireRequest(ip_key_t ip, int cost) {
+    if (c_rate.load(std::memory_order_relaxed) <= 0) {
+        return true;
+    }
+    uint64_t now = Metrics::NowNs();
+    Shard &shard = ShardOf(ip);
+    std::lock_guard<std::mutex> locker(shard.mutex);
+    Entry *entry = Find(shard, ip, now);
+    if (!entry) {
+        return true;
+    }
+    Refill(*entry, now);
+    if (entry->tokens < cost) {
+        return false;
+    }
+    entry->tokens -= cost;
+    return true;
+}
+
+void ClientLimiter::Sweep() {
+    uint64_t now = Metrics::NowNs();
+    size_t removed = 0;
+    for (auto &shard: c_shards) {
+        std::lock_guard<std::mutex> locker(shard.mutex);
+        for (auto it = shard.entries.begin(); it != shard.entries.end();) {
+            Refill(it->second, now);
+            if (it->second.conns == 0 && it->second.tokens >= c_burst.load(std::memory_order_relaxed)) {
+                it = shard.entries.erase(it);
+                ++removed;
+            } else {
+                ++it;
+            }
+        }
+    }
+    if (removed > 0) {
+        c_size.fetch_sub(removed, std::memory_order_relaxed);
+    }
+}
+
+ClientLimiter::Entry *ClientLimiter::Find(Shard &shard, ip_key_t ip, uint64_t now) {
+    auto it = shard.entries.find(ip);
+    if (it != shard.entries.end()) {
+        return &it->second;
+    }
+    if (shard.entries.size() >= c_shardMax) {
+        // 伪造地址的洪泛会填满分片, 先挤掉一条没有连接的记录
+        auto victim = std::find_if(shard.entries.begin(), shard.entries.end(),
+                                   [](const std::pair<const ip_key_t, Entry> &e) { return e.second.conns == 0; });
+        if (victim == shard.entries.end()) {
+            return nullptr;
+        }
+        shard.entries.erase(victim);
+        c_size.fetch_sub(1, std::memory_order_relaxed);
+    }
+    c_size.fetch_add(1, std::memory_order_relaxed);
+    return &shard.entries.emplace(ip, Entry{0, c_burst.load(std::memory_order_relaxed), now}).first->second;
+}
+
+void ClientLimiter::Refill(Entry &entry, uint64_t now) const {
+    if (now > entry.lastNs) {
+        double rate = c_rate.load(std::memory_order_relaxed);
+        double burst = c_burst.load(std::memory_order_relaxed);
+        entry.tokens = std::min(burst, entry.tokens + rate * (now - entry.lastNs) / 1e9);
+        entry.lastNs = now;
+    }
+}
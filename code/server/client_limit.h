@@ -0,0 +1,76 @@
+#ifndef CLIENT_LIMIT_H
+#define CLIENT_LIMIT_H
+
+#include <mutex>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <unordered_map>
+#include <netinet/in.h>
+
+#include "../log/log.h"
+#include "../metrics/metrics.h"
+
+// 单 IP 限制和限速使用的来源键, 由 HttpConn::IpKey 计算:
+// IPv6 为地址的高 64 位 (/64 前缀); IPv4 与 IPv4 映射地址为 ::ffff:a.b.c.d 的低 64 位 0000:ffff:aabb:ccdd,
+// 与之相同的 /64 前缀落在保留的 ::/8 中, 不会与真实的 IPv6 来源混淆
+typedef uint64_t ip_key_t;
+
+// 单 IP 限制: 并发连接数和请求令牌桶
+// 按 IP 哈希分片, 每个分片一把锁, 工作线程之间很少竞争
+class ClientLimiter {
+public:
+    // maxConns/requestRate 为 0 时不做对应的限制, maxEntries 为所有分片记录数的上限
+    ClientLimiter(int maxConns, int requestRate, int requestBurst, int maxEntries);
+
+    // 热加载时调整限制, 已有记录保留
+    void Configure(int maxConns, int requestRate, int requestBurst);
+
+    // 接受连接时调用, 超过单 IP 连接数时返回 false
+    bool AcquireConn(ip_key_t ip);
+
+    void ReleaseConn(ip_key_t ip);
+
+    // 收到请求行后调用, cost 为本次请求消耗的令牌数
+    bool AcquireRequest(ip_key_t ip, int cost);
+
+    // 定时器回调, 回收没有连接且令牌已补满的记录
+    void Sweep();
+
+    size_t Size() const { return c_size.load(std::memory_order_relaxed); }
+
+    static const int SWEEP_MS = 1000;
+
+private:
+    static constexpr int SHARD_BITS = 6;
+    static constexpr int SHARD_NUM = 1 << SHARD_BITS;
+
+    struct Entry {
+        int conns;
+        double tokens;
+        uint64_t lastNs;
+    };
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::unordered_map<ip_key_t, Entry> entries;
+    };
+
+    Shard &ShardOf(ip_key_t ip) {
+        return c_shards[(ip * 0x9e3779b97f4a7c15ull) >> (64 - SHARD_BITS)];
+    }
+
+    // 持有分片锁时调用, 分片已满且无法腾出位置时返回空, 此时不做限制
+    Entry *Find(Shard &shard, ip_key_t ip, uint64_t now);
+
+    void Refill(Entry &entry, uint64_t now) const;
+
+    std::atomic<int> c_maxConns;
+    std::atomic<double> c_rate;
+    std::atomic<double> c_burst;
+    size_t c_shardMax;
+    std::atomic<size_t> c_size;
+    Shard c_shards[SHARD_NUM];
+};
+
+#endif //CLIENT_LIMIT_H
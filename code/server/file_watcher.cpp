@@ -0,0 +1,111 @@
+#include "file_watcher.h"
+
+namespace {
+    const uint32_t WATCH_MASK = IN_CREATE | IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_DELETE |
+                                IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+}
+
+FileWatcher::~FileWatcher() {
+    if (f_fd >= 0) {
+        close(f_fd);
+    }
+}
+
+bool FileWatcher::Init(const std::string &root, const ChangeCallBack &onChange, const ResetCallBack &onReset) {
+    f_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (f_fd < 0) {
+        LOG_ERROR("inotify init error!")
+        return false;
+    }
+    f_root = root;
+    while (f_root.size() > 1 && f_root.back() == '/') {
+        f_root.pop_back();
+    }
+    f_onChange = onChange;
+    f_onReset = onReset;
+    AddWatch("");
+    if (f_dirs.empty()) {
+        LOG_ERROR("inotify watch %s error!", f_root.c_str())
+        close(f_fd);
+        f_fd = -1;
+        return false;
+    }
+    LOG_INFO("FileWatcher: %s, dirs:%d", f_root.c_str(), (int) f_dirs.size())
+    return true;
+}
+
+void FileWatcher::AddWatch(const std::string &dir) {
+    std::string fullPath = f_root + dir;
+    int wd = inotify_add_watch(f_fd, fullPath.c_str(), WATCH_MASK);
+    if (wd < 0) {
+        LOG_WARN("inotify watch %s error:%d", fullPath.c_str(), errno)
+        return;
+    }
+    f_dirs[wd] = dir;
+
+    DIR *dp = opendir(fullPath.c_str());
+    if (!dp) { return; }
+    while (struct dirent *ent = readdir(dp)) {
+        if (ent->d_type != DT_DIR && ent->d_type != DT_UNKNOWN) { continue; }
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) { continue; }
+        // DT_UNKNOWN 时交给 IN_ONLYDIR 判断是否为目录
+        AddWatch(dir + "/" + ent->d_name);
+    }
+    closedir(dp);
+}
+
+void FileWatcher::Rescan() {
+    for (const auto &it: f_dirs) {
+        inotify_rm_watch(f_fd, it.first);
+    }
+    f_dirs.clear();
+    AddWatch("");
+    f_onReset();
+}
+
+void FileWatcher::HandleEvents() {
+    alignas(struct inotify_event) char buff[8192];
+    bool reset = false, overflow = false;
+    while (true) {
+        ssize_t len = read(f_fd, buff, sizeof(buff));
+        if (len <= 0) { break; }
+        for (char *ptr = buff; ptr < buff + len;) {
+            const auto *event = reinterpret_cast<const struct inotify_event *>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                // 事件丢失, 只能全部重建
+                overflow = true;
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                f_dirs.erase(event->wd);
+                continue;
+            }
+            auto it = f_dirs.find(event->wd);
+            if (it == f_dirs.end()) { continue; }
+            std::string path = it->second;
+            if (event->len > 0) {
+                path += "/";
+                path += event->name;
+            }
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                reset = true;
+            } else if (event->mask & IN_ISDIR) {
+                // 目录变化影响整棵子树, 新目录需要补充监视
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    AddWatch(path);
+                }
+                reset = true;
+            } else {
+                LOG_DEBUG("FileWatcher change: %s", path.c_str())
+                f_onChange(path);
+            }
+        }
+    }
+    if (overflow) {
+        LOG_WARN("inotify queue overflow, rescan %s", f_root.c_str())
+        Rescan();
+    } else if (reset) {
+        f_onReset();
+    }
+}
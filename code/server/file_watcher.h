@@ -0,0 +1,42 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <string>
+#include <functional>
+#include <unordered_map>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "../log/log.h"
+
+typedef std::function<void(const std::string &)> ChangeCallBack;
+typedef std::function<void()> ResetCallBack;
+
+// 递归监视资源目录, inotify fd 注册到 Epoller 中由事件循环处理
+// 路径以相对根目录的形式回调, 如 "/css/style.css"
+class FileWatcher {
+public:
+    FileWatcher() : f_fd(-1) {}
+
+    ~FileWatcher();
+
+    bool Init(const std::string &root, const ChangeCallBack &onChange, const ResetCallBack &onReset);
+
+    int GetFd() const { return f_fd; }
+
+    void HandleEvents();
+
+private:
+    void AddWatch(const std::string &dir);
+
+    void Rescan();
+
+    int f_fd;
+    std::string f_root;
+    ChangeCallBack f_onChange;
+    ResetCallBack f_onReset;
+    std::unordered_map<int, std::string> f_dirs;
+};
+
+#endif //FILE_WATCHER_H
@@ -0,0 +1,46 @@
+#include "keep_alive.h"
+
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <unistd.h>
+
+KeepAlivePolicy::KeepAlivePolicy(int timeoutMs, int minTimeoutMs, int lowWater, int highWater, int memHighMB) :
+        k_lowWater(lowWater > 0 ? lowWater : INT_MAX),
+        k_highWater(highWater > 0 ? std::max(highWater, k_lowWater) : INT_MAX),
+        k_memHigh(memHighMB > 0 ? static_cast<size_t>(memHighMB) << 20 : 0), k_rss(0), k_level(0) {
+    int minMs = std::max(1, std::min(minTimeoutMs > 0 ? minTimeoutMs : timeoutMs, timeoutMs));
+    k_timeoutMs[0] = timeoutMs;
+    // 中间档取几何平均, 两端相差很大时也能平滑过渡
+    k_timeoutMs[1] = static_cast<int>(std::sqrt(static_cast<double>(timeoutMs) * minMs));
+    k_timeoutMs[2] = minMs;
+}
+
+bool KeepAlivePolicy::Update(int conns, bool sampleMem) {
+    int level = conns >= k_highWater ? 2 : conns >= k_lowWater ? 1 : 0;
+    if (k_memHigh > 0) {
+        if (sampleMem) { k_rss = ReadRss(); }
+        if (k_rss >= k_memHigh) {
+            level = 2;
+        } else if (k_rss >= k_memHigh / 4 * 3) {
+            level = std::max(level, 1);
+        }
+    }
+    if (level == k_level || (level < k_level && !sampleMem)) {
+        return false;
+    }
+    LOG_INFO("Keep-alive timeout %d ms -> %d ms, conns: %d, rss: %d MB",
+             k_timeoutMs[k_level], k_timeoutMs[level], conns, (int) (k_rss >> 20))
+    bool shorter = level > k_level;
+    k_level = level;
+    return shorter;
+}
+
+size_t KeepAlivePolicy::ReadRss() {
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (!fp) { return 0; }
+    unsigned long size = 0, resident = 0;
+    int ret = fscanf(fp, "%lu %lu", &size, &resident);
+    fclose(fp);
+    return ret == 2 ? resident * static_cast<size_t>(sysconf(_SC_PAGESIZE)) : 0;
+}
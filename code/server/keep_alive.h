@@ -0,0 +1,38 @@
+#ifndef KEEP_ALIVE_H
+#define KEEP_ALIVE_H
+
+#include <algorithm>
+#include <cstddef>
+
+#include "../log/log.h"
+
+// 自适应空闲超时: 连接数或常驻内存超过水位时缩短长连接的空闲超时
+// 共三档: timeoutMs, 中间档, minTimeoutMs
+class KeepAlivePolicy {
+public:
+    KeepAlivePolicy(int timeoutMs, int minTimeoutMs, int lowWater, int highWater, int memHighMB);
+
+    // 只由事件循环线程调用. 档位上升立即生效, 下降只在 sampleMem 的周期采样时进行
+    // 返回空闲超时是否变短, 变短时调用方需要收紧已有连接的定时器
+    bool Update(int conns, bool sampleMem);
+
+    int TimeoutMs() const { return k_timeoutMs[k_level]; }
+
+    int Level() const { return k_level; }
+
+    size_t Rss() const { return k_rss; }
+
+    static const int LEVEL_NUM = 3;
+
+private:
+    static size_t ReadRss();
+
+    int k_timeoutMs[LEVEL_NUM];
+    int k_lowWater;
+    int k_highWater;
+    size_t k_memHigh;
+    size_t k_rss;
+    int k_level;
+};
+
+#endif //KEEP_ALIVE_H
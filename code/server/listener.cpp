@@ -0,0 +1,122 @@
+#include "listener.h"
+
+#include <cstring>
+#include <cstddef>
+
+Listener::Listener(const ListenerConfig &config) : l_config(config), l_addr{}, l_addrLen(0), l_fd(-1) {
+    if (!Parse(config.address, &l_addr, &l_addrLen)) {
+        l_addrLen = 0;
+    }
+}
+
+bool Listener::Parse(const std::string &address, sockaddr_storage *addr, socklen_t *len) {
+    static const std::string UNIX_PREFIX = "unix:";
+    if (address.compare(0, UNIX_PREFIX.size(), UNIX_PREFIX) == 0) {
+        auto *un = reinterpret_cast<sockaddr_un *>(addr);
+        std::string path = address.substr(UNIX_PREFIX.size());
+        if (path.empty() || path.size() >= sizeof(un->sun_path)) { return false; }
+        un->sun_family = AF_UNIX;
+        memcpy(un->sun_path, path.c_str(), path.size() + 1);
+        *len = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size() + 1);
+        return true;
+    }
+
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) { return false; }
+    std::string host = address.substr(0, colon);
+    int port = atoi(address.c_str() + colon + 1);
+    if (port <= 0 || port > 65535) { return false; }
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+        auto *in6 = reinterpret_cast<sockaddr_in6 *>(addr);
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(port);
+        *len = sizeof(sockaddr_in6);
+        return inet_pton(AF_INET6, host.substr(1, host.size() - 2).c_str(), &in6->sin6_addr) == 1;
+    }
+    auto *in = reinterpret_cast<sockaddr_in *>(addr);
+    in->sin_family = AF_INET;
+    in->sin_port = htons(port);
+    *len = sizeof(sockaddr_in);
+    return inet_pton(AF_INET, host.c_str(), &in->sin_addr) == 1;
+}
+
+bool Listener::Match(int fd) const {
+    int listening = 0;
+    socklen_t optLen = sizeof(listening);
+    sockaddr_storage addr{};
+    socklen_t len = sizeof(addr);
+    if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &optLen) < 0 || !listening ||
+        getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len) < 0 || addr.ss_family != l_addr.ss_family) {
+        return false;
+    }
+    switch (addr.ss_family) {
+        case AF_INET: {
+            auto *a = reinterpret_cast<const sockaddr_in *>(&addr);
+            auto *b = reinterpret_cast<const sockaddr_in *>(&l_addr);
+            return a->sin_port == b->sin_port && a->sin_addr.s_addr == b->sin_addr.s_addr;
+        }
+        case AF_INET6: {
+            auto *a = reinterpret_cast<const sockaddr_in6 *>(&addr);
+            auto *b = reinterpret_cast<const sockaddr_in6 *>(&l_addr);
+            return a->sin6_port == b->sin6_port && memcmp(&a->sin6_addr, &b->sin6_addr, sizeof(in6_addr)) == 0;
+        }
+        case AF_UNIX:
+            return strcmp(reinterpret_cast<const sockaddr_un *>(&addr)->sun_path,
+                          reinterpret_cast<const sockaddr_un *>(&l_addr)->sun_path) == 0;
+        default:
+            return false;
+    }
+}
+
+bool Listener::Open(std::vector<int> &inherited, bool openLinger) {
+    for (auto it = inherited.begin(); it != inherited.end(); ++it) {
+        if (Match(*it)) {
+            // 升级前的进程留下的套接字, 期间到达的连接都在它的队列里
+            l_fd = *it;
+            inherited.erase(it);
+            LOG_INFO("Listen %s, inherited fd %d", l_config.address.c_str(), l_fd)
+            return true;
+        }
+    }
+
+    l_fd = socket(l_addr.ss_family, SOCK_STREAM, 0);
+    if (l_fd < 0) {
+        LOG_ERROR("Create socket %s error!", l_config.address.c_str())
+        return false;
+    }
+    bool ok = true;
+    if (IsUnix()) {
+        // 上次退出留下的套接字文件
+        unlink(reinterpret_cast<const sockaddr_un *>(&l_addr)->sun_path);
+    } else {
+        struct linger optLinger = {0};
+        if (openLinger) {
+            // 优雅关闭: 直到所剩数据发送完毕或超时
+            optLinger.l_onoff = 1;
+            optLinger.l_linger = 1;
+        }
+        int optVal = 1;
+        ok = setsockopt(l_fd, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger)) == 0 &&
+             setsockopt(l_fd, SOL_SOCKET, SO_REUSEADDR, &optVal, sizeof(optVal)) == 0;
+        if (ok && l_addr.ss_family == AF_INET6) {
+            // 与同端口的 IPv4 监听共存
+            ok = setsockopt(l_fd, IPPROTO_IPV6, IPV6_V6ONLY, &optVal, sizeof(optVal)) == 0;
+        }
+    }
+    if (!ok || bind(l_fd, reinterpret_cast<const sockaddr *>(&l_addr), l_addrLen) < 0 ||
+        listen(l_fd, l_config.backlog) < 0) {
+        LOG_ERROR("Listen %s error: %s", l_config.address.c_str(), strerror(errno))
+        Close();
+        return false;
+    }
+    LOG_INFO("Listen %s, backlog: %d, client limit: %s, tls: %s", l_config.address.c_str(), l_config.backlog,
+             l_config.clientLimit ? "on" : "off", l_config.tls ? "on" : "off")
+    return true;
+}
+
+void Listener::Close() {
+    if (l_fd >= 0) {
+        close(l_fd);
+        l_fd = -1;
+    }
+}
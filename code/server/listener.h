@@ -0,0 +1,51 @@
+#ifndef LISTENER_H
+#define LISTENER_H
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "../log/log.h"
+#include "../config/config.h"
+
+// 一个监听套接字: IPv4/IPv6 TCP 或 AF_UNIX 流套接字, 各自带有接入策略
+class Listener {
+public:
+    explicit Listener(const ListenerConfig &config);
+
+    // 地址格式错误时为 false
+    bool IsValid() const { return l_addrLen > 0; }
+
+    // 优先使用 inherited 中监听在同一地址上的套接字, 并从中移除, 否则新建
+    bool Open(std::vector<int> &inherited, bool openLinger);
+
+    void Close();
+
+    int GetFd() const { return l_fd; }
+
+    const std::string &GetAddress() const { return l_config.address; }
+
+    bool IsClientLimit() const { return l_config.clientLimit; }
+
+    bool IsUnix() const { return l_addr.ss_family == AF_UNIX; }
+
+    bool IsTls() const { return l_config.tls; }
+
+private:
+    static bool Parse(const std::string &address, sockaddr_storage *addr, socklen_t *len);
+
+    // fd 是否是监听在本地址上的套接字
+    bool Match(int fd) const;
+
+    ListenerConfig l_config;
+    sockaddr_storage l_addr;
+    socklen_t l_addrLen;
+    int l_fd;
+};
+
+#endif //LISTENER_H
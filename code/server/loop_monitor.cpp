@@ -0,0 +1,116 @@
+#include "loop_monitor.h"
+
+const char *LoopMonitor::PHASE_NAME[PHASE_NUM] = {
+        "epoll_wait", "timer", "listen", "signal", "loop_tasks", "watcher", "conn",
+};
+
+LoopMonitor::LoopMonitor(int stallMs) :
+        l_stallMs(stallMs), l_phase(PHASE_TIMER), l_busyStart(Metrics::NowNs()), l_waitStart(0),
+        l_waitNs(0), l_busyNs(0), l_wakeups(0), l_events(0), l_lastEvents(0),
+        l_timerCallbacks(0), l_stalls(0), l_stop(false) {}
+
+void LoopMonitor::Start() {
+    l_busyStart.store(Metrics::NowNs(), std::memory_order_relaxed);
+    if (l_stallMs > 0 && !l_watchdog.joinable()) {
+        l_watchdog = std::thread([this] { Watch(); });
+    }
+}
+
+LoopMonitor::~LoopMonitor() {
+    {
+        std::lock_guard<std::mutex> locker(l_mutex);
+        l_stop = true;
+    }
+    l_cond.notify_all();
+    if (l_watchdog.joinable()) {
+        l_watchdog.join();
+    }
+}
+
+void LoopMonitor::TimerFired(int cnt) {
+    if (cnt <= 0) { return; }
+    Add(l_timerCallbacks, cnt);
+    l_maxTimerCallbacks.Update(cnt, Metrics::NowNs());
+}
+
+void LoopMonitor::BeginWait() {
+    uint64_t now = Metrics::NowNs();
+    uint64_t busy = now - l_busyStart.load(std::memory_order_relaxed);
+    Add(l_busyNs, busy);
+    l_maxBusyNs.Update(busy, now);
+    Metrics::Record(HIST_LOOP_BUSY, busy);
+    l_waitStart = now;
+    Enter(PHASE_WAIT);
+}
+
+void LoopMonitor::EndWait(int eventCnt) {
+    uint64_t now = Metrics::NowNs();
+    Add(l_waitNs, now - l_waitStart);
+    Add(l_wakeups, 1);
+    l_lastEvents.store(eventCnt, std::memory_order_relaxed);
+    if (eventCnt > 0) {
+        Add(l_events, eventCnt);
+        l_maxEvents.Update(eventCnt, now);
+    }
+    l_busyStart.store(now, std::memory_order_relaxed);
+    Enter(PHASE_TIMER);
+}
+
+void LoopMonitor::Export() {
+    auto *metrics = Metrics::Instance();
+    auto load = [](const std::atomic<uint64_t> &v) { return static_cast<double>(v.load(std::memory_order_relaxed)); };
+    metrics->AddGaugeFunc("tws_loop_wait_seconds_total", [this, load] { return load(l_waitNs) / 1e9; });
+    metrics->AddGaugeFunc("tws_loop_busy_seconds_total", [this, load] { return load(l_busyNs) / 1e9; });
+    // 最大值取最近 10 到 20 秒的窗口, 读取不清零
+    metrics->AddGaugeFunc("tws_loop_max_iteration_seconds",
+                          [this] { return l_maxBusyNs.Get(Metrics::NowNs()) / 1e9; });
+    metrics->AddGaugeFunc("tws_loop_wakeups_total", [this, load] { return load(l_wakeups); });
+    metrics->AddGaugeFunc("tws_loop_events_total", [this, load] { return load(l_events); });
+    metrics->AddGaugeFunc("tws_loop_max_events_per_wakeup",
+                          [this] { return static_cast<double>(l_maxEvents.Get(Metrics::NowNs())); });
+    metrics->AddGaugeFunc("tws_loop_timer_callbacks_total", [this, load] { return load(l_timerCallbacks); });
+    metrics->AddGaugeFunc("tws_loop_max_timer_callbacks_per_tick",
+                          [this] { return static_cast<double>(l_maxTimerCallbacks.Get(Metrics::NowNs())); });
+    metrics->AddGaugeFunc("tws_loop_stalls_total", [this, load] { return load(l_stalls); });
+}
+
+void LoopMonitor::WindowMax::Update(uint64_t value, uint64_t now) {
+    uint64_t begin = start.load(std::memory_order_relaxed);
+    if (now - begin >= WINDOW_NS) {
+        // 跨过了两个以上窗口时上一个窗口没有数据
+        prev.store(now - begin >= 2 * WINDOW_NS ? 0 : cur.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        cur.store(0, std::memory_order_relaxed);
+        start.store(now, std::memory_order_relaxed);
+    }
+    if (value > cur.load(std::memory_order_relaxed)) {
+        cur.store(value, std::memory_order_relaxed);
+    }
+}
+
+uint64_t LoopMonitor::WindowMax::Get(uint64_t now) const {
+    // 事件循环长时间没有更新时, 按已经过去的窗口处理
+    uint64_t age = now - start.load(std::memory_order_relaxed);
+    if (age >= 2 * WINDOW_NS) { return 0; }
+    uint64_t value = cur.load(std::memory_order_relaxed);
+    return age >= WINDOW_NS ? value : std::max(value, prev.load(std::memory_order_relaxed));
+}
+
+void LoopMonitor::Watch() {
+    const uint64_t stallNs = static_cast<uint64_t>(l_stallMs) * 1000000;
+    const auto interval = std::chrono::milliseconds(std::max(l_stallMs / 2, 10));
+    uint64_t reported = 0;
+    std::unique_lock<std::mutex> locker(l_mutex);
+    while (!l_cond.wait_for(locker, interval, [this] { return l_stop; })) {
+        int phase = l_phase.load(std::memory_order_relaxed);
+        uint64_t start = l_busyStart.load(std::memory_order_relaxed);
+        if (phase == PHASE_WAIT || start == reported) { continue; }
+        uint64_t busy = Metrics::NowNs() - start;
+        if (busy < stallNs) { continue; }
+        // 同一轮只报告一次
+        reported = start;
+        Add(l_stalls, 1);
+        LOG_WARN("Event loop stall: %d ms in %s, %d events last wakeup",
+                 static_cast<int>(busy / 1000000), PHASE_NAME[phase],
+                 l_lastEvents.load(std::memory_order_relaxed))
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef LOOP_MONITOR_H
+#define LOOP_MONITOR_H
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "../log/log.h"
+#include "../metrics/metrics.h"
+
+// 事件循环监控: 统计 epoll_wait 与处理耗时, 每次唤醒的事件数和定时器回调数
+// 计数只由事件循环线程写入, 看门狗线程发现单轮处理超过阈值时记录当前阶段
+class LoopMonitor {
+public:
+    enum Phase {
+        PHASE_WAIT,
+        PHASE_TIMER,
+        PHASE_LISTEN,
+        PHASE_SIGNAL,
+        PHASE_TASKS,
+        PHASE_WATCHER,
+        PHASE_CONN,
+        PHASE_NUM,
+    };
+
+    explicit LoopMonitor(int stallMs);
+
+    ~LoopMonitor();
+
+    // 事件循环开始时调用, 从这里开始计时并启动看门狗; stallMs 为 0 时不启动
+    // 启动前的初始化 (连接数据库, 加载资源包等) 不计入
+    void Start();
+
+    void Enter(Phase phase) { l_phase.store(phase, std::memory_order_relaxed); }
+
+    void TimerFired(int cnt);
+
+    void BeginWait();
+
+    void EndWait(int eventCnt);
+
+    // 注册到 Metrics
+    void Export();
+
+private:
+    // 最近一到两个窗口内的最大值: 只由事件循环线程更新, 读取不改变状态, 多个采集方互不影响
+    struct WindowMax {
+        static constexpr uint64_t WINDOW_NS = 10ull * 1000000000;
+
+        void Update(uint64_t value, uint64_t now);
+
+        uint64_t Get(uint64_t now) const;
+
+        std::atomic<uint64_t> start{0};
+        std::atomic<uint64_t> cur{0};
+        std::atomic<uint64_t> prev{0};
+    };
+
+    static void Add(std::atomic<uint64_t> &counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    void Watch();
+
+    static const char *PHASE_NAME[PHASE_NUM];
+
+    int l_stallMs;
+    std::atomic<int> l_phase;
+    // 本轮处理开始时间, 看门狗据此判断是否卡住
+    std::atomic<uint64_t> l_busyStart;
+    uint64_t l_waitStart;
+
+    std::atomic<uint64_t> l_waitNs;
+    std::atomic<uint64_t> l_busyNs;
+    WindowMax l_maxBusyNs;
+    std::atomic<uint64_t> l_wakeups;
+    std::atomic<uint64_t> l_events;
+    WindowMax l_maxEvents;
+    std::atomic<int> l_lastEvents;
+    std::atomic<uint64_t> l_timerCallbacks;
+    WindowMax l_maxTimerCallbacks;
+    std::atomic<uint64_t> l_stalls;
+
+    bool l_stop;
+    std::mutex l_mutex;
+    std::condition_variable l_cond;
+    std::thread l_watchdog;
+};
+
+#endif //LOOP_MONITOR_H
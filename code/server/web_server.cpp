@@ -1,40 +1,269 @@
 #include "web_server.h"
 
-WebServer::WebServer(
-        int port, int trigMode, int timeoutMS, bool optLinger,
-        int sqlPort, const char *sqlUser, const char *sqlPwd,
-        const char *dbName, int connPoolNum, int threadNum,
-        bool openLog, int logLevel, int logQueSize) :
-        w_port(port), w_openLinger(optLinger), w_timeoutMs(timeoutMS), w_shutdown(false),
-        w_timer(new Timer()), w_threadPool(new ThreadPool(threadNum)), w_epoller(new Epoller()) {
+WebServer::WebServer(const std::shared_ptr<const Config> &config) :
+        w_config(config), w_bootConfig(config),
+        w_port(config->port), w_openLinger(config->optLinger), w_timeoutMs(config->timeoutMs),
+        w_shutdown(false), w_draining(false), w_drainDeadlineNs(0), w_childPid(0), w_parentPid(0),
+        w_signalFd(InitSignal()),
+        w_timer(new Timer()),
+        w_threadPool(new ThreadPool(config->threadNum, config->threadMax, config->threadTargetWaitMs,
+                                    config->threadIdleMs, config->workerCpus)),
+        w_epoller(new Epoller()),
+        w_ioPool(config->ioThreadNum > 0 ? new ThreadPool(config->ioThreadNum) : nullptr),
+        w_dbPool(config->dbThreadNum > 0 ? new ThreadPool(config->dbThreadNum) : nullptr),
+        w_loopCpus(config->loopCpus), w_numaAware(!config->workerCpus.empty()),
+        w_busyPoll(config->busyPoll), w_spinMaxNs(static_cast<uint64_t>(std::max(config->busyPollSpinUs, 1)) * 1000),
+        w_spinNs(w_spinMaxNs), w_busyPollSocketUs(config->busyPollSocketUs),
+        w_eventFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), w_monitor(new LoopMonitor(config->loopStallMs)) {
     w_srcDir = getcwd(nullptr, 256);
     assert(w_srcDir);
     strncat(w_srcDir, "/resources/", 16);
     HttpConn::userCount = 0;
     HttpConn::srcDir = w_srcDir;
-    SqlConnPool::Instance()->Init("localhost", sqlPort, sqlUser, sqlPwd, dbName, connPoolNum);
+    HttpConn::isCheckResident = static_cast<bool>(w_ioPool);
+    HttpConn::writeQuantum = config->writeQuantum > 0 ? config->writeQuantum : 0;
+    HttpConn::metricsPath = config->metricsPath;
+    HttpConn::isHttp2 = config->http2;
+    Http2Session::maxStreams = config->http2MaxStreams;
+    HttpConn::wsPath = config->wsPath;
+    HttpConn::wsRelay = config->wsRelay;
+    WebSocket::maxMessageSize = std::max(config->wsMaxMessage, 1);
+    WebSocket::maxQueueBytes = std::max(config->wsMaxQueue, 1);
+    WebSocket::arm = [this](int fd, bool isWrite) {
+        w_epoller->ModFd(fd, w_connEvent | (isWrite ? EPOLLOUT : EPOLLIN));
+    };
+    SqlConnPool::Instance()->Init("localhost", config->sqlPort, config->sqlUser.c_str(), config->sqlPwd.c_str(),
+                                  config->dbName.c_str(), config->connPoolNum);
+    ResponseCache::Instance()->Init(config->cacheMaxFileSize > 0 ? config->cacheMaxFileSize : 0);
+    for (int code: {503, 429}) {
+        Buffer buff;
+        char retry[16];
+        ResponseHeader::AppendStatusLine(buff, code);
+        ResponseHeader::AppendConnection(buff, false);
+        size_t len = ResponseHeader::FormatUInt(retry, std::max(config->retryAfter, 1));
+        ResponseHeader::AppendField(buff, "Retry-After", std::string_view(retry, len));
+        ResponseHeader::AppendContentLength(buff, 0);
+        (code == 503 ? w_unavailable : w_tooMany) = buff.RetrieveAllToStr();
+    }
+    if (config->ipMaxConns > 0 || config->ipRequestRate > 0) {
+        w_limiter.reset(new ClientLimiter(config->ipMaxConns, config->ipRequestRate, config->ipRequestBurst,
+                                          config->ipMaxEntries));
+        SweepClients();
+        HttpConn::admitStream = [this](ip_key_t ip, bool isDbRequest) -> const std::string * {
+            int cost = isDbRequest ? std::max(Snapshot()->ipDbCost, 1) : 1;
+            return w_limiter->AcquireRequest(ip, cost) ? nullptr : &w_tooMany;
+        };
+    }
+    if (w_dbPool) {
+        HttpConn::dispatchDbStream = [this](HttpConn *client, uint32_t streamId, std::string &&request) {
+            return DispatchDbStream(client, streamId, std::move(request));
+        };
+    }
+    if (config->admitMaxLimit > 0) {
+        w_admission.reset(new AdmissionControl(config->admitMinLimit, config->admitMaxLimit, config->admitTargetMs));
+    }
+    LoadLiveConfig(*config);
+    if (w_keepAlive) {
+        SampleKeepAlive();
+    }
 
-    InitEventMode(trigMode);
-    if (!InitSocket()) { w_shutdown = true; }
+    InitEventMode(config->trigMode);
+    if (!InitSocket(*config)) { w_shutdown = true; }
+    if (w_signalFd < 0 || !w_epoller->AddFd(w_signalFd, EPOLLIN)) { w_shutdown = true; }
+    if (w_eventFd < 0 || !w_epoller->AddFd(w_eventFd, EPOLLIN)) { w_shutdown = true; }
 
-    if (openLog) {
-        Log::Instance()->Init(logLevel, "./log", ".log", logQueSize);
+    if (config->openLog) {
+        Log::Instance()->Init(config->logLevel, "./log", ".log", config->logQueSize);
+        std::thread *logThread = Log::Instance()->GetWriteThread();
+        if (logThread && !config->logCpus.empty() && !CpuAffinity::Pin(logThread->native_handle(), config->logCpus)) {
+            LOG_WARN("Log thread pin cpu error!")
+        }
+    }
+    bool hasTls = std::any_of(config->listeners.begin(), config->listeners.end(),
+                              [](const ListenerConfig &listener) { return listener.tls; });
+    if (hasTls && !TlsContext::Instance()->Init(config->tlsCertFile, config->tlsKeyFile, config->tlsSessionCacheSize,
+                                                config->tlsSessionTimeoutSec, config->tlsKtls, config->http2)) {
+        w_shutdown = true;
+    }
+    if (!config->bundlePath.empty() && !Bundle::Instance()->Load(config->bundlePath, config->bundlePopulate)) {
+        w_shutdown = true;
+    }
+    if (config->fileCacheEntries > 0 && !InitWatcher(config->fileCacheEntries)) {
+        LOG_WARN("FileWatcher init failed, FileCache disabled")
+    }
+    if (!HttpConn::metricsPath.empty()) {
+        Metrics::Instance()->AddGaugeFunc("tws_connections", [] { return HttpConn::userCount.load(); });
+        Metrics::Instance()->AddGaugeFunc("tws_sql_free_connections",
+                                          [] { return SqlConnPool::Instance()->GetFreeConnCount(); });
+        w_monitor->Export();
+        Metrics::Instance()->AddGaugeFunc("tws_pool_threads", [this] { return w_threadPool->ThreadCount(); });
+        Metrics::Instance()->AddGaugeFunc("tws_pool_idle_threads", [this] { return w_threadPool->IdleCount(); });
+        if (w_limiter) {
+            Metrics::Instance()->AddGaugeFunc("tws_client_limit_entries", [this] { return w_limiter->Size(); });
+        }
+        if (!HttpConn::wsPath.empty()) {
+            Metrics::Instance()->AddGaugeFunc("tws_websocket_clients", [] { return WebSocketHub::Instance()->Size(); });
+        }
+        if (w_keepAlive) {
+            Metrics::Instance()->AddGaugeFunc("tws_keepalive_timeout_seconds",
+                                              [] { return HttpResponse::keepAliveSec.load(); });
+        }
+        if (w_admission) {
+            Metrics::Instance()->AddGaugeFunc("tws_admission_limit", [this] { return w_admission->Limit(); });
+            Metrics::Instance()->AddGaugeFunc("tws_admission_in_flight", [this] { return w_admission->InFlight(); });
+        }
+    }
+    if (!config->bwRules.empty()) {
+        w_shaper.reset(new BandwidthShaper(config->bwGlobalRate, config->bwPerIpRate, config->bwRules));
+        if (config->bwGlobalRate > 0 || config->bwPerIpRate > 0) {
+            RefillBandwidth();
+        }
+    }
+    if (config->openLog) {
         if (w_shutdown) { LOG_ERROR("========== Server Init error!==========") }
         else {
             LOG_INFO("========== Server Init ==========")
-            LOG_INFO("Port:%d, OpenLinger: %s", w_port, optLinger ? "true" : "false")
+            LOG_INFO("Port:%d, OpenLinger: %s", w_port, config->optLinger ? "true" : "false")
+            for (const auto &listener: w_listeners) {
+                LOG_INFO("Listen: %s, fd: %d, client limit: %s, tls: %s", listener.GetAddress().c_str(),
+                         listener.GetFd(), listener.IsClientLimit() ? "on" : "off", listener.IsTls() ? "on" : "off")
+            }
             LOG_INFO("Listen Mode: %s, OpenConn Mode: %s",
                      (w_listenEvent & EPOLLET ? "ET" : "LT"),
                      (w_connEvent & EPOLLET ? "ET" : "LT"))
-            LOG_INFO("LogSys level: %d", logLevel)
+            LOG_INFO("LogSys level: %d", config->logLevel)
             LOG_INFO("srcDir: %s", HttpConn::srcDir)
-            LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", connPoolNum, threadNum)
+            LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d, IO thread num: %d",
+                     config->connPoolNum, config->threadNum, config->ioThreadNum)
+            LOG_INFO("ThreadPool max: %d, target wait: %d ms, idle: %d ms",
+                     std::max(config->threadNum, config->threadMax), config->threadTargetWaitMs,
+                     config->threadIdleMs)
+            LOG_INFO("CPU pinning: loop %d cpus, workers %d cpus, log %d cpus, NUMA nodes: %d",
+                     (int) config->loopCpus.size(), (int) config->workerCpus.size(), (int) config->logCpus.size(),
+                     CpuAffinity::NodeNum())
+            LOG_INFO("Busy poll: %s, spin: %d us, socket: %d us",
+                     config->busyPoll ? "on" : "off", config->busyPollSpinUs, config->busyPollSocketUs)
+            LOG_INFO("DB lane threads: %d, queue max: %d", config->dbThreadNum, config->dbQueueMax)
+            LOG_INFO("ResponseCache max file size: %d", config->cacheMaxFileSize)
+            LOG_INFO("Write quantum: %d, TCP_NOTSENT_LOWAT: %d", config->writeQuantum, config->notSentLowat)
+            LOG_INFO("HTTP/2: %s, max concurrent streams: %d", config->http2 ? "on" : "off", config->http2MaxStreams)
+            LOG_INFO("WebSocket: %s, ping: %d ms, max message: %d, max queue: %d",
+                     config->wsPath.empty() ? "off" : config->wsPath.c_str(), config->wsPingMs, config->wsMaxMessage,
+                     config->wsMaxQueue)
+            LOG_INFO("Bandwidth rules: %d, global: %d B/s, per ip: %d B/s",
+                     (int) config->bwRules.size(), config->bwGlobalRate, config->bwPerIpRate)
+            LOG_INFO("Bundle: %s", config->bundlePath.empty() ? "off" : config->bundlePath.c_str())
+            LOG_INFO("FileCache entries: %d", FileCache::Instance()->IsOpen() ? config->fileCacheEntries : 0)
+            LOG_INFO("Slow client: header %d ms, min body rate: %d B/s, min send rate: %d B/s, grace: %d ms",
+                     config->headerTimeoutMs, config->minBodyRate, config->minSendRate, config->slowGraceMs)
+            LOG_INFO("Per IP: %d conns, %d req/s, burst: %d, db cost: %d, max entries: %d",
+                     config->ipMaxConns, config->ipRequestRate, config->ipRequestBurst, config->ipDbCost,
+                     config->ipMaxEntries)
+            LOG_INFO("Loop stall threshold: %d ms", config->loopStallMs)
+            LOG_INFO("Keep-alive watermarks: %d/%d conns, %d MB, min timeout: %d ms, max conns: %d",
+                     config->keepAliveLowWater, config->keepAliveHighWater, config->memHighMB,
+                     config->keepAliveMinMs, w_maxConns)
+            LOG_INFO("Admission limit: [%d, %d], target queue: %d ms, deadline: %d ms",
+                     w_admission ? config->admitMinLimit : 0, config->admitMaxLimit, config->admitTargetMs,
+                     config->admitDeadlineMs)
+            LOG_INFO("Trace sample rate: 1/%d, dump: %s", config->traceSampleRate, w_traceFile.c_str())
+            LOG_INFO("Metrics: %s", HttpConn::metricsPath.empty() ? "off" : HttpConn::metricsPath.c_str())
+        }
+    }
+}
+
+void WebServer::LoadLiveConfig(const Config &config) {
+    w_notSentLowat = config.notSentLowat;
+    w_maxConns = config.maxConns > 0 && config.maxConns < MAX_FD ? config.maxConns : MAX_FD;
+    w_headerTimeoutNs = config.headerTimeoutMs > 0 ? static_cast<uint64_t>(config.headerTimeoutMs) * 1000000 : 0;
+    w_minBodyRate = std::max(config.minBodyRate, 0);
+    w_minSendRate = std::max(config.minSendRate, 0);
+    w_slowGraceNs = static_cast<uint64_t>(std::max(config.slowGraceMs, 0)) * 1000000;
+    w_wsPingNs = static_cast<uint64_t>(std::max(config.wsPingMs, 1)) * 1000000;
+    w_slowCheckMs = std::min(config.headerTimeoutMs > 0 ? config.headerTimeoutMs : INT_MAX,
+                             w_minBodyRate > 0 || w_minSendRate > 0 ? std::max(config.slowGraceMs, 1) : INT_MAX);
+    if (w_timeoutMs > 0 && config.timeoutMs > 0) {
+        // 档位重新从最长的一档开始, 由下次采样重新判断
+        w_timeoutMs = config.timeoutMs;
+        w_keepAlive.reset(new KeepAlivePolicy(w_timeoutMs, config.keepAliveMinMs, config.keepAliveLowWater,
+                                              config.keepAliveHighWater, config.memHighMB));
+        HttpResponse::keepAliveSec = std::max(w_keepAlive->TimeoutMs() / 1000, 1);
+    }
+    Tracer::Instance()->Init(config.traceSampleRate, config.traceBufferSize);
+    w_traceFile = config.traceSampleRate > 0 ? config.traceFile : "";
+}
+
+void WebServer::Reload() {
+    // 读文件, 校验和新建数据库连接都在工作线程中进行, 不阻塞事件循环
+    w_threadPool->AddTask([this] {
+        std::string err;
+        std::shared_ptr<const Config> config = Config::Load(Config::PATH, &err);
+        if (!config) {
+            LOG_ERROR("Config reload failed, keep the old one: %s", err.c_str())
+            return;
+        }
+        if (config->connPoolNum != Snapshot()->connPoolNum) {
+            SqlConnPool::Instance()->Resize(config->connPoolNum);
+        }
+        QueueInLoop([this, config] { ApplyConfig(config); });
+    });
+}
+
+void WebServer::ApplyConfig(const std::shared_ptr<const Config> &config) {
+    std::shared_ptr<const Config> before = Snapshot();
+    std::vector<std::string> live, restart, ignored;
+    Config::Diff(*before, *config, live, ignored);
+    // 需要重启的项与启动时的配置比较, 多次热加载后仍能报告
+    Config::Diff(*w_bootConfig, *config, ignored, restart);
+
+    if (before->openLog) {
+        Log::Instance()->SetLevel(config->logLevel);
+    }
+    w_threadPool->SetLimits(config->threadNum, config->threadMax, config->threadTargetWaitMs, config->threadIdleMs);
+    if (w_dbPool && config->dbThreadNum > 0) {
+        w_dbPool->SetLimits(config->dbThreadNum, config->dbThreadNum, 0, 0);
+    }
+    if (w_admission && config->admitMaxLimit > 0) {
+        w_admission->SetLimits(config->admitMinLimit, config->admitMaxLimit, config->admitTargetMs);
+    }
+    if (w_limiter) {
+        // 单 IP 连接数限制的开关需要重启, 否则已有连接没有计数
+        bool sameSwitch = (config->ipMaxConns > 0) == (w_bootConfig->ipMaxConns > 0);
+        w_limiter->Configure(sameSwitch ? config->ipMaxConns : w_bootConfig->ipMaxConns,
+                             config->ipRequestRate, config->ipRequestBurst);
+    }
+    LoadLiveConfig(*config);
+    if (w_keepAlive) {
+        // 空闲超时可能变短, 已有连接按新的超时重新检查
+        for (auto &user: w_users) {
+            if (!user.second.IsClosed()) { w_timer->Shorten(user.first, w_keepAlive->TimeoutMs()); }
         }
     }
+    std::atomic_store(&w_config, config);
+
+    auto join = [](const std::vector<std::string> &names) {
+        std::string res;
+        for (const auto &name: names) {
+            res += res.empty() ? name : ", " + name;
+        }
+        return res;
+    };
+    LOG_INFO("Config reloaded, applied: [%s]", join(live).c_str())
+    if (!restart.empty()) {
+        LOG_WARN("Config changes need a restart: [%s]", join(restart).c_str())
+    }
 }
 
 WebServer::~WebServer() {
-    close(w_listenFd);
+    // 先等工作线程执行完剩余任务, 它们仍会访问连接和事件循环
+    w_threadPool.reset();
+    w_dbPool.reset();
+    w_ioPool.reset();
+    for (auto &listener: w_listeners) {
+        listener.Close();
+    }
+    close(w_signalFd);
+    close(w_eventFd);
     w_shutdown = true;
     free(w_srcDir);
     SqlConnPool::Instance()->ClosePool();
@@ -64,17 +293,45 @@ void WebServer::Start() {
     // epoll wait timeout == -1 无事件将阻塞
     int timeMS = -1;
     if (!w_shutdown) { LOG_INFO("========== Server start ==========") }
+    if (!w_shutdown && w_parentPid > 0 && getppid() == w_parentPid) {
+        // 由升级启动, 已经可以处理请求, 让旧进程开始退出
+        LOG_INFO("Upgrade: take over from pid %d", w_parentPid)
+        kill(w_parentPid, SIGQUIT);
+    }
+    if (!w_loopCpus.empty() && !CpuAffinity::Pin(pthread_self(), w_loopCpus)) {
+        LOG_WARN("Event loop pin cpu error!")
+    }
+    // 看门狗从事件循环开始时计时, 不把启动过程算作卡顿
+    w_monitor->Start();
     while (!w_shutdown) {
-        if (w_timeoutMs > 0) {
-            timeMS = w_timer->GetNextTick();
-        }
-        int eventCnt = w_epoller->Wait(timeMS);
+        w_monitor->Enter(LoopMonitor::PHASE_TIMER);
+        timeMS = w_timer->GetNextTick();
+        w_monitor->TimerFired(w_timer->Expired());
+        Metrics::SetGauge(GAUGE_TIMER_HEAP, w_timer->Size());
+        w_batchClosed.clear();
+        w_monitor->BeginWait();
+        int eventCnt = w_busyPoll ? BusyWait(timeMS) : w_epoller->Wait(timeMS);
+        w_monitor->EndWait(eventCnt);
         for (int i = 0; i < eventCnt; i++) {
             // 处理事件
             int fd = w_epoller->GetEventFd(i);
             uint32_t events = w_epoller->GetEvents(i);
-            if (fd == w_listenFd) {
-                DealListen();
+            w_monitor->Enter(LoopMonitor::PHASE_CONN);
+            if (Listener *listener = FindListener(fd)) {
+                w_monitor->Enter(LoopMonitor::PHASE_LISTEN);
+                DealListen(*listener);
+            } else if (fd == w_signalFd) {
+                w_monitor->Enter(LoopMonitor::PHASE_SIGNAL);
+                DealSignal();
+            } else if (fd == w_eventFd) {
+                w_monitor->Enter(LoopMonitor::PHASE_TASKS);
+                DealLoopTasks();
+            } else if (w_watcher && fd == w_watcher->GetFd()) {
+                w_monitor->Enter(LoopMonitor::PHASE_WATCHER);
+                w_watcher->HandleEvents();
+            } else if (!w_batchClosed.empty() &&
+                       std::find(w_batchClosed.begin(), w_batchClosed.end(), fd) != w_batchClosed.end()) {
+                continue;
             } else if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
                 assert(w_users.count(fd) > 0);
                 CloseConn(&w_users[fd]);
@@ -91,100 +348,783 @@ void WebServer::Start() {
     }
 }
 
-void WebServer::SendError(int fd, const char *info) {
+int WebServer::BusyWait(int timeMS) {
+    uint64_t start = Metrics::NowNs();
+    uint64_t budget = w_spinNs;
+    if (timeMS >= 0) {
+        budget = std::min(budget, static_cast<uint64_t>(timeMS) * 1000000);
+    }
+    for (int spins = 0;; ++spins) {
+        int eventCnt = w_epoller->Wait(0);
+        if (eventCnt != 0) {
+            // 自旋等到了事件, 放宽预算
+            w_spinNs = std::min(w_spinMaxNs, w_spinNs * 2);
+            return eventCnt;
+        }
+        uint64_t spun = Metrics::NowNs() - start;
+        if (spun >= budget) {
+            w_spinNs = std::max(w_spinMaxNs / SPIN_SHRINK, w_spinNs / 2);
+            if (timeMS >= 0) {
+                timeMS = std::max(0, timeMS - static_cast<int>(spun / 1000000));
+            }
+            return w_epoller->Wait(timeMS);
+        }
+        if (spins >= 64) {
+            // 空转一段时间后让出 CPU, 同核的其他线程可以运行
+            sched_yield();
+        }
+    }
+}
+
+void WebServer::SendReject(int fd, const std::string &response) {
     assert(fd > 0);
-    int ret = send(fd, info, strlen(info), 0);
+    char buff[4096];
+    for (int i = 0; i < 16 && recv(fd, buff, sizeof(buff), MSG_DONTWAIT) > 0; ++i) {}
+    ssize_t ret = send(fd, response.data(), response.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
     if (ret < 0) {
         LOG_WARN("send error to client[%d] error!", fd)
     }
-    close(fd);
+}
+
+void WebServer::RejectConn(HttpConn *client, const std::string &response) {
+    // 已切换协议的连接和用户态加密的 TLS 连接不能直接写 HTTP/1.1 明文, 只关闭
+    if (!client->IsHttp2() && !client->IsWebSocket() && (!client->IsTls() || client->IsKtlsSend())) {
+        SendReject(client->GetFd(), response);
+    }
+    CloseConn(client);
 }
 
 void WebServer::CloseConn(HttpConn *client) {
     assert(client);
+    if (w_limiter && client->IsLimited() && !client->IsClosed()) {
+        w_limiter->ReleaseConn(client->GetIpKey());
+    }
     LOG_INFO("Client[%d] quit!", client->GetFd())
     w_epoller->DelFd(client->GetFd());
     client->Close();
 }
 
-void WebServer::AddClient(int fd, sockaddr_in addr) {
+bool WebServer::CloseIdleConn(HttpConn *client, bool isDrained) {
+    // 与工作线程交还连接互斥, 不会在清除标记和重新注册事件之间关闭; 未派发时读缓冲区也不会被工作线程修改
+    std::lock_guard<std::mutex> locker(client->DispatchMutex());
+    if (client->IsClosed() || client->IsDispatched()) {
+        return false;
+    }
+    int pending = 0;
+    if (isDrained && (client->ToReadBytes() > 0 || client->IsAwaitingDb() ||
+                      ioctl(client->GetFd(), FIONREAD, &pending) != 0 || pending > 0)) {
+        return false;
+    }
+    w_batchClosed.push_back(client->GetFd());
+    CloseConn(client);
+    return true;
+}
+
+void WebServer::AddClient(int fd, const sockaddr_storage &addr, bool isLimited, ssl_st *ssl) {
     assert(fd > 0);
     w_users[fd].Init(fd, addr);
-    if (w_timeoutMs > 0) {
-        w_timer->Add(fd, w_timeoutMs, [this, w_userFd = &w_users[fd]] { CloseConn(w_userFd); });
+    w_users[fd].SetLimited(isLimited);
+    if (ssl) {
+        w_users[fd].InitTls(ssl);
+    }
+    if (w_numaAware) {
+        // 按收包 CPU 的节点分派, 连接缓冲区在 OnRead 中由工作线程重新分配到其节点
+        int cpu = -1;
+        socklen_t len = sizeof(cpu);
+        if (getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0 && cpu >= 0) {
+            w_users[fd].SetNode(CpuAffinity::NodeOf(cpu));
+        }
+    }
+    if (w_keepAlive) {
+        // 握手按头部期限检查
+        int timeoutMs = ssl ? std::min(w_keepAlive->TimeoutMs(), w_slowCheckMs) : w_keepAlive->TimeoutMs();
+        w_timer->Add(fd, timeoutMs, [this, client = &w_users[fd]] { OnTimeout(client); });
     }
     w_epoller->AddFd(fd, EPOLLIN | w_connEvent);
     SetFdNonblock(fd);
+    if (w_busyPoll && w_busyPollSocketUs > 0) {
+        // 读取时在网卡队列上忙等, 需要 CAP_NET_ADMIN 或 net.core.busy_read 允许
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &w_busyPollSocketUs, sizeof(w_busyPollSocketUs));
+#ifdef SO_PREFER_BUSY_POLL
+        int prefer = 1;
+        setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer));
+#endif
+    }
+    if (w_notSentLowat > 0) {
+        // 限制内核中未发送的数据量, 大文件不会一次塞满发送缓冲区
+        setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &w_notSentLowat, sizeof(w_notSentLowat));
+    }
     LOG_INFO("Client[%d] in!", w_users[fd].GetFd())
 }
 
-void WebServer::DealListen() {
-    struct sockaddr_in addr{};
-    socklen_t len = sizeof(addr);
+void WebServer::DealListen(const Listener &listener) {
+    struct sockaddr_storage addr{};
+    socklen_t len;
     do {
-        int fd = accept(w_listenFd, (struct sockaddr *) &addr, &len);
+        len = sizeof(addr);
+        int fd = accept(listener.GetFd(), (struct sockaddr *) &addr, &len);
         if (fd <= 0) { return; }
-        else if (HttpConn::userCount >= MAX_FD) {
-            SendError(fd, "Server busy!");
+        else if (HttpConn::userCount >= w_maxConns && !EvictIdle()) {
+            Metrics::Add(CONN_REJECT);
+            if (!listener.IsTls()) { SendReject(fd, w_unavailable); }
+            close(fd);
             LOG_WARN("Clients is Full!")
             return;
         }
-        AddClient(fd, addr);
+        // 同机代理的 AF_UNIX 连接没有客户端地址, 不做单 IP 限制
+        bool isLimited = w_limiter && listener.IsClientLimit() && !listener.IsUnix();
+        if (isLimited && !w_limiter->AcquireConn(HttpConn::IpKey(addr))) {
+            // 单 IP 连接数超限, 不占用连接表
+            Metrics::Add(CLIENT_CONN_REJECT);
+            if (!listener.IsTls()) { SendReject(fd, w_tooMany); }
+            close(fd);
+            continue;
+        }
+        Metrics::Add(CONN_ACCEPT);
+        TWS_PROBE2(accept, fd, HttpConn::userCount.load());
+        ssl_st *ssl = nullptr;
+        if (listener.IsTls() && !(ssl = TlsContext::Instance()->NewSession(fd))) {
+            LOG_ERROR("TLS session for client[%d] error!", fd)
+            if (isLimited) { w_limiter->ReleaseConn(HttpConn::IpKey(addr)); }
+            close(fd);
+            continue;
+        }
+        AddClient(fd, addr, isLimited, ssl);
+        UpdateKeepAlive(false);
     } while (w_listenEvent & EPOLLET);
 }
 
+Listener *WebServer::FindListener(int fd) {
+    for (auto &listener: w_listeners) {
+        if (listener.GetFd() == fd) { return &listener; }
+    }
+    return nullptr;
+}
+
+int WebServer::InitSignal() {
+    // 信号统一由 signalfd 在事件循环中处理
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    sigaddset(&mask, SIGUSR2);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGQUIT);
+    sigaddset(&mask, SIGTTIN);
+    sigaddset(&mask, SIGCHLD);
+    if (pthread_sigmask(SIG_BLOCK, &mask, nullptr) != 0) {
+        return -1;
+    }
+    return signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+}
+
+bool WebServer::InitWatcher(int fileCacheEntries) {
+    // 缓存只在能收到变更通知时开启, 否则会返回过期内容
+    w_watcher.reset(new FileWatcher());
+    bool ret = w_watcher->Init(w_srcDir,
+                               [](const std::string &path) {
+                                   FileCache::Instance()->Invalidate(path);
+                                   ResponseCache::Instance()->Invalidate(path);
+                               },
+                               [] {
+                                   FileCache::Instance()->Clear();
+                                   ResponseCache::Instance()->Clear();
+                               });
+    if (!ret || !w_epoller->AddFd(w_watcher->GetFd(), EPOLLIN)) {
+        w_watcher.reset();
+        return false;
+    }
+    FileCache::Instance()->Init(fileCacheEntries);
+    return true;
+}
+
+void WebServer::DealSignal() {
+    struct signalfd_siginfo info{};
+    while (read(w_signalFd, &info, sizeof(info)) == sizeof(info)) {
+        switch (info.ssi_signo) {
+            case SIGUSR1:
+                // 部署新资源包后重新映射
+                if (Bundle::Instance()->Reload()) {
+                    ResponseCache::Instance()->Clear();
+                } else {
+                    LOG_WARN("Bundle reload failed, keep serving the old one")
+                }
+                break;
+            case SIGHUP:
+                Reload();
+                break;
+            case SIGTERM:
+            case SIGINT:
+            case SIGQUIT:
+                if (w_draining) {
+                    // 排空期间再次收到退出信号, 不再等待
+                    LOG_WARN("Drain interrupted, exit now")
+                    w_shutdown = true;
+                } else {
+                    StartDrain();
+                }
+                break;
+            case SIGTTIN:
+                // SIGUSR1/SIGUSR2 已有用途, 服务器不读终端, 借用 SIGTTIN 触发升级
+                Upgrade();
+                break;
+            case SIGCHLD:
+                ReapChild();
+                break;
+            case SIGUSR2:
+                // 导出采样到的请求追踪
+                if (Tracer::IsOpen() && !w_traceFile.empty()) {
+                    Tracer::Instance()->Dump(w_traceFile.c_str());
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void WebServer::QueueInLoop(std::function<void()> &&task) {
+    {
+        std::lock_guard<std::mutex> locker(w_loopMutex);
+        w_loopTasks.emplace_back(std::move(task));
+    }
+    uint64_t one = 1;
+    write(w_eventFd, &one, sizeof(one));
+}
+
+void WebServer::DealLoopTasks() {
+    uint64_t cnt;
+    read(w_eventFd, &cnt, sizeof(cnt));
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> locker(w_loopMutex);
+        tasks.swap(w_loopTasks);
+    }
+    for (auto &task: tasks) {
+        task();
+    }
+}
+
+void WebServer::PrefetchFile(HttpConn *client) {
+    // 文件页不在内存: IO 线程读入后再由事件循环恢复写事件
+    void *addr;
+    size_t len;
+    auto owner = client->PrefetchRange(&addr, &len);
+    uint64_t seq = client->GetSeq();
+    LOG_DEBUG("Client[%d] prefetch %d bytes", client->GetFd(), (int) len)
+    Undispatch(client);
+    w_ioPool->AddTask([this, client, owner, addr, len, seq] {
+        HttpConn::Prefetch(addr, len);
+        QueueInLoop([this, client, seq] {
+            // 期间连接可能已超时关闭, fd 也可能被新连接复用
+            if (!client->IsClosed() && client->GetSeq() == seq) {
+                ModConn(client, EPOLLOUT);
+            }
+        });
+    });
+}
+
+void WebServer::ParkConn(HttpConn *client, int waitMs) {
+    uint64_t seq = client->GetSeq();
+    Undispatch(client);
+    QueueInLoop([this, client, seq, waitMs] {
+        if (client->IsClosed() || client->GetSeq() != seq) { return; }
+        w_timer->Add(PARK_TIMER_BASE + client->GetFd(), waitMs, [this, client, seq] {
+            if (!client->IsClosed() && client->GetSeq() == seq) {
+                ModConn(client, EPOLLOUT);
+            }
+        });
+    });
+}
+
+void WebServer::RefillBandwidth() {
+    w_shaper->Refill();
+    w_timer->Add(REFILL_TIMER_ID, BandwidthShaper::REFILL_MS, [this] { RefillBandwidth(); });
+}
+
 void WebServer::DealRead(HttpConn *client) {
     assert(client);
+    if (client->IsWebSocket() && !client->GetWebSocket()->Acquire()) {
+        // 广播唤醒与已派发的事件重叠, 由正在处理的线程重新注册
+        return;
+    }
+    if (client->IsDispatched()) {
+        // 数据库线程交回响应时重新注册了事件, 同一批中较早的事件已经派发
+        return;
+    }
     ExtentTime(client);
-    w_threadPool->AddTask([this, client] { OnRead(client); });
+    client->BeginTrace();
+    TWS_PROBE1(dispatch_read, client->GetFd());
+    if (w_admission && !w_admission->TryAcquire()) {
+        // 超过并发上限, 不再进入队列
+        Metrics::Add(ADMIT_REJECT);
+        RejectConn(client, w_unavailable);
+        return;
+    }
+    uint64_t dispatchNs = Metrics::NowNs();
+    client->SetDispatched(true);
+    if (w_busyPoll) {
+        OnRead(client, dispatchNs);
+        return;
+    }
+    w_threadPool->AddTask([this, client, dispatchNs] { OnRead(client, dispatchNs); }, false, client->GetNode());
 }
 
 void WebServer::DealWrite(HttpConn *client) {
     assert(client);
+    if (client->IsWebSocket() && !client->GetWebSocket()->Acquire()) {
+        return;
+    }
+    if (client->IsDispatched()) {
+        return;
+    }
     ExtentTime(client);
-    w_threadPool->AddTask([this, client] { OnWrite(client); });
+    TWS_PROBE2(dispatch_write, client->GetFd(), client->ToWriteBytes());
+    client->SetDispatched(true);
+    if (w_busyPoll) {
+        OnWrite(client);
+        return;
+    }
+    // 大文件的后续发送进入低优先级队列, 短响应优先
+    w_threadPool->AddTask([this, client] { OnWrite(client); }, client->IsBulk(), client->GetNode());
 }
 
 void WebServer::ExtentTime(HttpConn *client) {
     assert(client);
-    if (w_timeoutMs > 0) { w_timer->Adjust(client->GetFd(), w_timeoutMs); }
+    if (!w_keepAlive) {
+        return;
+    }
+    int timeoutMs = std::min(w_keepAlive->TimeoutMs(), w_slowCheckMs);
+    if (client->GetPhase() != HttpConn::PHASE_IDLE) {
+        // 未完成的阶段不因收到新数据而整体延长, 按已有进度计算期限
+        uint64_t now = Metrics::NowNs();
+        uint64_t deadline = DeadlineNs(client);
+        timeoutMs = deadline > now ? static_cast<int>((deadline - now + 999999) / 1000000) : 0;
+    }
+    // 到期后由 OnTimeout 重新计算, 连接空闲时延长到空闲超时
+    w_timer->Adjust(client->GetFd(), timeoutMs);
 }
 
-void WebServer::OnRead(HttpConn *client) {
+uint64_t WebServer::DeadlineNs(HttpConn *client) {
+    uint64_t idle = client->GetActiveNs() + static_cast<uint64_t>(w_keepAlive->TimeoutMs()) * 1000000;
+    if (client->IsWebSocket()) {
+        // 不按空闲超时关闭: 一个周期没有收到帧时发送 Ping, 再过一个周期仍没有收到才关闭
+        idle = client->GetWebSocket()->LastActiveNs() + w_wsPingNs;
+    }
+    uint64_t begin = client->GetPhaseNs();
+    switch (client->GetPhase()) {
+        case HttpConn::PHASE_HEADER:
+            // 头部从第一个字节起限时, 不随收到的字节延长
+            return w_headerTimeoutNs > 0 ? std::min(idle, begin + w_headerTimeoutNs) : idle;
+        case HttpConn::PHASE_BODY:
+            if (w_minBodyRate <= 0) { return idle; }
+            return std::min(idle, begin + w_slowGraceNs + client->GetPhaseBytes() * 1000000000 / w_minBodyRate);
+        case HttpConn::PHASE_WRITE:
+            // 被限速的响应不按最低速率检查
+            if (w_minSendRate <= 0 || client->GetBucket().enabled) { return idle; }
+            return std::min(idle, begin + w_slowGraceNs + client->GetPhaseBytes() * 1000000000 / w_minSendRate);
+        case HttpConn::PHASE_LINGER:
+            return std::min(idle, begin + static_cast<uint64_t>(LINGER_MS) * 1000000);
+        default:
+            return idle;
+    }
+}
+
+void WebServer::OnTimeout(HttpConn *client) {
     assert(client);
-    int ret = -1;
-    int readErrno = 0;
-    ret = client->Read(&readErrno);
-    if (ret <= 0 && readErrno != EAGAIN) {
-        CloseConn(client);
+    // 持锁期间工作线程不能交还连接, 未派发的连接在锁内关闭
+    std::lock_guard<std::mutex> locker(client->DispatchMutex());
+    if (!client->IsClosed()) {
+        if (client->IsDispatched()) {
+            w_timer->Add(client->GetFd(), DISPATCHED_RECHECK_MS, [this, client] { OnTimeout(client); });
+            return;
+        }
+        uint64_t now = Metrics::NowNs();
+        uint64_t deadline = DeadlineNs(client);
+        if (deadline > now) {
+            int waitMs = static_cast<int>((deadline - now + 999999) / 1000000);
+            w_timer->Add(client->GetFd(), waitMs, [this, client] { OnTimeout(client); });
+            return;
+        }
+        HttpConn::Phase phase = client->GetPhase();
+        WebSocket *ws = client->IsWebSocket() ? client->GetWebSocket() : nullptr;
+        if (ws && phase == HttpConn::PHASE_IDLE && !ws->IsPinging()) {
+            ws->Ping();
+            int waitMs = static_cast<int>(w_wsPingNs / 1000000);
+            w_timer->Add(client->GetFd(), waitMs, [this, client] { OnTimeout(client); });
+            return;
+        }
+        if (phase == HttpConn::PHASE_HEADER || phase == HttpConn::PHASE_BODY || phase == HttpConn::PHASE_WRITE) {
+            Metrics::Add(phase == HttpConn::PHASE_HEADER ? SLOW_HEADER :
+                         phase == HttpConn::PHASE_BODY ? SLOW_BODY : SLOW_SEND);
+            LOG_WARN("Client[%d](%s) too slow in phase %d, %d bytes", client->GetFd(), client->GetIP(),
+                     (int) phase, (int) client->GetPhaseBytes())
+            // 直接 RST, 不保留发送缓冲区和 TIME_WAIT
+            struct linger optLinger = {1, 0};
+            setsockopt(client->GetFd(), SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));
+        }
+    }
+    CloseConn(client);
+}
+
+void WebServer::UpdateKeepAlive(bool sampleMem) {
+    int level = w_keepAlive->Level();
+    bool shorter = w_keepAlive->Update(HttpConn::userCount, sampleMem);
+    if (level == w_keepAlive->Level()) {
+        return;
+    }
+    int timeoutMs = w_keepAlive->TimeoutMs();
+    HttpResponse::keepAliveSec = std::max(timeoutMs / 1000, 1);
+    if (shorter) {
+        for (auto &user: w_users) {
+            if (!user.second.IsClosed()) { w_timer->Shorten(user.first, timeoutMs); }
+        }
+    }
+}
+
+void WebServer::SweepClients() {
+    w_limiter->Sweep();
+    w_timer->Add(CLIENT_TIMER_ID, ClientLimiter::SWEEP_MS, [this] { SweepClients(); });
+}
+
+void WebServer::StartDrain() {
+    w_draining = true;
+    HttpConn::isDraining = true;
+    w_drainDeadlineNs = Metrics::NowNs() + static_cast<uint64_t>(std::max(Snapshot()->drainTimeoutMs, 0)) * 1000000;
+    for (auto &listener: w_listeners) {
+        // 升级时新进程持有同样的监听套接字, 端口不会断开
+        if (listener.GetFd() < 0) { continue; }
+        w_epoller->DelFd(listener.GetFd());
+        listener.Close();
+    }
+    // WebSocket 连接发送关闭帧后关闭
+    WebSocketHub::Instance()->CloseAll(WebSocket::WS_GOING_AWAY);
+    // 空闲的长连接直接关闭, 已经发来请求或已派发的连接处理完再关闭
+    int closed = 0;
+    for (auto &user: w_users) {
+        HttpConn &client = user.second;
+        if (!client.IsClosed() && !client.IsWebSocket() && client.GetPhase() == HttpConn::PHASE_IDLE &&
+            CloseIdleConn(&client, true)) {
+            ++closed;
+        }
+    }
+    LOG_INFO("========== Server drain ==========")
+    LOG_INFO("Drain: %d idle conns closed, %d in flight", closed, HttpConn::userCount.load())
+    CheckDrain();
+}
+
+void WebServer::CheckDrain() {
+    if (HttpConn::userCount > 0 && Metrics::NowNs() < w_drainDeadlineNs) {
+        w_timer->Add(DRAIN_TIMER_ID, DRAIN_CHECK_MS, [this] { CheckDrain(); });
+        return;
+    }
+    if (HttpConn::userCount > 0) {
+        LOG_WARN("Drain timeout, close %d conns", HttpConn::userCount.load())
+        // 仍在工作线程中的连接在析构时等线程池结束后关闭
+        for (auto &user: w_users) {
+            CloseIdleConn(&user.second);
+        }
+    }
+    w_shutdown = true;
+}
+
+void WebServer::Upgrade() {
+    if (w_draining || w_childPid > 0) {
+        LOG_WARN("Upgrade already in progress")
+        return;
+    }
+    char exe[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (len <= 0) {
+        LOG_ERROR("Upgrade: read /proc/self/exe error!")
+        return;
+    }
+    // 可执行文件被替换后链接显示为 "路径 (deleted)"
+    std::string path(exe, len);
+    const std::string deleted = " (deleted)";
+    if (path.size() > deleted.size() && path.compare(path.size() - deleted.size(), deleted.size(), deleted) == 0) {
+        path.resize(path.size() - deleted.size());
+    }
+
+    // fork 之后子进程只能调用异步信号安全的函数, 参数和环境变量提前准备好
+    std::vector<int> listenFds;
+    std::string listenEnv = LISTEN_FD_ENV;
+    for (const auto &listener: w_listeners) {
+        listenEnv += (listenFds.empty() ? "=" : ",") + std::to_string(listener.GetFd());
+        listenFds.push_back(listener.GetFd());
+    }
+    std::sort(listenFds.begin(), listenFds.end());
+    std::string parentEnv = std::string(PARENT_PID_ENV) + "=" + std::to_string(getpid());
+    std::vector<char *> envp;
+    for (char **env = environ; *env; ++env) {
+        envp.push_back(*env);
+    }
+    envp.push_back(&listenEnv[0]);
+    envp.push_back(&parentEnv[0]);
+    envp.push_back(nullptr);
+    char *argv[] = {&path[0], nullptr};
+    long maxFd = sysconf(_SC_OPEN_MAX);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        LOG_ERROR("Upgrade: fork error: %s", strerror(errno))
         return;
     }
-    OnProcess(client);
+    if (pid == 0) {
+        // 只保留标准输入输出和监听套接字, 客户端连接不能被新进程持有
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, nullptr);
+        int first = 3;
+        for (int fd: listenFds) {
+            CloseRange(first, fd - 1, maxFd);
+            first = fd + 1;
+        }
+        CloseRange(first, INT_MAX, maxFd);
+        execve(argv[0], argv, envp.data());
+        _exit(127);
+    }
+    w_childPid = pid;
+    LOG_INFO("Upgrade: start %s, pid %d", path.c_str(), pid)
+}
+
+void WebServer::ReapChild() {
+    int status = 0;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        if (pid != w_childPid) { continue; }
+        w_childPid = 0;
+        if (!w_draining) {
+            // 新进程没能启动, 继续由本进程服务
+            LOG_ERROR("Upgrade failed: pid %d exit status %d, keep serving", pid,
+                      WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status))
+        }
+    }
+}
+
+void WebServer::SampleKeepAlive() {
+    UpdateKeepAlive(true);
+    w_timer->Add(KEEP_ALIVE_TIMER_ID, KEEP_ALIVE_SAMPLE_MS, [this] { SampleKeepAlive(); });
+}
+
+bool WebServer::EvictIdle() {
+    // 每次扫描关闭一批, 分摊遍历所有连接的开销
+    std::vector<std::pair<uint64_t, HttpConn *>> idle;
+    for (auto &user: w_users) {
+        // 已派发的连接可能刚收到新请求, 工作线程仍在使用
+        if (!user.second.IsClosed() && !user.second.IsDispatched() && user.second.GetPhase() == HttpConn::PHASE_IDLE &&
+            !user.second.IsAwaitingDb()) {
+            idle.emplace_back(user.second.GetActiveNs(), &user.second);
+        }
+    }
+    if (idle.empty()) {
+        return false;
+    }
+    size_t cnt = std::min(idle.size(), static_cast<size_t>(EVICT_BATCH));
+    std::nth_element(idle.begin(), idle.begin() + cnt - 1, idle.end());
+    size_t evicted = 0;
+    for (size_t i = 0; i < cnt; ++i) {
+        int fd = idle[i].second->GetFd();
+        if (CloseIdleConn(idle[i].second)) {
+            LOG_WARN("Clients is Full! Evict client[%d]", fd)
+            ++evicted;
+        }
+    }
+    Metrics::Add(CONN_EVICT, evicted);
+    return evicted > 0;
+}
+
+void WebServer::OnRead(HttpConn *client, uint64_t dispatchNs) {
+    assert(client);
+    uint64_t queueNs = Metrics::NowNs() - dispatchNs;
+    std::shared_ptr<const Config> config = Snapshot();
+    uint64_t deadlineNs = config->admitDeadlineMs > 0 ? static_cast<uint64_t>(config->admitDeadlineMs) * 1000000 : 0;
+    if (client->GetNode() >= 0) {
+        int node = CpuAffinity::CurrentNode();
+        Metrics::Add(node == client->GetNode() ? NUMA_LOCAL : NUMA_REMOTE);
+        client->LocalizeBuffers(node);
+    }
+    if (client->GetPhase() == HttpConn::PHASE_LINGER) {
+        // 413 已经发出, 读走剩余的请求体, 对端关闭或期限到达时再关闭
+        if (client->Discard()) {
+            ModConn(client, EPOLLIN);
+        } else {
+            CloseConn(client);
+        }
+    } else if (deadlineNs > 0 && queueNs > deadlineNs) {
+        // 排队太久, 客户端多半已经放弃, 不再处理
+        Metrics::Add(DEADLINE_DROP);
+        RejectConn(client, w_unavailable);
+    } else if (client->IsHandshaking() && !OnHandshake(client)) {
+        // 握手未完成, 已重新注册事件或已关闭
+    } else {
+        int readErrno = 0;
+        bool isNewRequest = client->GetPhase() == HttpConn::PHASE_IDLE;
+        int ret = client->Read(&readErrno);
+        if (ret <= 0 && readErrno != EAGAIN) {
+            CloseConn(client);
+        } else if (w_limiter && client->IsLimited() && isNewRequest && !client->IsHttp2() && !client->IsWebSocket() &&
+                   client->ToReadBytes() > 0 &&
+                   !w_limiter->AcquireRequest(client->GetIpKey(),
+                                              client->IsDbRequest() ? std::max(config->ipDbCost, 1) : 1)) {
+            // 新请求开始时按 IP 计费, 登录/注册消耗更多令牌; HTTP/2 的流和 WebSocket 的消息在 HttpConn 中计费
+            Metrics::Add(CLIENT_RATE_REJECT);
+            RejectConn(client, w_tooMany);
+        } else if (w_dbPool && client->IsDbRequest()) {
+            // 转入数据库队列后归还准入名额, 数据库队列只由 dbQueueMax 限制, 数据库变慢不会压低静态请求的准入上限
+            bool added = w_dbPool->TryAddTask([this, client] { OnProcess(client); },
+                                              config->dbQueueMax > 0 ? config->dbQueueMax : SIZE_MAX);
+            if (!added) {
+                Metrics::Add(DB_LANE_REJECT);
+                RejectConn(client, w_unavailable);
+            }
+        } else {
+            OnProcess(client);
+        }
+    }
+    if (w_admission) {
+        w_admission->Release(queueNs);
+    }
+}
+
+bool WebServer::OnHandshake(HttpConn *client) {
+    switch (client->Handshake()) {
+        case TlsContext::TLS_DONE:
+            return true;
+        case TlsContext::TLS_WANT_READ:
+            ModConn(client, EPOLLIN);
+            return false;
+        case TlsContext::TLS_WANT_WRITE:
+            ModConn(client, EPOLLOUT);
+            return false;
+        default:
+            CloseConn(client);
+            return false;
+    }
 }
 
 void WebServer::OnProcess(HttpConn *client) {
     if (client->process()) {
-        w_epoller->ModFd(client->GetFd(), w_connEvent | EPOLLOUT);
+        if (w_shaper) {
+            const BandwidthRule *rule = w_shaper->Match(client->GetPath());
+            client->GetBucket().Reset(rule != nullptr, rule ? rule->rate : 0);
+        }
+        ModConn(client, EPOLLOUT);
     } else {
-        w_epoller->ModFd(client->GetFd(), w_connEvent | EPOLLIN);
+        ModConn(client, EPOLLIN);
+    }
+}
+
+const std::string *WebServer::DispatchDbStream(HttpConn *client, uint32_t streamId, std::string &&request) {
+    // 与 HTTP/1.1 的登录/注册请求一样不占用准入名额, 只受 dbQueueMax 限制
+    std::shared_ptr<const Config> config = Snapshot();
+    uint64_t seq = client->GetSeq();
+    // 数据库线程只使用自己的 HttpRequest/HttpResponse, 不访问连接
+    bool added = w_dbPool->TryAddTask([this, client, seq, streamId, request = std::move(request)] {
+        Buffer buff;
+        buff.Append(request);
+        HttpRequest httpRequest;
+        HttpResponse httpResponse;
+        HttpConn::Http2Reply reply = HttpConn::MakeHttp2Reply(streamId, buff, httpRequest, httpResponse);
+        QueueInLoop([this, client, seq, reply]() mutable { DeliverDbReply(client, seq, std::move(reply)); });
+    }, config->dbQueueMax > 0 ? config->dbQueueMax : SIZE_MAX);
+    if (added) {
+        return nullptr;
     }
+    Metrics::Add(DB_LANE_REJECT);
+    return &w_unavailable;
+}
+
+void WebServer::DeliverDbReply(HttpConn *client, uint64_t seq, HttpConn::Http2Reply &&reply) {
+    std::lock_guard<std::mutex> locker(client->DispatchMutex());
+    // 期间连接可能已关闭, fd 也可能被新连接复用
+    if (client->IsClosed() || client->GetSeq() != seq) {
+        return;
+    }
+    client->AddDbReply(std::move(reply));
+    // 已派发的连接由 ModConn 注册写事件; 正在发送的连接写完后会再次 process, 期间可能挂在定时器或 IO 线程上
+    if (!client->IsDispatched() && client->GetPhase() != HttpConn::PHASE_WRITE) {
+        w_epoller->ModFd(client->GetFd(), w_connEvent | EPOLLOUT);
+    }
+}
+
+void WebServer::ModConn(HttpConn *client, uint32_t events) {
+    // 先清除再注册: 注册后事件循环可能立即再次派发
+    std::lock_guard<std::mutex> locker(client->DispatchMutex());
+    client->SetDispatched(false);
+    if (client->IsWebSocket()) {
+        client->GetWebSocket()->Release(events == EPOLLOUT);
+        return;
+    }
+    if (client->HasDbReply()) {
+        // process 之后又交回了数据库线程的响应
+        events = EPOLLOUT;
+    }
+    w_epoller->ModFd(client->GetFd(), w_connEvent | events);
+}
+
+void WebServer::Undispatch(HttpConn *client) {
+    std::lock_guard<std::mutex> locker(client->DispatchMutex());
+    client->SetDispatched(false);
 }
 
 void WebServer::OnWrite(HttpConn *client) {
     assert(client);
+    if (client->IsHandshaking()) {
+        // 握手消息写完后等待请求
+        if (OnHandshake(client)) {
+            ModConn(client, EPOLLIN);
+        }
+        return;
+    }
+    if ((client->IsWebSocket() || client->IsHttp2()) && client->ToWriteBytes() == 0) {
+        // 空闲时被广播或交回的数据库响应唤醒, 先装入待发送的帧
+        OnProcess(client);
+        return;
+    }
     int ret = -1;
     int writeErrno = 0;
-    ret = client->Write(&writeErrno);
+    size_t maxBytes = 0;
+    TokenBucket &bucket = client->GetBucket();
+    ip_key_t ip = client->GetIpKey();
+    if (w_shaper && bucket.enabled) {
+        int waitMs = 0;
+        maxBytes = w_shaper->Acquire(bucket, ip, client->ToWriteBytes(), &waitMs);
+        if (maxBytes == 0) {
+            ParkConn(client, waitMs);
+            return;
+        }
+    }
+    size_t sent = client->GetSentBytes();
+    ret = client->Write(&writeErrno, maxBytes);
+    if (w_shaper && bucket.enabled) {
+        w_shaper->Consume(bucket, ip, client->GetSentBytes() - sent);
+    }
+    if (ret < 0 && writeErrno == EINPROGRESS) {
+        PrefetchFile(client);
+        return;
+    }
     if (client->ToWriteBytes() == 0) {
         // 传输完成
+        client->EndTrace();
         if (client->IsKeepAlive()) {
             OnProcess(client);
             return;
         }
+        if (client->IsLinger()) {
+            client->StartLinger();
+            ModConn(client, EPOLLIN);
+            return;
+        }
+    } else if (ret > 0) {
+        // 本次写配额用完, 让出工作线程, 等待下一次可写事件
+        ModConn(client, EPOLLOUT);
+        return;
     } else if (ret < 0) {
         if (writeErrno == EAGAIN) {
             // 继续传输
-            w_epoller->ModFd(client->GetFd(), w_connEvent | EPOLLOUT);
+            ModConn(client, EPOLLOUT);
             return;
         }
     }
@@ -192,68 +1132,71 @@ void WebServer::OnWrite(HttpConn *client) {
 }
 
 // Create listenFd
-bool WebServer::InitSocket() {
-    int ret;
-    struct sockaddr_in addr{};
+bool WebServer::InitSocket(const Config &config) {
     if (w_port > 65535 || w_port < 1024) {
         LOG_ERROR("Port:%d error!", w_port)
         return false;
     }
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port = htons(w_port);
-    struct linger optLinger = {0};
-    if (w_openLinger) {
-        // 优雅关闭: 直到所剩数据发送完毕或超时
-        optLinger.l_onoff = 1;
-        optLinger.l_linger = 1;
+    // 原有的 IPv4 端口之外, 还可以监听多个 TCP/IPv6/AF_UNIX 地址
+    w_listeners.emplace_back(ListenerConfig{"0.0.0.0:" + std::to_string(w_port), 6, true, false});
+    for (const auto &listener: config.listeners) {
+        w_listeners.emplace_back(listener);
     }
-
-    w_listenFd = socket(AF_INET, SOCK_STREAM, 0);
-    if (w_listenFd < 0) {
-        LOG_ERROR("Create socket error!", w_port)
-        return false;
+    std::vector<int> inherited = InheritedFds();
+    bool ok = true;
+    for (auto &listener: w_listeners) {
+        if (!listener.IsValid()) {
+            LOG_ERROR("Listen address %s error!", listener.GetAddress().c_str())
+            ok = false;
+            break;
+        }
+        if (!listener.Open(inherited, w_openLinger)) {
+            ok = false;
+            break;
+        }
+        if (!w_epoller->AddFd(listener.GetFd(), w_listenEvent | EPOLLIN)) {
+            LOG_ERROR("Add listen error!")
+            ok = false;
+            break;
+        }
+        SetFdNonblock(listener.GetFd());
     }
-
-    ret = setsockopt(w_listenFd, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));
-    if (ret < 0) {
-        close(w_listenFd);
-        LOG_ERROR("Init linger error!", w_port)
-        return false;
+    // 升级时去掉的监听地址
+    for (int fd: inherited) {
+        close(fd);
     }
+    return ok;
+}
 
-    int optVal = 1;
-    // 端口复用
-    // 只有最后一个套接字会正常接收数据
-    ret = setsockopt(w_listenFd, SOL_SOCKET, SO_REUSEADDR, (const void *) &optVal, sizeof(int));
-    if (ret == -1) {
-        LOG_ERROR("set socket setsockopt error !")
-        close(w_listenFd);
-        return false;
+std::vector<int> WebServer::InheritedFds() {
+    std::vector<int> fds;
+    const char *listenEnv = getenv(LISTEN_FD_ENV);
+    if (!listenEnv) {
+        return fds;
     }
-
-    ret = bind(w_listenFd, (struct sockaddr *) &addr, sizeof(addr));
-    if (ret < 0) {
-        LOG_ERROR("Bind Port:%d error!", w_port)
-        close(w_listenFd);
-        return false;
+    const char *parentEnv = getenv(PARENT_PID_ENV);
+    w_parentPid = parentEnv ? atoi(parentEnv) : 0;
+    for (const char *p = listenEnv; *p;) {
+        char *end;
+        long fd = strtol(p, &end, 10);
+        if (end == p) { break; }
+        if (fd > 2) { fds.push_back(static_cast<int>(fd)); }
+        p = *end == ',' ? end + 1 : end;
     }
+    // 不再传给之后启动的进程
+    unsetenv(LISTEN_FD_ENV);
+    unsetenv(PARENT_PID_ENV);
+    return fds;
+}
 
-    ret = listen(w_listenFd, 6);
-    if (ret < 0) {
-        LOG_ERROR("Listen port:%d error!", w_port)
-        close(w_listenFd);
-        return false;
+void WebServer::CloseRange(int first, int last, long maxFd) {
+    if (first > last) { return; }
+#ifdef SYS_close_range
+    if (syscall(SYS_close_range, first, last, 0) == 0) { return; }
+#endif
+    for (long fd = first; fd <= last && fd < maxFd; ++fd) {
+        close(static_cast<int>(fd));
     }
-    ret = w_epoller->AddFd(w_listenFd, w_listenEvent | EPOLLIN);
-    if (ret == 0) {
-        LOG_ERROR("Add listen error!")
-        close(w_listenFd);
-        return false;
-    }
-    SetFdNonblock(w_listenFd);
-    LOG_INFO("Server port:%d", w_port)
-    return true;
 }
 
 int WebServer::SetFdNonblock(int fd) {
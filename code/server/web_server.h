@@ -5,66 +5,206 @@
 #include <unistd.h>
 #include <cassert>
 #include <cerrno>
+#include <climits>
 #include <unordered_map>
+#include <csignal>
 #include <sys/socket.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sched.h>
 
 #include "epoller.h"
+#include "file_watcher.h"
+#include "bandwidth.h"
+#include "loop_monitor.h"
+#include "admission.h"
+#include "keep_alive.h"
+#include "client_limit.h"
+#include "listener.h"
 #include "../log/log.h"
+#include "../config/config.h"
 #include "../timer/timer.h"
 #include "../pool/sql_conn_pool.h"
 #include "../pool/thread_pool.h"
 #include "../pool/sql_conn_RAII.h"
+#include "../pool/cpu_affinity.h"
 #include "../http/http_conn.h"
+#include "../bundle/bundle.h"
+#include "../metrics/probes.h"
 
 class WebServer {
 public:
-    WebServer(
-            int port, int trigMode, int timeoutMS, bool optLinger,
-            int sqlPort, const char *sqlUser, const char *sqlPwd,
-            const char *dbName, int connPoolNum, int threadNum,
-            bool openLog, int logLevel, int logQueSize);
+    explicit WebServer(const std::shared_ptr<const Config> &config);
 
     ~WebServer();
 
     void Start();
 
 private:
-    bool InitSocket();
+    bool InitSocket(const Config &config);
 
     void InitEventMode(int trigMode);
 
-    void AddClient(int fd, sockaddr_in addr);
+    static int InitSignal();
 
-    void DealListen();
+    bool InitWatcher(int fileCacheEntries);
+
+    void AddClient(int fd, const sockaddr_storage &addr, bool isLimited, ssl_st *ssl);
+
+    void DealListen(const Listener &listener);
+
+    Listener *FindListener(int fd);
 
     void DealWrite(HttpConn *client);
 
     void DealRead(HttpConn *client);
 
-    void SendError(int fd, const char *info);
+    void DealSignal();
+
+    // 其他线程投递到事件循环线程执行的任务
+    void QueueInLoop(std::function<void()> &&task);
+
+    void DealLoopTasks();
+
+    void PrefetchFile(HttpConn *client);
+
+    // 令牌不足时挂到定时器上, 到期后恢复写事件
+    void ParkConn(HttpConn *client, int waitMs);
+
+    void RefillBandwidth();
+
+    // 低延迟模式: 先以 epoll_wait(0) 自旋, 空转超过预算后退回阻塞等待
+    int BusyWait(int timeMS);
+
+    // 发送预先构造的 503/429 响应, 先读掉未处理的请求数据, 避免关闭时发送 RST
+    void SendReject(int fd, const std::string &response);
+
+    void SweepClients();
+
+    // 停止接受新连接, 关闭空闲连接, 其余连接响应完当前请求后关闭
+    void StartDrain();
+
+    void CheckDrain();
+
+    // 启动新的可执行文件并把监听套接字交给它, 新进程就绪后通知本进程退出
+    void Upgrade();
+
+    void ReapChild();
+
+    // 当前生效的配置, 工作线程每次使用时取一份快照
+    std::shared_ptr<const Config> Snapshot() const { return std::atomic_load(&w_config); }
+
+    // SIGHUP: 在工作线程中读取并校验配置, 再回到事件循环线程应用
+    void Reload();
+
+    void ApplyConfig(const std::shared_ptr<const Config> &config);
+
+    // 只由事件循环线程读取的可热更新配置
+    void LoadLiveConfig(const Config &config);
 
     void ExtentTime(HttpConn *client);
 
+    // 连接定时器到期: 按所处阶段计算真正的期限, 未到则重新挂上定时器
+    void OnTimeout(HttpConn *client);
+
+    uint64_t DeadlineNs(HttpConn *client);
+
+    // 重新计算空闲超时, 变短时收紧所有连接的定时器
+    void UpdateKeepAlive(bool sampleMem);
+
+    void SampleKeepAlive();
+
+    // 连接数达到上限时关闭最久没有活动的空闲连接
+    bool EvictIdle();
+
     void CloseConn(HttpConn *client);
 
-    void OnRead(HttpConn *client);
+    // 事件循环主动关闭连接: 已派发给工作线程的连接跳过, 返回是否关闭;
+    // isDrained 为 true 时还要求读缓冲区和套接字中都没有未处理的请求, 也没有在数据库队列中的流
+    bool CloseIdleConn(HttpConn *client, bool isDrained = false);
+
+    // 发送 503/429 后关闭
+    void RejectConn(HttpConn *client, const std::string &response);
+
+    // 推进 TLS 握手, 完成时返回 true, 否则已按需要重新注册事件或关闭连接
+    bool OnHandshake(HttpConn *client);
+
+    void OnRead(HttpConn *client, uint64_t dispatchNs);
 
     void OnWrite(HttpConn *client);
 
     void OnProcess(HttpConn *client);
 
+    // HTTP/2 的登录/注册流单独转入数据库队列, 连接继续处理其余的流; 队列已满时返回 503
+    const std::string *DispatchDbStream(HttpConn *client, uint32_t streamId, std::string &&request);
+
+    // 在事件循环线程中把数据库线程构造的响应交回连接, 连接空闲时注册写事件
+    void DeliverDbReply(HttpConn *client, uint64_t seq, HttpConn::Http2Reply &&reply);
+
+    // 工作线程处理完后清除派发标记并重新注册事件; WebSocket 连接可能同时被广播唤醒, 交给它在锁内完成
+    void ModConn(HttpConn *client, uint32_t events);
+
+    // 工作线程把连接交给 IO 线程或定时器, 由事件循环之后重新注册
+    static void Undispatch(HttpConn *client);
+
     static const int MAX_FD = 65536;
+    // 定时器 id: [0, MAX_FD) 为连接超时, 其后为内部定时任务
+    static const int PARK_TIMER_BASE = MAX_FD;
+    static const int REFILL_TIMER_ID = 2 * MAX_FD;
+    static const int KEEP_ALIVE_TIMER_ID = 2 * MAX_FD + 1;
+    static const int CLIENT_TIMER_ID = 2 * MAX_FD + 2;
+    static const int DRAIN_TIMER_ID = 2 * MAX_FD + 3;
+    static const int DRAIN_CHECK_MS = 100;
+    // 超时到期时连接仍在工作线程中, 隔一段时间再检查
+    static const int DISPATCHED_RECHECK_MS = 100;
+    // 回应 413 后最多丢弃请求体的时长, 到期后直接关闭
+    static const int LINGER_MS = 2000;
+    // 升级时通过环境变量传给新进程的监听套接字(逗号分隔)和旧进程 pid
+    static constexpr const char *LISTEN_FD_ENV = "TWS_LISTEN_FDS";
+    static constexpr const char *PARENT_PID_ENV = "TWS_PARENT_PID";
+    static const int KEEP_ALIVE_SAMPLE_MS = 1000;
+    static const int EVICT_BATCH = 16;
+    // 自旋预算的下限为上限的 1/SPIN_SHRINK
+    static const int SPIN_SHRINK = 16;
 
     static int SetFdNonblock(int fd);
 
+    // 升级前进程留下的监听套接字
+    std::vector<int> InheritedFds();
+
+    // fork 之后调用, 只使用异步信号安全的函数
+    static void CloseRange(int first, int last, long maxFd);
+
+    // 热加载时整体替换, 通过 atomic_load/atomic_store 读写
+    std::shared_ptr<const Config> w_config;
+    // 启动时的配置, 用于报告需要重启才能生效的修改
+    std::shared_ptr<const Config> w_bootConfig;
     int w_port;
     bool w_openLinger;
     int w_timeoutMs;
+    int w_notSentLowat;
+    std::string w_unavailable;
+    std::string w_tooMany;
+    std::string w_traceFile;
     bool w_shutdown;
-    int w_listenFd;
+    bool w_draining;
+    uint64_t w_drainDeadlineNs;
+    // 升级中的新进程, 未升级时为 0
+    pid_t w_childPid;
+    // 从旧进程继承监听套接字时, 就绪后通知旧进程退出
+    pid_t w_parentPid;
+    std::vector<Listener> w_listeners;
+    // 本批事件中由事件循环关闭的连接, fd 可能已被新连接复用, 批内余下的事件属于旧连接
+    std::vector<int> w_batchClosed;
     char *w_srcDir;
+    // 须在线程池之前创建, 使工作线程继承信号屏蔽字
+    int w_signalFd;
 
     uint32_t w_listenEvent;
     uint32_t w_connEvent;
@@ -72,6 +212,36 @@ private:
     std::unique_ptr<Timer> w_timer;
     std::unique_ptr<ThreadPool> w_threadPool;
     std::unique_ptr<Epoller> w_epoller;
+    std::unique_ptr<FileWatcher> w_watcher;
+    std::unique_ptr<ThreadPool> w_ioPool;
+    std::unique_ptr<BandwidthShaper> w_shaper;
+    std::unique_ptr<AdmissionControl> w_admission;
+    std::unique_ptr<KeepAlivePolicy> w_keepAlive;
+    int w_maxConns;
+    // 慢速客户端: 头部期限, 请求体/响应的最低速率(字节/秒), 速率检查前的宽限时间
+    uint64_t w_headerTimeoutNs;
+    int w_minBodyRate;
+    int w_minSendRate;
+    uint64_t w_slowGraceNs;
+    // WebSocket 的 Ping 周期
+    uint64_t w_wsPingNs;
+    // 有读写事件时定时器最晚在这么久之后检查一次
+    int w_slowCheckMs;
+    std::unique_ptr<ClientLimiter> w_limiter;
+    // 登录/注册等访问数据库的请求单独排队, 不占用静态请求的工作线程
+    std::unique_ptr<ThreadPool> w_dbPool;
+    std::vector<int> w_loopCpus;
+    bool w_numaAware;
+    // 开启后请求在事件循环线程中直接处理, 不经过线程池
+    bool w_busyPoll;
+    uint64_t w_spinMaxNs;
+    uint64_t w_spinNs;
+    int w_busyPollSocketUs;
+
+    int w_eventFd;
+    std::mutex w_loopMutex;
+    std::vector<std::function<void()>> w_loopTasks;
+    std::unique_ptr<LoopMonitor> w_monitor;
     std::unordered_map<int, HttpConn> w_users;
 };
 
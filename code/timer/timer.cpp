@@ -85,12 +85,29 @@ void Timer::Del(size_t index) {
 void Timer::Adjust(int id, int timeout) {
     // 调整指定id的结点
     assert(!t_heap.empty() && t_ref.count(id) > 0);
-    t_heap[t_ref[id]].expires = Clock::now() + MS(timeout);
-    ShiftDown(t_ref[id], t_heap.size());
+    size_t i = t_ref[id];
+    t_heap[i].expires = Clock::now() + MS(timeout);
+    // 超时时长可能变短, 两个方向都要调整
+    if (!ShiftDown(i, t_heap.size())) {
+        ShiftUp(i);
+    }
+}
+
+void Timer::Shorten(int id, int timeout) {
+    auto it = t_ref.find(id);
+    if (it == t_ref.end()) {
+        return;
+    }
+    TimeStamp expires = Clock::now() + MS(timeout);
+    if (t_heap[it->second].expires > expires) {
+        t_heap[it->second].expires = expires;
+        ShiftUp(it->second);
+    }
 }
 
 void Timer::Tick() {
     // 清除超时结点
+    t_expired = 0;
     if (t_heap.empty()) {
         return;
     }
@@ -99,8 +116,12 @@ void Timer::Tick() {
         if (std::chrono::duration_cast<MS>(node.expires - Clock::now()).count() > 0) {
             break;
         }
-        node.cb();
+        // 先出堆再回调, 回调中可以重新 Add 同一个 id
         Pop();
+        TWS_PROBE2(timer_expire, node.id,
+                   std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - node.expires).count());
+        node.cb();
+        ++t_expired;
     }
 }
 
@@ -11,6 +11,7 @@
 #include <chrono>
 
 #include "../log/log.h"
+#include "../metrics/probes.h"
 
 typedef std::function<void()> TimeoutCallBack;
 typedef std::chrono::high_resolution_clock Clock;
@@ -35,6 +36,9 @@ public:
 
     void Adjust(int id, int timeout);
 
+    // 到期时间晚于 now + timeout 时提前, 否则不变
+    void Shorten(int id, int timeout);
+
     void Add(int id, int timeOut, const TimeoutCallBack &cb);
 
     void DelWork(int id);
@@ -47,6 +51,11 @@ public:
 
     int GetNextTick();
 
+    size_t Size() const { return t_heap.size(); }
+
+    // 最近一次 Tick 执行的回调数
+    int Expired() const { return t_expired; }
+
 private:
     void Del(size_t index);
 
@@ -59,6 +68,8 @@ private:
     std::vector<TimerNode> t_heap;
 
     std::unordered_map<int, size_t> t_ref;
+
+    int t_expired = 0;
 };
 
 #endif //TIMER_H
\ No newline at end of file
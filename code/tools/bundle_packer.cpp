@@ -0,0 +1,160 @@
+// 离线资源打包工具: BundlePacker <资源目录> <输出文件> [--no-gzip]
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+
+#ifdef TWS_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#include "../bundle/bundle_format.h"
+#include "../http/response_header.h"
+
+namespace fs = std::filesystem;
+
+struct PackItem {
+    std::string path;
+    std::string mime;
+    std::string etag;
+    std::string data;
+    std::string gzip;
+    BundleEntry entry;
+};
+
+static bool IsCompressible(const std::string &mime) {
+    return mime.compare(0, 5, "text/") == 0 || mime.find("xml") != std::string::npos
+           || mime.find("javascript") != std::string::npos;
+}
+
+static bool Gzip(const std::string &src, std::string &dst) {
+#ifdef TWS_WITH_ZLIB
+    z_stream zs = {};
+    // windowBits 15 + 16: 输出 gzip 格式
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    dst.resize(deflateBound(&zs, src.size()) + 32);
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(src.data()));
+    zs.avail_in = src.size();
+    zs.next_out = reinterpret_cast<Bytef *>(&dst[0]);
+    zs.avail_out = dst.size();
+    int ret = deflate(&zs, Z_FINISH);
+    deflateEnd(&zs);
+    if (ret != Z_STREAM_END) {
+        // 不保留不完整的输出, 否则会作为 gzip 版本打包
+        dst.clear();
+        return false;
+    }
+    dst.resize(zs.total_out);
+    return true;
+#else
+    (void) src;
+    (void) dst;
+    return false;
+#endif
+}
+
+static bool ReadAll(const fs::path &file, std::string &data) {
+    std::ifstream fin(file, std::ios::binary);
+    if (!fin) { return false; }
+    data.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <srcDir> <output> [--no-gzip]\n", argv[0]);
+        return 1;
+    }
+    fs::path root(argv[1]);
+    std::string output(argv[2]);
+    bool useGzip = !(argc > 3 && std::string(argv[3]) == "--no-gzip");
+
+    std::vector<PackItem> items;
+    for (const auto &it: fs::recursive_directory_iterator(root)) {
+        if (!it.is_regular_file()) { continue; }
+        PackItem item{};
+        item.path = "/" + fs::relative(it.path(), root).generic_string();
+        item.mime = std::string(ResponseHeader::ContentType(item.path));
+        if (!ReadAll(it.path(), item.data)) {
+            fprintf(stderr, "read %s error\n", it.path().c_str());
+            return 1;
+        }
+        char etag[32];
+        snprintf(etag, sizeof(etag), "\"%016llx\"",
+                 static_cast<unsigned long long>(BundleHash(item.data.data(), item.data.size())));
+        item.etag = etag;
+        // 压缩收益不足 10% 时不保留 gzip 版本
+        if (useGzip && IsCompressible(item.mime) && Gzip(item.data, item.gzip)
+            && item.gzip.size() * 10 > item.data.size() * 9) {
+            item.gzip.clear();
+        }
+        items.push_back(std::move(item));
+    }
+    std::sort(items.begin(), items.end(), [](const PackItem &a, const PackItem &b) {
+        return a.path < b.path;
+    });
+
+    BundleHeader header{};
+    memcpy(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+    header.version = BUNDLE_VERSION;
+    header.count = items.size();
+    header.indexOffset = sizeof(BundleHeader);
+    header.stringOffset = header.indexOffset + items.size() * sizeof(BundleEntry);
+
+    std::string strings;
+    auto addString = [&strings](const std::string &str, uint64_t &off, uint32_t &len) {
+        off = strings.size();
+        len = str.size();
+        strings += str;
+    };
+    for (auto &item: items) {
+        addString(item.path, item.entry.pathOff, item.entry.pathLen);
+        addString(item.mime, item.entry.mimeOff, item.entry.mimeLen);
+        addString(item.etag, item.entry.etagOff, item.entry.etagLen);
+    }
+    header.stringLen = strings.size();
+
+    // 文件数据按页对齐, 便于 sendfile 和按页换入
+    uint64_t off = BundleAlign(header.stringOffset + header.stringLen);
+    for (auto &item: items) {
+        item.entry.dataOff = off;
+        item.entry.dataLen = item.data.size();
+        off = BundleAlign(off + item.data.size());
+        if (!item.gzip.empty()) {
+            item.entry.gzipOff = off;
+            item.entry.gzipLen = item.gzip.size();
+            off = BundleAlign(off + item.gzip.size());
+        }
+    }
+    header.fileSize = off;
+
+    // 先写临时文件再 rename, 运行中的服务器不会读到半个文件
+    std::string tmpName = output + ".tmp";
+    std::ofstream fout(tmpName, std::ios::binary | std::ios::trunc);
+    if (!fout) {
+        fprintf(stderr, "open %s error\n", tmpName.c_str());
+        return 1;
+    }
+    std::string image(header.fileSize, '\0');
+    memcpy(&image[0], &header, sizeof(header));
+    for (size_t i = 0; i < items.size(); ++i) {
+        const PackItem &item = items[i];
+        memcpy(&image[header.indexOffset + i * sizeof(BundleEntry)], &item.entry, sizeof(BundleEntry));
+        std::copy(item.data.begin(), item.data.end(), image.begin() + item.entry.dataOff);
+        std::copy(item.gzip.begin(), item.gzip.end(), image.begin() + item.entry.gzipOff);
+    }
+    std::copy(strings.begin(), strings.end(), image.begin() + header.stringOffset);
+    fout.write(image.data(), image.size());
+    fout.close();
+    if (!fout || rename(tmpName.c_str(), output.c_str()) != 0) {
+        fprintf(stderr, "write %s error\n", output.c_str());
+        return 1;
+    }
+    printf("packed %zu files into %s (%llu bytes)\n", items.size(), output.c_str(),
+           static_cast<unsigned long long>(header.fileSize));
+    return 0;
+}
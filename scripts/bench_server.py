@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+# 基准测试的公共部分: 以指定配置在临时目录中启动服务器, 在长连接上发送请求并统计延迟
+# 服务器从工作目录读取 server_config.json 和 resources/, 临时目录中写入合并后的配置, 并链接仓库 resources 中的文件
+import copy
+import json
+import os
+import shutil
+import socket
+import subprocess
+import tempfile
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# 与被测功能无关又会干扰测量的部分: 日志, 单 IP 限制, 带宽规则和请求追踪
+QUIET = {"server": {"openLog": False, "clientLimit": {"maxConns": 0, "requestRate": 0},
+                    "bandwidth": {"rules": []}, "trace": {"sampleRate": 0}}}
+
+
+def merge(base, override):
+    result = copy.deepcopy(base)
+    for key, value in override.items():
+        if isinstance(value, dict) and isinstance(result.get(key), dict):
+            result[key] = merge(result[key], value)
+        else:
+            result[key] = value
+    return result
+
+
+class Server:
+    # files: {相对 resources 的路径: 字节数}, 测试用的文件只生成在临时目录中
+    def __init__(self, binary, *overrides, env=None, files=None):
+        with open(os.path.join(ROOT, "server_config.json")) as f:
+            self.config = json.load(f)
+        for override in (QUIET,) + overrides:
+            self.config = merge(self.config, override)
+        self.port = self.config["server"]["port"]
+        self.binary = os.path.abspath(binary)
+        self.env = dict(os.environ, **(env or {}))
+        self.files = files or {}
+        self.dir = None
+        self.proc = None
+
+    def __enter__(self):
+        self.dir = tempfile.mkdtemp(prefix="tws-bench-")
+        with open(os.path.join(self.dir, "server_config.json"), "w") as f:
+            json.dump(self.config, f, indent=2)
+        resources = os.path.join(self.dir, "resources")
+        os.mkdir(resources)
+        for name in os.listdir(os.path.join(ROOT, "resources")):
+            os.symlink(os.path.join(ROOT, "resources", name), os.path.join(resources, name))
+        block = os.urandom(1 << 20)
+        for path, size in self.files.items():
+            path = os.path.join(resources, path.lstrip("/"))
+            os.makedirs(os.path.dirname(path), exist_ok=True)
+            with open(path, "wb") as f:
+                for off in range(0, size, len(block)):
+                    f.write(block[:size - off])
+        self.proc = subprocess.Popen([self.binary], cwd=self.dir, env=self.env,
+                                     stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        deadline = time.time() + 10
+        while True:
+            if self.proc.poll() is not None:
+                raise RuntimeError("server exited with %d" % self.proc.returncode)
+            try:
+                socket.create_connection(("127.0.0.1", self.port), timeout=1).close()
+                return self
+            except OSError:
+                if time.time() > deadline:
+                    raise
+                time.sleep(0.05)
+
+    def __exit__(self, *exc):
+        self.proc.terminate()
+        try:
+            self.proc.wait(5)
+        except subprocess.TimeoutExpired:
+            self.proc.kill()
+            self.proc.wait()
+        shutil.rmtree(self.dir, ignore_errors=True)
+
+
+def connect(port):
+    sock = socket.create_connection(("127.0.0.1", port))
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    return sock
+
+
+def get_request(path):
+    return ("GET %s HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n" % path).encode()
+
+
+def read_response(sock, buff, sink=False):
+    # 返回 (状态码, 剩余数据); sink 为 True 时不保留响应体, 用于大文件
+    while b"\r\n\r\n" not in buff:
+        chunk = sock.recv(65536)
+        if not chunk:
+            raise ConnectionError("closed")
+        buff += chunk
+    head, _, rest = buff.partition(b"\r\n\r\n")
+    status = int(head.split(b" ", 2)[1])
+    length = 0
+    for line in head.split(b"\r\n")[1:]:
+        name, _, value = line.partition(b":")
+        if name.strip().lower() == b"content-length":
+            length = int(value)
+    if sink:
+        left = length - len(rest)
+        rest = rest[length:]
+        while left > 0:
+            chunk = sock.recv(min(left, 1 << 20))
+            if not chunk:
+                raise ConnectionError("closed")
+            left -= len(chunk)
+        return status, rest
+    while len(rest) < length:
+        chunk = sock.recv(65536)
+        if not chunk:
+            raise ConnectionError("closed")
+        rest += chunk
+    return status, rest[length:]
+
+
+def percentile(samples, p):
+    return samples[min(len(samples) - 1, int(len(samples) * p))] / 1000
+
+
+def report(name, samples):
+    samples.sort()
+    print("%-14s n %6d  p50 %9.1f us  p90 %9.1f us  p99 %9.1f us  max %9.1f us"
+          % (name, len(samples), percentile(samples, 0.5), percentile(samples, 0.9), percentile(samples, 0.99),
+             samples[-1] / 1000))
+    return percentile(samples, 0.99)
@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+# 检查超过 1 MiB 的请求体得到 413: 客户端像常见的 HTTP 库一样先发完整个请求再读响应,
+# 服务器回应 413 后仍要读走剩余的请求体, 否则关闭时的 RST 会让客户端的发送出错, 收不到 413
+# 用法: 在仓库根目录运行 python3 scripts/body_limit_test.py [--binary ./TryWebServer] [--size 2097152] [--rounds 10]
+import argparse
+import socket
+import sys
+
+from bench_server import Server
+
+
+def post(port, size):
+    sock = socket.create_connection(("127.0.0.1", port), timeout=10)
+    head = ("POST /login HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n"
+            "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: %d\r\n\r\n" % size)
+    error = None
+    try:
+        sock.sendall(head.encode() + b"x" * size)
+    except OSError as e:
+        error = "send: %s" % e
+    data = b""
+    try:
+        while True:
+            chunk = sock.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+    except OSError as e:
+        error = error or "recv: %s" % e
+    sock.close()
+    status = data.split(b"\r\n", 1)[0].decode(errors="replace")
+    return status, error
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--binary", default="./TryWebServer")
+    parser.add_argument("--size", type=int, default=2 << 20, help="请求体字节数")
+    parser.add_argument("--rounds", type=int, default=10)
+    args = parser.parse_args()
+
+    failed = 0
+    with Server(args.binary) as server:
+        for _ in range(args.rounds):
+            status, error = post(server.port, args.size)
+            if " 413 " not in status or error:
+                failed += 1
+                print("got %r, %s" % (status, error or "no error"))
+    print("%d/%d requests got 413" % (args.rounds - failed, args.rounds))
+    if failed:
+        print("FAIL: 413 lost")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+# 回环上单个长连接的请求延迟: 分别在关闭和开启忙轮询 (busyPoll) 时启动服务器, 对比 p50/p99
+# 忙轮询省掉的是事件循环睡眠和唤醒工作线程的时间, 请求之间可以用 --gap-us 留出空闲, 让关闭时的线程真正睡下去
+# 用法: 编译后在仓库根目录运行 python3 scripts/busy_poll_bench.py [--binary ./TryWebServer] [--requests 20000]
+import argparse
+import time
+
+from bench_server import Server, connect, get_request, read_response, report
+
+
+def run(args, name, overrides):
+    with Server(args.binary, overrides) as server:
+        sock = connect(server.port)
+        request = get_request(args.path)
+        buff = b""
+        samples = []
+        for i in range(args.warmup + args.requests):
+            if args.gap_us:
+                time.sleep(args.gap_us / 1e6)
+            begin = time.perf_counter_ns()
+            sock.sendall(request)
+            status, buff = read_response(sock, buff)
+            if i >= args.warmup:
+                samples.append(time.perf_counter_ns() - begin)
+            assert status == 200, status
+        sock.close()
+        samples.sort()
+        return report(name, samples), samples[len(samples) // 2] / 1000
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--binary", default="./TryWebServer")
+    parser.add_argument("--path", default="/index.html")
+    parser.add_argument("--requests", type=int, default=20000)
+    parser.add_argument("--warmup", type=int, default=1000)
+    parser.add_argument("--gap-us", type=int, default=0, help="两个请求之间的空闲时间")
+    parser.add_argument("--spin-us", type=int, default=200)
+    parser.add_argument("--socket-us", type=int, default=50)
+    args = parser.parse_args()
+
+    off_p99, off_p50 = run(args, "busy poll off", {"server": {"busyPoll": {"enabled": False}}})
+    on_p99, on_p50 = run(args, "busy poll on", {"server": {"busyPoll": {"enabled": True, "spinUs": args.spin_us,
+                                                                        "socketUs": args.socket_us}}})
+    print("on / off: p50 %.2f  p99 %.2f" % (on_p50 / off_p50, on_p99 / off_p99))
+
+
+if __name__ == "__main__":
+    main()
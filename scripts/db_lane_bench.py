@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+# 数据库变慢时静态请求的延迟: 分别在开启和关闭数据库队列 (dbThreadNum) 时启动服务器,
+# 并发登录占住数据库的同时测量静态 GET 的 p99
+# 服务器与 MySQL 之间经过一个本地代理, 代理把每条查询 (COM_QUERY) 推迟 --delay-ms 再转发
+# 用法: 本机 MySQL 按 server_config.json 配好后, 在仓库根目录运行
+#   python3 scripts/db_lane_bench.py [--binary ./TryWebServer] [--delay-ms 200] [--logins 32]
+# 数据库本身已经很慢时可以加 --no-proxy 直接连接
+# 准入控制会用 503 拒绝排队的请求, 掩盖线程被占满的效果, 测量时关闭
+import argparse
+import multiprocessing
+import socket
+import threading
+import time
+
+from bench_server import Server, connect, get_request, read_response, report
+
+COM_QUERY = 0x03
+
+
+class DelayProxy:
+    def __init__(self, upstream_port, delay):
+        self.upstream_port = upstream_port
+        self.delay = delay
+        self.listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.listener.bind(("127.0.0.1", 0))
+        self.listener.listen(128)
+        self.port = self.listener.getsockname()[1]
+        threading.Thread(target=self.accept, daemon=True).start()
+
+    def accept(self):
+        while True:
+            client, _ = self.listener.accept()
+            server = socket.create_connection(("127.0.0.1", self.upstream_port))
+            threading.Thread(target=self.pump, args=(client, server, True), daemon=True).start()
+            threading.Thread(target=self.pump, args=(server, client, False), daemon=True).start()
+
+    def pump(self, src, dst, is_request):
+        try:
+            while True:
+                data = src.recv(65536)
+                if not data:
+                    break
+                # 包头 3 字节长度 + 1 字节序号, 之后是命令; 只推迟查询, 握手和 ping 不受影响
+                if is_request and len(data) > 4 and data[4] == COM_QUERY:
+                    time.sleep(self.delay)
+                dst.sendall(data)
+        except OSError:
+            pass
+        finally:
+            src.close()
+            dst.close()
+
+
+def login(port, stop, counter):
+    body = b"username=bench&password=bench"
+    request = (b"POST /login HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n"
+               b"Content-Type: application/x-www-form-urlencoded\r\nContent-Length: %d\r\n\r\n" % len(body)) + body
+    sock, buff = None, b""
+    while not stop.is_set():
+        try:
+            if sock is None:
+                sock, buff = connect(port), b""
+            sock.sendall(request)
+            status, buff = read_response(sock, buff)
+            if status == 200:
+                with counter.get_lock():
+                    counter.value += 1
+            else:
+                # 503 等拒绝会关闭连接
+                sock.close()
+                sock = None
+        except OSError:
+            if sock:
+                sock.close()
+            sock = None
+
+
+def run(args, name, overrides):
+    base = {"mysql": {"port": args.db_port},
+            "server": {"threadNum": args.threads, "threadMax": args.threads,
+                       "admission": {"maxLimit": 0, "deadlineMs": 0}}}
+    with Server(args.binary, base, overrides) as server:
+        stop = multiprocessing.Event()
+        counter = multiprocessing.Value("i", 0)
+        loaders = [multiprocessing.Process(target=login, args=(server.port, stop, counter), daemon=True)
+                   for _ in range(args.logins)]
+        for loader in loaders:
+            loader.start()
+        time.sleep(1)
+
+        sock = connect(server.port)
+        request = get_request(args.path)
+        buff = b""
+        samples = []
+        start = time.perf_counter()
+        while len(samples) < args.requests and time.perf_counter() - start < args.max_seconds:
+            begin = time.perf_counter_ns()
+            sock.sendall(request)
+            status, buff = read_response(sock, buff)
+            samples.append(time.perf_counter_ns() - begin)
+            assert status == 200, status
+        elapsed = time.perf_counter() - start
+        sock.close()
+        stop.set()
+        for loader in loaders:
+            loader.join(args.delay_ms / 1000 * 4 + 5)
+            if loader.is_alive():
+                loader.terminate()
+        p99 = report(name, samples)
+        print("%-14s %d logins finished in %.1f s" % ("", counter.value, elapsed))
+        return p99
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--binary", default="./TryWebServer")
+    parser.add_argument("--path", default="/index.html", help="静态请求")
+    parser.add_argument("--requests", type=int, default=2000)
+    parser.add_argument("--max-seconds", type=float, default=30, help="静态请求被饿死时最多测这么久")
+    parser.add_argument("--logins", type=int, default=32, help="并发登录的连接数")
+    parser.add_argument("--delay-ms", type=int, default=200, help="每条查询的额外延迟")
+    parser.add_argument("--mysql-port", type=int, default=3306)
+    parser.add_argument("--no-proxy", action="store_true")
+    parser.add_argument("--threads", type=int, default=4, help="固定的工作线程数")
+    parser.add_argument("--db-threads", type=int, default=4)
+    args = parser.parse_args()
+    args.db_port = args.mysql_port
+    if not args.no_proxy:
+        args.db_port = DelayProxy(args.mysql_port, args.delay_ms / 1000).port
+
+    off = run(args, "db lane off", {"server": {"dbThreadNum": 0}})
+    on = run(args, "db lane on", {"server": {"dbThreadNum": args.db_threads}})
+    print("static p99 off / on: %.1fx" % (off / on))
+
+
+if __name__ == "__main__":
+    main()
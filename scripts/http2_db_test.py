@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+# 检查 HTTP/2 连接上的登录流不阻塞其他流: 开启数据库队列 (dbThreadNum) 启动服务器, 数据库查询经过延迟代理,
+# 同一连接上先发一个登录流, 再发两批静态 GET, 第二批在第一批完成后才发送; 静态流都应在登录流之前完成
+# 用法: 本机 MySQL 按 server_config.json 配好后, 在仓库根目录运行
+#   python3 scripts/http2_db_test.py [--binary ./TryWebServer] [--delay-ms 500] [--streams 20]
+# 数据库本身已经很慢时可以加 --no-proxy 直接连接
+import argparse
+import struct
+import sys
+import time
+
+from bench_server import Server, connect
+from db_lane_bench import DelayProxy
+from http2_test import PREFACE, frame, read_frames, status_of
+
+
+def literal(name, value):
+    # 不进入动态表的字面量头部, 名称和值都不超过 127 字节
+    return b"\x00" + bytes([len(name)]) + name + bytes([len(value)]) + value
+
+
+def run(port, path, streams):
+    sock = connect(port)
+    sock.sendall(PREFACE + frame(4, 0, 0))
+    body = b"username=bench&password=bench"
+    # :method POST, :scheme http, :path, :authority, content-type, content-length
+    login = (b"\x83\x86\x04\x06/login\x41\x09localhost" +
+             literal(b"content-type", b"application/x-www-form-urlencoded") +
+             literal(b"content-length", str(len(body)).encode()))
+    sock.sendall(frame(1, 0x04, 1, login) + frame(0, 0x01, 1, body))
+    get = b"\x82\x86\x04" + bytes([len(path)]) + path.encode() + b"\x41\x09localhost"
+    next_id = 3
+    batches = []
+
+    def send_batch():
+        nonlocal next_id
+        ids = list(range(next_id, next_id + streams * 2, 2))
+        next_id += streams * 2
+        sock.sendall(b"".join(frame(1, 0x05, stream_id, get) for stream_id in ids))
+        batches.append(ids)
+
+    start = time.perf_counter()
+    send_batch()
+    status = {}
+    finished = {}
+    for type_, flags, stream_id, payload in read_frames(sock):
+        if type_ == 4 and not flags & 0x01:
+            sock.sendall(frame(4, 0x01, 0))
+        elif type_ == 1:
+            status[stream_id] = status_of(payload)
+        elif type_ == 0 and payload:
+            sock.sendall(frame(8, 0, 0, struct.pack(">I", len(payload))))
+        elif type_ == 3 or type_ == 7:
+            print("%s on stream %d" % ("RST_STREAM" if type_ == 3 else "GOAWAY", stream_id))
+            break
+        if type_ in (0, 1) and flags & 0x01:
+            finished[stream_id] = time.perf_counter() - start
+            if len(batches) == 1 and all(s in finished for s in batches[0]):
+                # 登录流还在数据库队列中时, 同一连接上的新流也要继续处理
+                send_batch()
+            if 1 in finished and all(s in finished for batch in batches for s in batch):
+                break
+    sock.close()
+    return status, finished, [s for batch in batches for s in batch]
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--binary", default="./TryWebServer")
+    parser.add_argument("--path", default="/index.html", help="静态请求")
+    parser.add_argument("--streams", type=int, default=20, help="每批静态流的个数")
+    parser.add_argument("--delay-ms", type=int, default=500, help="每条查询的额外延迟")
+    parser.add_argument("--mysql-port", type=int, default=3306)
+    parser.add_argument("--no-proxy", action="store_true")
+    parser.add_argument("--db-threads", type=int, default=2)
+    args = parser.parse_args()
+    db_port = args.mysql_port
+    if not args.no_proxy:
+        db_port = DelayProxy(args.mysql_port, args.delay_ms / 1000).port
+
+    config = {"mysql": {"port": db_port},
+              "server": {"dbThreadNum": args.db_threads, "http2": {"enabled": True}}}
+    with Server(args.binary, config) as server:
+        status, finished, statics = run(server.port, args.path, args.streams)
+
+    if 1 not in finished:
+        print("FAIL: login stream got no response")
+        return 1
+    late = [s for s in statics if s not in finished or finished[s] > finished[1]]
+    ok = sum(1 for s in statics if status.get(s) == 200)
+    print("login stream: status %s in %.1f ms" % (status.get(1), finished[1] * 1000))
+    print("static streams: %d/%d ok, last done in %.1f ms, %d finished after the login stream"
+          % (ok, len(statics), max(finished.get(s, 0) for s in statics) * 1000, len(late)))
+    if late or ok != len(statics):
+        print("FAIL: static streams waited for the database")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+# 检查 HTTP/2 (h2c, prior knowledge): 一个连接上并发多个流, 小窗口下的流量控制, 以及 /metrics 中的 HTTP/2 计数
+# 响应体与同一路径的 HTTP/1.1 响应比较
+# 服务器需要开启 http2.enabled
+# 用法: 启动服务器后运行 python3 scripts/http2_test.py [--port 9006] [--path /index.html] [--streams 300] [--window 65535]
+import argparse
+import http.client
+import socket
+import struct
+import time
+
+PREFACE = b"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+# 静态表中的 :status
+STATUS = {0x88: 200, 0x89: 204, 0x8a: 206, 0x8b: 304, 0x8c: 400, 0x8d: 404, 0x8e: 500}
+
+
+def frame(type_, flags, stream_id, payload=b""):
+    return struct.pack(">I", len(payload))[1:] + bytes([type_, flags]) + struct.pack(">I", stream_id) + payload
+
+
+def status_of(block):
+    # 服务器的 :status 总是头部块的第一个字段: 静态表下标, 或名称下标 8 的字面量
+    if block[0] in STATUS:
+        return STATUS[block[0]]
+    if block[0] & 0x0f == 8 or block[0] & 0x3f == 8:
+        return int(block[2:2 + block[1]])
+    return None
+
+
+def read_frames(sock):
+    buf = b""
+    while True:
+        while len(buf) >= 9:
+            length = int.from_bytes(buf[:3], "big")
+            if len(buf) < 9 + length:
+                break
+            yield buf[3], buf[4], int.from_bytes(buf[5:9], "big") & 0x7fffffff, buf[9:9 + length]
+            buf = buf[9 + length:]
+        data = sock.recv(65536)
+        if not data:
+            return
+        buf += data
+
+
+def run(port, path, streams, window):
+    sock = socket.create_connection(("127.0.0.1", port))
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    # SETTINGS_INITIAL_WINDOW_SIZE
+    sock.sendall(PREFACE + frame(4, 0, 0, struct.pack(">HI", 4, window)))
+    # :method GET, :scheme http, :path 字面量不进入动态表, :authority
+    block = b"\x82\x86\x04" + bytes([len(path)]) + path.encode() + b"\x41\x09localhost"
+    pending = list(range(1, streams * 2, 2))
+    results = {}
+    limit = 1
+
+    def send_more():
+        while pending and len([s for s in results if results[s][2] is False]) < limit:
+            stream_id = pending.pop(0)
+            results[stream_id] = [None, b"", False]
+            sock.sendall(frame(1, 0x05, stream_id, block))
+
+    send_more()
+    for type_, flags, stream_id, payload in read_frames(sock):
+        if type_ == 4 and not flags & 0x01:
+            for i in range(0, len(payload), 6):
+                key, value = struct.unpack(">HI", payload[i:i + 6])
+                if key == 3:
+                    limit = value
+            sock.sendall(frame(4, 0x01, 0))
+        elif type_ == 1:
+            results[stream_id][0] = status_of(payload)
+        elif type_ == 0:
+            results[stream_id][1] += payload
+            if payload:
+                sock.sendall(frame(8, 0, 0, struct.pack(">I", len(payload))))
+                if not flags & 0x01:
+                    sock.sendall(frame(8, 0, stream_id, struct.pack(">I", len(payload))))
+        elif type_ == 3 or type_ == 7:
+            print("%s on stream %d, error %d" % ("RST_STREAM" if type_ == 3 else "GOAWAY", stream_id,
+                                                  struct.unpack(">I", payload[-4:] if type_ == 3 else payload[4:8])[0]))
+            if type_ == 7:
+                break
+        if type_ in (0, 1, 3) and (flags & 0x01 or type_ == 3):
+            results[stream_id][2] = True
+            send_more()
+            if not pending and all(r[2] for r in results.values()):
+                break
+    sock.close()
+    return results, limit
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--port", type=int, default=9006)
+    parser.add_argument("--path", default="/index.html")
+    parser.add_argument("--streams", type=int, default=300)
+    parser.add_argument("--window", type=int, default=65535, help="流窗口, 设小可以检查流量控制")
+    args = parser.parse_args()
+
+    conn = http.client.HTTPConnection("127.0.0.1", args.port)
+    conn.request("GET", args.path)
+    expected = conn.getresponse().read()
+    conn.close()
+
+    start = time.perf_counter()
+    results, limit = run(args.port, args.path, args.streams, args.window)
+    elapsed = time.perf_counter() - start
+    statuses = [r[0] for r in results.values()]
+    same = sum(1 for r in results.values() if r[0] == 200 and r[1] == expected)
+    print("%d streams (max concurrent %d): %d ok, %d identical to HTTP/1.1, %d 429, %.1f streams/s"
+          % (len(results), limit, statuses.count(200), same, statuses.count(429), len(results) / elapsed))
+
+    conn = http.client.HTTPConnection("127.0.0.1", args.port)
+    conn.request("GET", "/metrics")
+    for line in conn.getresponse().read().decode().splitlines():
+        if line.startswith("tws_http2_"):
+            print(line)
+
+
+if __name__ == "__main__":
+    main()
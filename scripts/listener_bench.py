@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+# 对比同一个请求经 TCP 回环和 AF_UNIX 监听套接字的延迟
+# 用法: 在 server_config.json 的 listeners 中加入 {"address": "unix:/tmp/tws.sock", "backlog": 1024, "clientLimit": false}
+# 启动服务器后运行 python3 scripts/listener_bench.py [--port 9006] [--unix /tmp/tws.sock] [--requests 20000]
+import argparse
+import socket
+import time
+
+
+def connect(target):
+    if isinstance(target, str):
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    else:
+        sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    sock.connect(target)
+    return sock
+
+
+def read_response(sock, buff):
+    while b"\r\n\r\n" not in buff:
+        chunk = sock.recv(65536)
+        if not chunk:
+            raise ConnectionError("closed")
+        buff += chunk
+    head, _, rest = buff.partition(b"\r\n\r\n")
+    length = 0
+    for line in head.split(b"\r\n")[1:]:
+        name, _, value = line.partition(b":")
+        if name.strip().lower() == b"content-length":
+            length = int(value)
+    while len(rest) < length:
+        chunk = sock.recv(65536)
+        if not chunk:
+            raise ConnectionError("closed")
+        rest += chunk
+    return rest[length:]
+
+
+def bench(target, path, requests, warmup):
+    request = ("GET %s HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n" % path).encode()
+    sock = connect(target)
+    buff = b""
+    samples = []
+    for i in range(warmup + requests):
+        start = time.perf_counter_ns()
+        sock.sendall(request)
+        buff = read_response(sock, buff)
+        if i >= warmup:
+            samples.append(time.perf_counter_ns() - start)
+    sock.close()
+    samples.sort()
+    return samples
+
+
+def report(name, samples):
+    def pct(p):
+        return samples[min(len(samples) - 1, int(len(samples) * p))] / 1000
+
+    mean = sum(samples) / len(samples) / 1000
+    print("%-6s mean %8.1f us  p50 %8.1f us  p90 %8.1f us  p99 %8.1f us" % (name, mean, pct(0.5), pct(0.9), pct(0.99)))
+    return mean
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--port", type=int, default=9006)
+    parser.add_argument("--unix", default="/tmp/tws.sock")
+    parser.add_argument("--path", default="/")
+    parser.add_argument("--requests", type=int, default=20000)
+    parser.add_argument("--warmup", type=int, default=1000)
+    args = parser.parse_args()
+
+    tcp = report("tcp", bench(("127.0.0.1", args.port), args.path, args.requests, args.warmup))
+    unix = report("unix", bench(args.unix, args.path, args.requests, args.warmup))
+    print("unix / tcp mean: %.2f" % (unix / tcp))
+
+
+if __name__ == "__main__":
+    main()
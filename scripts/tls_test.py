@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+# 检查 TLS 监听: 完整握手, 会话恢复, 长连接上的多次请求, 以及 /metrics 中的 TLS 计数
+# 用法: 生成自签名证书
+#   openssl req -x509 -newkey rsa:2048 -nodes -days 365 -subj /CN=localhost -keyout tls/key.pem -out tls/cert.pem
+# 在 server_config.json 的 tls 中填入 certFile/keyFile, listeners 中加入 {"address": "0.0.0.0:9443", ..., "tls": true}
+# 启动服务器后运行 python3 scripts/tls_test.py [--port 9443] [--metrics-port 9006] [--requests 200]
+import argparse
+import http.client
+import socket
+import ssl
+import time
+
+
+def request(sock, path):
+    sock.sendall(("GET %s HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n" % path).encode())
+    response = http.client.HTTPResponse(sock)
+    response.begin()
+    body = response.read()
+    return response.status, len(body)
+
+
+def session(context, port, path, count, reuse=None):
+    raw = socket.create_connection(("127.0.0.1", port))
+    sock = context.wrap_socket(raw, server_hostname="localhost", session=reuse)
+    statuses = [request(sock, path)[0] for _ in range(count)]
+    saved = sock.session
+    resumed = sock.session_reused
+    sock.close()
+    return statuses, saved, resumed
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--port", type=int, default=9443)
+    parser.add_argument("--metrics-port", type=int, default=9006)
+    parser.add_argument("--path", default="/")
+    parser.add_argument("--requests", type=int, default=200)
+    parser.add_argument("--tls12", action="store_true", help="测试 TLS 1.2 的会话缓存")
+    args = parser.parse_args()
+
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+    context.check_hostname = False
+    context.verify_mode = ssl.CERT_NONE
+    if args.tls12:
+        context.maximum_version = ssl.TLSVersion.TLSv1_2
+
+    start = time.perf_counter()
+    statuses, saved, resumed = session(context, args.port, args.path, args.requests)
+    elapsed = time.perf_counter() - start
+    print("full handshake: resumed=%s, %d requests, %d ok, %.1f req/s"
+          % (resumed, len(statuses), statuses.count(200), len(statuses) / elapsed))
+
+    statuses, _, resumed = session(context, args.port, args.path, 1, saved)
+    print("second handshake: resumed=%s, status %s" % (resumed, statuses[0]))
+
+    conn = http.client.HTTPConnection("127.0.0.1", args.metrics_port)
+    conn.request("GET", "/metrics")
+    for line in conn.getresponse().read().decode().splitlines():
+        if line.startswith("tws_tls_"):
+            print(line)
+
+
+if __name__ == "__main__":
+    main()
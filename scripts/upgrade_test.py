@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+# 升级过程中持续发送请求, 检查没有失败的请求
+# 用法: 先启动服务器, 再运行 python3 scripts/upgrade_test.py [--port 9006] [--path /] [--threads 16]
+# 压测开始后向服务器发送 SIGTTIN, 新进程接管后旧进程排空退出
+import argparse
+import http.client
+import os
+import signal
+import subprocess
+import threading
+import time
+
+
+def server_pids():
+    out = subprocess.run(["pgrep", "-x", "TryWebServer"], capture_output=True, text=True).stdout
+    return sorted(int(pid) for pid in out.split())
+
+
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.ok = 0
+        self.failed = []
+
+    def add(self, ok, reason=None):
+        with self.lock:
+            if ok:
+                self.ok += 1
+            else:
+                self.failed.append(reason)
+
+
+def worker(args, stats, stop, keep_alive):
+    conn = None
+    while not stop.is_set():
+        reused = conn is not None
+        try:
+            if conn is None:
+                conn = http.client.HTTPConnection("127.0.0.1", args.port, timeout=10)
+            headers = {} if keep_alive else {"Connection": "close"}
+            conn.request("GET", args.path, headers=headers)
+            resp = conn.getresponse()
+            resp.read()
+            stats.add(resp.status == 200, "status %d" % resp.status)
+            if not keep_alive or resp.getheader("Connection", "").lower() == "close":
+                conn.close()
+                conn = None
+        except (http.client.RemoteDisconnected, ConnectionResetError, BrokenPipeError) as e:
+            conn.close()
+            conn = None
+            if not reused:
+                stats.add(False, repr(e))
+            # 空闲的长连接被服务器关闭, 与 HTTP 客户端的通常做法一样重试
+        except Exception as e:
+            if conn:
+                conn.close()
+            conn = None
+            stats.add(False, repr(e))
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--port", type=int, default=9006)
+    parser.add_argument("--path", default="/")
+    parser.add_argument("--threads", type=int, default=16)
+    parser.add_argument("--seconds", type=float, default=6)
+    args = parser.parse_args()
+
+    old = server_pids()
+    if len(old) != 1:
+        print("expect one running server, found:", old)
+        return 1
+    stats = Stats()
+    stop = threading.Event()
+    threads = [threading.Thread(target=worker, args=(args, stats, stop, i % 2 == 0)) for i in range(args.threads)]
+    for t in threads:
+        t.start()
+    time.sleep(args.seconds / 3)
+    print("upgrade pid", old[0])
+    os.kill(old[0], signal.SIGTTIN)
+    time.sleep(args.seconds * 2 / 3)
+    stop.set()
+    for t in threads:
+        t.join()
+
+    now = server_pids()
+    print("requests ok: %d, failed: %d" % (stats.ok, len(stats.failed)))
+    for reason in stats.failed[:10]:
+        print("  ", reason)
+    print("servers before:", old, "after:", now)
+    return 0 if not stats.failed and old[0] not in now and len(now) == 1 else 1
+
+
+if __name__ == "__main__":
+    exit(main())
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+# 检查 WebSocket: 握手, 多个客户端收到同一条广播, 各种长度的掩码帧 (含 SIMD 尾部), Ping/Pong, 超长消息和关闭握手,
+# 以及 /metrics 中的 WebSocket 计数
+# 客户端的消息经服务器转发才能检查广播, 服务器需要设置 websocket.path 并开启 websocket.relay
+# 用法: 启动服务器后运行 python3 scripts/websocket_test.py [--port 9006] [--path /ws] [--clients 8] [--max 65536]
+import argparse
+import base64
+import hashlib
+import http.client
+import os
+import socket
+import struct
+import time
+
+GUID = b"258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+
+class Client:
+    def __init__(self, port, path):
+        self.sock = socket.create_connection(("127.0.0.1", port))
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.sock.settimeout(5)
+        key = base64.b64encode(os.urandom(16))
+        self.sock.sendall(b"GET " + path.encode() + b" HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\n"
+                          b"Connection: keep-alive, Upgrade\r\nSec-WebSocket-Key: " + key +
+                          b"\r\nSec-WebSocket-Version: 13\r\n\r\n")
+        self.buf = b""
+        while b"\r\n\r\n" not in self.buf:
+            self.buf += self.recv()
+        head, self.buf = self.buf.split(b"\r\n\r\n", 1)
+        accept = base64.b64encode(hashlib.sha1(key + GUID).digest())
+        self.ok = head.startswith(b"HTTP/1.1 101 ") and b"Sec-WebSocket-Accept: " + accept in head
+
+    def recv(self):
+        data = self.sock.recv(1 << 20)
+        if not data:
+            raise EOFError
+        return data
+
+    def send(self, opcode, payload, fin=True):
+        mask = os.urandom(4)
+        head = bytes([(0x80 if fin else 0) | opcode])
+        if len(payload) < 126:
+            head += bytes([0x80 | len(payload)])
+        elif len(payload) < 65536:
+            head += bytes([0x80 | 126]) + struct.pack(">H", len(payload))
+        else:
+            head += bytes([0x80 | 127]) + struct.pack(">Q", len(payload))
+        masked = bytes(b ^ mask[i & 3] for i, b in enumerate(payload))
+        self.sock.sendall(head + mask + masked)
+
+    def read(self):
+        while True:
+            if len(self.buf) >= 2:
+                length, pos = self.buf[1] & 0x7f, 2
+                if length == 126:
+                    length, pos = int.from_bytes(self.buf[2:4], "big"), 4
+                elif length == 127:
+                    length, pos = int.from_bytes(self.buf[2:10], "big"), 10
+                if len(self.buf) >= pos + length:
+                    opcode, payload = self.buf[0] & 0x0f, self.buf[pos:pos + length]
+                    self.buf = self.buf[pos + length:]
+                    return opcode, payload
+            self.buf += self.recv()
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--port", type=int, default=9006)
+    parser.add_argument("--path", default="/ws")
+    parser.add_argument("--clients", type=int, default=8)
+    parser.add_argument("--max", type=int, default=65536, help="服务器的 maxMessageSize")
+    args = parser.parse_args()
+
+    clients = [Client(args.port, args.path) for _ in range(args.clients)]
+    print("handshake: %d/%d ok" % (sum(c.ok for c in clients), len(clients)))
+
+    # 长度覆盖 16/32 字节块的边界和各种尾部
+    sizes = [0, 1, 3, 15, 16, 17, 31, 33, 125, 126, 127, 1000, 4099, 65535, args.max]
+    start = time.perf_counter()
+    received = 0
+    for i, size in enumerate(sizes):
+        opcode = 1 if i % 2 == 0 else 2
+        payload = (b"abcdefghijklmnopqrstuvwxyz0123456789" * (size // 36 + 1))[:size] if opcode == 1 else os.urandom(size)
+        clients[i % len(clients)].send(opcode, payload)
+        for c in clients:
+            if c.read() == (opcode, payload):
+                received += 1
+    elapsed = time.perf_counter() - start
+    print("broadcast: %d messages, %d/%d received intact, %.1f ms"
+          % (len(sizes), received, len(sizes) * len(clients), elapsed * 1000))
+
+    # 分片的文本消息, 中间夹一个 Ping
+    c = clients[0]
+    c.send(1, "你好, ".encode(), fin=False)
+    c.send(9, b"ping")
+    c.send(0, "世界".encode())
+    pong = c.read()
+    message = [other.read() for other in clients]
+    print("ping: %s, fragmented: %s" % (pong == (0xa, b"ping"), all(m == (1, "你好, 世界".encode()) for m in message)))
+
+    # 超过 maxMessageSize 时以 1009 关闭
+    big = clients[-1]
+    big.send(2, b"x" * (args.max + 1))
+    opcode, payload = big.read()
+    print("too big: close %s" % (struct.unpack(">H", payload[:2])[0] if opcode == 8 else "missing"))
+
+    # 正常关闭: 服务器回送关闭帧后断开
+    c.send(8, struct.pack(">H", 1000) + b"bye")
+    opcode, payload = c.read()
+    try:
+        closed = c.recv() == b""
+    except EOFError:
+        closed = True
+    print("close: echo %s, disconnected %s" % (opcode == 8 and payload[:2] == struct.pack(">H", 1000), closed))
+
+    for client in clients:
+        client.sock.close()
+    time.sleep(0.1)
+    conn = http.client.HTTPConnection("127.0.0.1", args.port)
+    conn.request("GET", "/metrics")
+    for line in conn.getresponse().read().decode().splitlines():
+        if line.startswith("tws_websocket_"):
+            print(line)
+
+
+if __name__ == "__main__":
+    main()
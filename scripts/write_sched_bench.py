@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+# 大文件下载占满工作线程时, 小请求的延迟: 分别在开启和关闭写配额 (writeQuantum/notSentLowat) 时启动服务器测量
+# 用法: 编译后在仓库根目录运行 python3 scripts/write_sched_bench.py [--binary ./TryWebServer] [--downloads 8]
+import argparse
+import multiprocessing
+import time
+
+from bench_server import Server, connect, get_request, read_response, report
+
+LARGE_PATH = "/bench/large.bin"
+
+
+def download(port, stop, counter):
+    sock = connect(port)
+    request = get_request(LARGE_PATH)
+    buff = b""
+    while not stop.is_set():
+        sock.sendall(request)
+        _, buff = read_response(sock, buff, sink=True)
+        with counter.get_lock():
+            counter.value += 1
+    sock.close()
+
+
+def run(args, name, overrides):
+    files = {LARGE_PATH: args.large_mb << 20}
+    threads = {"server": {"threadNum": args.threads, "threadMax": args.threads}}
+    with Server(args.binary, threads, overrides, files=files) as server:
+        stop = multiprocessing.Event()
+        counter = multiprocessing.Value("i", 0)
+        loaders = [multiprocessing.Process(target=download, args=(server.port, stop, counter), daemon=True)
+                   for _ in range(args.downloads)]
+        for loader in loaders:
+            loader.start()
+        time.sleep(1)
+
+        sock = connect(server.port)
+        request = get_request(args.path)
+        buff = b""
+        samples = []
+        start = time.perf_counter()
+        for _ in range(args.requests):
+            begin = time.perf_counter_ns()
+            sock.sendall(request)
+            status, buff = read_response(sock, buff)
+            samples.append(time.perf_counter_ns() - begin)
+            assert status == 200, status
+        elapsed = time.perf_counter() - start
+        sock.close()
+        stop.set()
+        for loader in loaders:
+            loader.join(30)
+            if loader.is_alive():
+                loader.terminate()
+        p99 = report(name, samples)
+        print("%-14s %d large downloads of %d MB in %.1f s" % ("", counter.value, args.large_mb, elapsed))
+        return p99
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--binary", default="./TryWebServer")
+    parser.add_argument("--path", default="/index.html", help="小请求")
+    parser.add_argument("--requests", type=int, default=2000)
+    parser.add_argument("--downloads", type=int, default=8, help="并发下载大文件的连接数")
+    parser.add_argument("--large-mb", type=int, default=256)
+    parser.add_argument("--threads", type=int, default=4, help="固定的工作线程数")
+    parser.add_argument("--quantum", type=int, default=262144)
+    parser.add_argument("--lowat", type=int, default=131072)
+    args = parser.parse_args()
+
+    off = run(args, "quantum off", {"server": {"writeQuantum": 0, "notSentLowat": 0}})
+    on = run(args, "quantum on", {"server": {"writeQuantum": args.quantum, "notSentLowat": args.lowat}})
+    print("small request p99 on / off: %.2f" % (on / off))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,61 @@
+// 静态 GET 的响应头构造不应产生堆分配
+// 替换全局 operator new 计数, 在连接缓冲区已经分配好之后构造响应头
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string_view>
+
+#include "../code/http/response_header.h"
+
+namespace {
+    size_t newCount = 0;
+    bool isCounting = false;
+}
+
+void *operator new(size_t size) {
+    if (isCounting) { ++newCount; }
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr) { throw std::bad_alloc(); }
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+// 与 HttpResponse::MakeResponse 对静态文件的写法一致: 状态行, Connection, Content-type, Date, Content-length
+static void MakeHead(Buffer &buff, std::string_view path, size_t len) {
+    ResponseHeader::AppendStatusLine(buff, 200);
+    ResponseHeader::AppendConnection(buff, true, 5);
+    ResponseHeader::AppendContentType(buff, path);
+    ResponseHeader::AppendDate(buff);
+    ResponseHeader::AppendContentLength(buff, len);
+}
+
+int main() {
+    const std::string_view paths[] = {"/index.html", "/images/profile.jpg", "/video/xxx.mp4", "/unknown"};
+    Buffer buff;
+    // 第一次调用初始化线程的 Date 缓存
+    MakeHead(buff, paths[0], 0);
+    buff.RetrieveAll();
+
+    isCounting = true;
+    size_t bytes = 0;
+    for (size_t i = 0; i < 100000; ++i) {
+        MakeHead(buff, paths[i % 4], i * 7919);
+        bytes += buff.ReadableBytes();
+        buff.RetrieveAll();
+    }
+    isCounting = false;
+
+    printf("%zu header bytes, %zu operator new calls\n", bytes, newCount);
+    if (newCount != 0) {
+        fprintf(stderr, "FAIL: static GET header path allocated\n");
+        return 1;
+    }
+    return 0;
+}